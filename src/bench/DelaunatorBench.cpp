@@ -0,0 +1,141 @@
+//
+// Created by LiangKeJin on 2024/8/14.
+//
+// Delaunator 构建吞吐，比较原来的 compare + std::sort 和预计算距离 key + 基数排序两条路径
+// 输入为稠密网格形变的典型分布: 带抖动的规则控制网格，加上一块随机分布的关键点
+// --threads 为 key sort 路径预排序的线程数，默认为 CPU 核数
+//
+//   DelaunatorBench [--sizes 1000,10000,100000,1000000] [--repeat 5] [--threads n] [--out result.json]
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "utils/Delaunator.h"
+#include "utils/TimeUtils.h"
+
+struct DelaunatorBenchResult {
+    std::size_t points = 0;
+    std::size_t triangles = 0;
+    double legacyMs = 0;
+    double keySortMs = 0;
+    bool same = false;
+};
+
+/**
+ * 3/4 的点为抖动过的 sqrt x sqrt 网格，1/4 为中间区域的随机点
+ */
+static std::vector<float> meshPoints(std::size_t count, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::size_t gridCount = count * 3 / 4;
+    int side = std::max(2, (int) std::sqrt((double) gridCount));
+    std::uniform_real_distribution<float> jitter(-0.2f, 0.2f);
+    std::uniform_real_distribution<float> center(0.3f * (float) side, 0.7f * (float) side);
+    std::vector<float> points;
+    points.reserve(count * 2);
+    for (int y = 0; y < side; ++y) {
+        for (int x = 0; x < side; ++x) {
+            points.push_back((float) x + jitter(rng));
+            points.push_back((float) y + jitter(rng));
+        }
+    }
+    while (points.size() < count * 2) {
+        points.push_back(center(rng));
+        points.push_back(center(rng));
+    }
+    return points;
+}
+
+static double medianMs(std::vector<double> costs) {
+    std::sort(costs.begin(), costs.end());
+    return costs[costs.size() / 2];
+}
+
+static DelaunatorBenchResult run(std::size_t count, int repeat, int threads) {
+    std::vector<float> points = meshPoints(count, 7);
+    delaunator::StridedSpan<float> span(points);
+
+    DelaunatorBenchResult result;
+    result.points = span.size();
+    delaunator::BasicDelaunator<float> legacy, keySort;
+    legacy.use_key_sort = false;
+    keySort.sort_threads = (std::size_t) threads;
+    std::vector<double> legacyCosts, keySortCosts;
+    // 每次都从头构建，先各跑一遍让缓冲区到达最终容量
+    for (int r = 0; r <= repeat; ++r) {
+        legacy.triangles.clear();
+        int64_t startUs = TimeUtils::nowUs();
+        legacy.update(span);
+        int64_t legacyUs = TimeUtils::nowUs() - startUs;
+
+        keySort.triangles.clear();
+        startUs = TimeUtils::nowUs();
+        keySort.update(span);
+        int64_t keySortUs = TimeUtils::nowUs() - startUs;
+        if (r > 0) {
+            legacyCosts.push_back((double) legacyUs / 1000.0);
+            keySortCosts.push_back((double) keySortUs / 1000.0);
+        }
+    }
+    result.triangles = keySort.triangles.size() / 3;
+    result.legacyMs = medianMs(legacyCosts);
+    result.keySortMs = medianMs(keySortCosts);
+    result.same = legacy.triangles == keySort.triangles;
+    return result;
+}
+
+int main(int argc, char **argv) {
+    std::string sizes = "1000,10000,100000,1000000", out;
+    int repeat = 5;
+    int threads = std::max(1, (int) std::thread::hardware_concurrency());
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string key = argv[i], value = argv[i + 1];
+        if (key == "--sizes") {
+            sizes = value;
+        } else if (key == "--repeat") {
+            repeat = std::max(1, atoi(value.c_str()));
+        } else if (key == "--threads") {
+            threads = std::max(1, atoi(value.c_str()));
+        } else if (key == "--out") {
+            out = value;
+        } else {
+            fprintf(stderr, "unknown option: %s\n", key.c_str());
+            return 1;
+        }
+    }
+
+    std::vector<DelaunatorBenchResult> results;
+    std::stringstream ss(sizes);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        std::size_t count = (std::size_t) std::max(16L, atol(item.c_str()));
+        DelaunatorBenchResult r = run(count, repeat, threads);
+        fprintf(stderr, "%8zu points  legacy %9.3f ms  key sort %9.3f ms  x%.2f%s\n", r.points,
+                r.legacyMs, r.keySortMs, r.legacyMs / r.keySortMs, r.same ? "" : "  (triangles differ!)");
+        results.push_back(r);
+    }
+
+    FILE *file = out.empty() ? stdout : fopen(out.c_str(), "w");
+    if (file == nullptr) {
+        fprintf(stderr, "open %s failed\n", out.c_str());
+        return 1;
+    }
+    fprintf(file, "{\n  \"repeat\": %d,\n  \"sort_threads\": %d,\n  \"results\": [\n", repeat, threads);
+    for (size_t i = 0; i < results.size(); ++i) {
+        const DelaunatorBenchResult &r = results[i];
+        fprintf(file, "    {\"points\": %zu, \"triangles\": %zu, \"legacy_ms\": %.3f, \"key_sort_ms\": %.3f, "
+                      "\"legacy_mpts_per_s\": %.3f, \"key_sort_mpts_per_s\": %.3f, \"same_triangles\": %s}%s\n",
+                r.points, r.triangles, r.legacyMs, r.keySortMs,
+                (double) r.points / (r.legacyMs * 1000.0), (double) r.points / (r.keySortMs * 1000.0),
+                r.same ? "true" : "false", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    if (file != stdout) {
+        fclose(file);
+    }
+    return 0;
+}
@@ -0,0 +1,331 @@
+//
+// Created by LiangKeJin on 2024/8/13.
+//
+// FaceMorph 基准测试，不依赖人脸检测和真实图片，可以在 Linux 上直接运行
+// 输入是合成的纹理图和合成的关键点，按 分辨率 x 关键点密度 x 引擎 扫描，结果以 JSON 输出
+//
+//   MorphBench [--frames 30] [--repeat 3] [--threads 1] [--fixed 0|1] [--nv21 0|1]
+//              [--res 720p,1080p,4k] [--points 3,106,256,1024] [--engine classic,fused]
+//              [--landmarks record.bin] [--out result.json]
+//
+// --landmarks 回放 LandmarkRecorder 录制的关键点（第 0 帧为 src，第 1 帧为 dst），替代合成的关键点，
+// 缩放到测试分辨率，--points 不再生效
+//
+
+#include <Playground.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "face/CVAllocProbe.h"
+#include "face/detect/ReplayLandmarkProvider.h"
+#include "face/detect/SyntheticLandmarkProvider.h"
+#include "face/morph/FaceMorph.h"
+#include "utils/AllocProbe.h"
+#include "utils/TimeUtils.h"
+
+WUTA_ALLOC_PROBE_OPERATOR_NEW()
+
+struct BenchResolution {
+    std::string name;
+    int width;
+    int height;
+};
+
+struct BenchCase {
+    BenchResolution res;
+    int points;
+    MorphEngine engine;
+};
+
+struct BenchResult {
+    BenchCase bench;
+    int triangles = 0;
+    int frames = 0;
+    double msPerFrame = 0;
+    double p50Ms = 0;
+    double p99Ms = 0;
+    double mpixPerSec = 0;
+    double heapAllocsPerFrame = 0;
+    long poolAllocs = 0;
+};
+
+struct BenchOptions {
+    int frames = 30;
+    int repeat = 3;
+    int threads = 1;
+    bool fixedPoint = false;
+    bool nv21 = false;
+    std::vector<BenchResolution> resolutions;
+    std::vector<int> points;
+    std::vector<MorphEngine> engines;
+    std::string out;
+    std::string landmarks;
+};
+
+static std::vector<std::string> split(const std::string &s) {
+    std::vector<std::string> items;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+static bool parseResolution(const std::string &name, BenchResolution &res) {
+    if (name == "720p") {
+        res = {name, 1280, 720};
+    } else if (name == "1080p") {
+        res = {name, 1920, 1080};
+    } else if (name == "4k") {
+        res = {name, 3840, 2160};
+    } else {
+        int w = 0, h = 0;
+        if (sscanf(name.c_str(), "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0) {
+            return false;
+        }
+        res = {name, w, h};
+    }
+    return true;
+}
+
+static bool parseOptions(int argc, char **argv, BenchOptions &opts) {
+    std::string res = "720p,1080p,4k", points = "3,106,256,1024", engines = "classic,fused";
+    for (int i = 1; i < argc; ++i) {
+        std::string key = argv[i];
+        if (i + 1 >= argc) {
+            fprintf(stderr, "missing value of %s\n", key.c_str());
+            return false;
+        }
+        std::string value = argv[++i];
+        if (key == "--frames") {
+            opts.frames = std::max(3, atoi(value.c_str()));
+        } else if (key == "--repeat") {
+            opts.repeat = std::max(1, atoi(value.c_str()));
+        } else if (key == "--threads") {
+            opts.threads = atoi(value.c_str());
+        } else if (key == "--fixed") {
+            opts.fixedPoint = value == "1" || value == "true";
+        } else if (key == "--nv21") {
+            opts.nv21 = value == "1" || value == "true";
+        } else if (key == "--res") {
+            res = value;
+        } else if (key == "--points") {
+            points = value;
+        } else if (key == "--engine") {
+            engines = value;
+        } else if (key == "--out") {
+            opts.out = value;
+        } else if (key == "--landmarks") {
+            opts.landmarks = value;
+        } else {
+            fprintf(stderr, "unknown option: %s\n", key.c_str());
+            return false;
+        }
+    }
+    for (const std::string &name : split(res)) {
+        BenchResolution r;
+        if (!parseResolution(name, r)) {
+            fprintf(stderr, "invalid resolution: %s\n", name.c_str());
+            return false;
+        }
+        opts.resolutions.push_back(r);
+    }
+    for (const std::string &p : split(points)) {
+        opts.points.push_back(std::max(3, atoi(p.c_str())));
+    }
+    for (const std::string &e : split(engines)) {
+        if (e == "classic") {
+            opts.engines.push_back(MORPH_ENGINE_CLASSIC);
+        } else if (e == "fused") {
+            opts.engines.push_back(MORPH_ENGINE_FUSED);
+        } else {
+            fprintf(stderr, "invalid engine: %s\n", e.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * 模糊后的随机噪声，保证双线性采样读到的不是常量
+ */
+static cv::Mat syntheticImage(int width, int height, uint32_t seed, bool nv21) {
+    cv::Mat img = nv21 ? cv::Mat(height * 3 / 2, width, CV_8UC1) : cv::Mat(height, width, CV_8UC3);
+    cv::theRNG().state = seed;
+    cv::randu(img, cv::Scalar(0, 0, 0), cv::Scalar(255, 255, 255));
+    cv::GaussianBlur(img, img, cv::Size(0, 0), 2.0);
+    return img;
+}
+
+static std::vector<float> firstFace(const LandmarkResult &result) {
+    const LandmarkFace *f = result.face(0);
+    if (f == nullptr) {
+        return {};
+    }
+    // 回放的结果在下一帧时被覆盖
+    return f->landmarks().toVector();
+}
+
+/**
+ * 录制文件的第 0, 1 帧作为 src, dst，只有一帧时两端相同
+ */
+static void replayPoints(const std::string &path, int width, int height,
+                         std::vector<float> &srcPoints, std::vector<float> &dstPoints) {
+    ReplayLandmarkProvider replay(path.c_str());
+    srcPoints = firstFace(replay.detect(nullptr, width, height));
+    dstPoints = firstFace(replay.detect(nullptr, width, height));
+}
+
+static double percentile(std::vector<double> sorted, double p) {
+    std::sort(sorted.begin(), sorted.end());
+    size_t i = (size_t) std::lround(p * (double) (sorted.size() - 1));
+    return sorted[std::min(i, sorted.size() - 1)];
+}
+
+static BenchResult runCase(const BenchCase &bench, const BenchOptions &opts) {
+    int w = bench.res.width, h = bench.res.height;
+    cv::Mat src = syntheticImage(w, h, 1, opts.nv21);
+    cv::Mat dst = syntheticImage(w, h, 2, opts.nv21);
+    std::vector<float> srcPoints, dstPoints;
+    if (!opts.landmarks.empty()) {
+        replayPoints(opts.landmarks, w, h, srcPoints, dstPoints);
+    } else {
+        std::vector<float> face = SyntheticLandmarkProvider::faceShape(bench.points);
+        float size = (float) h * 0.6f;
+        srcPoints = SyntheticLandmarkProvider::placeFace(face, w, h, (float) w * 0.45f, (float) h * 0.5f,
+                                                         size, 0.01f, 3);
+        dstPoints = SyntheticLandmarkProvider::placeFace(face, w, h, (float) w * 0.55f, (float) h * 0.48f,
+                                                         size * 0.9f, 0.02f, 4);
+    }
+
+    MorphConfig config;
+    config.threads = opts.threads;
+    config.engine = bench.engine;
+    config.fixed_point = opts.fixedPoint;
+    config.verbose = false;
+    FaceMorph morph;
+    morph.setConfig(config);
+    if (opts.nv21) {
+        morph.setupNV21(src, srcPoints, dst, dstPoints);
+    } else {
+        morph.setup(src, srcPoints, dst, dstPoints);
+    }
+    auto frameAt = [&](int k) {
+        return opts.nv21 ? morph.getFrameAtNV21(k, opts.frames) : morph.getFrameAt(k, opts.frames);
+    };
+
+    BenchResult result;
+    result.bench = bench;
+    result.triangles = morph.triangleCount();
+
+    // 第一遍预热: 分配输出帧、scratch 和线程池，不计入结果
+    for (int k = 1; k < opts.frames - 1; ++k) {
+        frameAt(k);
+    }
+
+    // 首尾两帧直接返回原图，只统计中间帧
+    std::vector<double> costs;
+    long poolAllocs = morph.allocations();
+    long heapAllocs = wuta::AllocProbe::count();
+    for (int r = 0; r < opts.repeat; ++r) {
+        for (int k = 1; k < opts.frames - 1; ++k) {
+            int64_t startUs = TimeUtils::nowUs();
+            frameAt(k);
+            costs.push_back((double) (TimeUtils::nowUs() - startUs) / 1000.0);
+        }
+    }
+    heapAllocs = wuta::AllocProbe::count() - heapAllocs;
+
+    double total = 0;
+    for (double c : costs) {
+        total += c;
+    }
+    result.frames = (int) costs.size();
+    result.msPerFrame = total / (double) costs.size();
+    result.p50Ms = percentile(costs, 0.5);
+    result.p99Ms = percentile(costs, 0.99);
+    result.mpixPerSec = (double) w * h / (result.msPerFrame * 1000.0);
+    result.heapAllocsPerFrame = (double) heapAllocs / (double) costs.size();
+    result.poolAllocs = morph.allocations() - poolAllocs;
+    return result;
+}
+
+static void writeJson(FILE *file, const BenchOptions &opts, const std::vector<BenchResult> &results) {
+    fprintf(file, "{\n");
+    fprintf(file, "  \"machine\": {\"hardware_threads\": %u, \"compiler\": \"%s\", \"optimized\": %s, "
+                  "\"simd\": \"%s\"},\n",
+            std::thread::hardware_concurrency(), __VERSION__,
+#ifdef NDEBUG
+            "true",
+#else
+            "false",
+#endif
+            MorphKernel::simdName());
+    fprintf(file, "  \"config\": {\"frames\": %d, \"repeat\": %d, \"threads\": %d, \"fixed_point\": %s, "
+                  "\"format\": \"%s\"},\n",
+            opts.frames, opts.repeat, opts.threads, opts.fixedPoint ? "true" : "false", opts.nv21 ? "nv21" : "bgr");
+    fprintf(file, "  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult &r = results[i];
+        fprintf(file, "    {\"resolution\": \"%s\", \"width\": %d, \"height\": %d, \"points\": %d, "
+                      "\"triangles\": %d, \"engine\": \"%s\", \"frames\": %d, "
+                      "\"ms_per_frame\": %.3f, \"p50_ms\": %.3f, \"p99_ms\": %.3f, \"mpix_per_s\": %.2f, "
+                      "\"heap_allocs_per_frame\": %.2f, \"pool_allocs\": %ld}%s\n",
+                r.bench.res.name.c_str(), r.bench.res.width, r.bench.res.height, r.bench.points,
+                r.triangles, r.bench.engine == MORPH_ENGINE_FUSED ? "fused" : "classic", r.frames,
+                r.msPerFrame, r.p50Ms, r.p99Ms, r.mpixPerSec,
+                r.heapAllocsPerFrame, r.poolAllocs, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+}
+
+int main(int argc, char **argv) {
+    // heap_allocs_per_frame 包括 cv::Mat 的数据
+    wuta::CVAllocProbe::install();
+    BenchOptions opts;
+    if (!parseOptions(argc, argv, opts)) {
+        return 1;
+    }
+    if (!opts.landmarks.empty()) {
+        // 点数由录制文件决定
+        try {
+            ReplayLandmarkProvider replay(opts.landmarks.c_str());
+            opts.points = {(int) firstFace(replay.frame(0)).size() / 2};
+        } catch (const std::runtime_error &e) {
+            fprintf(stderr, "%s\n", e.what());
+            return 1;
+        }
+    }
+
+    std::vector<BenchResult> results;
+    for (const BenchResolution &res : opts.resolutions) {
+        for (int points : opts.points) {
+            for (MorphEngine engine : opts.engines) {
+                BenchResult r = runCase({res, points, engine}, opts);
+                fprintf(stderr, "%-6s points=%-5d %-7s %8.3f ms/frame  p99 %8.3f ms  %8.2f MPix/s\n",
+                        res.name.c_str(), points, engine == MORPH_ENGINE_FUSED ? "fused" : "classic",
+                        r.msPerFrame, r.p99Ms, r.mpixPerSec);
+                results.push_back(r);
+            }
+        }
+    }
+
+    FILE *file = opts.out.empty() ? stdout : fopen(opts.out.c_str(), "w");
+    if (file == nullptr) {
+        fprintf(stderr, "open %s failed\n", opts.out.c_str());
+        return 1;
+    }
+    writeJson(file, opts, results);
+    if (file != stdout) {
+        fclose(file);
+    }
+    return 0;
+}
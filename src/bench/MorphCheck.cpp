@@ -0,0 +1,735 @@
+//
+// Created by LiangKeJin on 2024/8/23.
+//
+// FaceMorph 相关的正确性检查，输入都是合成的，不依赖人脸检测和真实图片，可以在 Linux 上直接运行
+// 由 ctest 调用，有检查失败时返回 1
+//
+//   MorphCheck [name ...]    只运行指定的检查，默认全部
+//
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+#include "face/CVAllocProbe.h"
+#include "face/detect/SyntheticLandmarkProvider.h"
+#include "face/morph/FaceMeshTopology.h"
+#include "face/morph/FaceMorph.h"
+#include "face/morph/MorphKernel.h"
+#include "utils/AllocProbe.h"
+#include "utils/TriangleLocator.h"
+
+WUTA_ALLOC_PROBE_OPERATOR_NEW()
+
+/**
+ * 条件不成立时输出原因
+ */
+static bool expect(bool ok, const char *fmt, ...) {
+    if (!ok) {
+        va_list args;
+        va_start(args, fmt);
+        fprintf(stderr, "    ");
+        vfprintf(stderr, fmt, args);
+        fprintf(stderr, "\n");
+        va_end(args);
+    }
+    return ok;
+}
+
+/**
+ * 和 FaceMorph::setup 相同的点位: 106 个点的合成人脸 + Landmarks 的 4 个图像角点
+ */
+static std::vector<float> facePoints106(int width, int height, float cx, float cy, float size,
+                                        float jitter = 0, uint32_t seed = 1) {
+    std::vector<float> points = SyntheticLandmarkProvider::placeFace(SyntheticLandmarkProvider::faceShape(106),
+                                                                     width, height, cx * (float) width,
+                                                                     cy * (float) height, size * (float) height,
+                                                                     jitter, seed);
+    float w = (float) width - 1, h = (float) height - 1;
+    points.insert(points.end(), {0, 0, w, 0, 0, h, w, h});
+    return points;
+}
+
+/**
+ * 106 个点的合成正脸（SyntheticLandmarkProvider::faceShape(106)）+ Landmarks 的 4 个图像角点的三角形表，
+ * 在 1280x720 上居中、人脸高度 0.6 时由 FaceMeshTopology::dumpTable 生成，只作为检查 FaceMeshTopology 的输入，
+ * 和 InspireFace 的点位含义不同，不能放进 FACE_MESH_TABLES
+ */
+static const uint16_t SYNTHETIC_MESH_106[] = {
+        72, 71, 52, 71, 70, 52, 52, 73, 72, 70, 51, 52, 70, 69, 51, 53, 74, 73, 104, 53, 52, 52, 53, 73,
+        41, 59, 51, 51, 59, 52, 83, 75, 74, 59, 104, 52, 83, 76, 75, 59, 58, 104, 104, 54, 53, 83, 77, 76,
+        57, 54, 104, 83, 74, 53, 54, 83, 53, 70, 64, 69, 69, 41, 51, 59, 39, 58, 71, 64, 70, 72, 64, 71,
+        63, 64, 72, 63, 72, 73, 63, 73, 74, 63, 74, 78, 74, 75, 78, 58, 57, 104, 42, 41, 69, 58, 37, 57,
+        56, 55, 54, 28, 91, 83, 64, 65, 69, 83, 82, 77, 43, 40, 41, 41, 39, 59, 33, 56, 57, 57, 56, 54,
+        78, 75, 76, 64, 63, 65, 82, 81, 77, 77, 78, 76, 40, 39, 41, 66, 42, 65, 65, 42, 69, 40, 43, 39,
+        81, 80, 77, 79, 78, 77, 44, 38, 39, 39, 38, 58, 63, 66, 65, 80, 79, 77, 44, 43, 42, 42, 43, 41,
+        38, 37, 58, 63, 105, 66, 66, 44, 42, 62, 105, 63, 78, 62, 63, 45, 44, 66, 43, 44, 39, 38, 106, 37,
+        37, 36, 57, 82, 92, 81, 81, 93, 80, 80, 94, 79, 83, 92, 82, 91, 92, 83, 92, 93, 81, 68, 67, 105,
+        105, 67, 66, 36, 35, 57, 56, 32, 55, 35, 33, 57, 35, 34, 33, 32, 54, 55, 30, 83, 54, 92, 101, 93,
+        67, 45, 66, 44, 45, 38, 100, 101, 92, 101, 102, 93, 93, 94, 80, 79, 94, 78, 0, 61, 1, 62, 61, 105,
+        67, 46, 45, 61, 2, 1, 103, 94, 93, 33, 32, 56, 32, 31, 54, 91, 100, 92, 101, 99, 102, 61, 68, 105,
+        31, 30, 54, 26, 90, 91, 91, 89, 100, 102, 103, 93, 0, 60, 61, 97, 103, 102, 95, 78, 94, 61, 60, 68,
+        88, 99, 100, 100, 99, 101, 47, 67, 68, 47, 46, 67, 107, 106, 38, 30, 29, 83, 99, 98, 102, 23, 89, 90,
+        90, 89, 91, 99, 87, 98, 96, 94, 103, 96, 95, 94, 29, 28, 83, 97, 96, 103, 98, 97, 102, 89, 88, 100,
+        98, 87, 97, 28, 27, 91, 48, 47, 68, 88, 87, 99, 85, 95, 96, 85, 84, 95, 86, 96, 97, 61, 62, 2,
+        27, 26, 91, 89, 20, 88, 87, 86, 97, 86, 85, 96, 49, 48, 50, 26, 25, 90, 50, 48, 68, 50, 68, 60,
+        0, 50, 60, 25, 24, 90, 88, 18, 87, 24, 23, 90, 87, 14, 86, 78, 3, 2, 62, 78, 2, 78, 4, 3,
+        23, 22, 89, 78, 95, 4, 4, 95, 5, 5, 95, 6, 22, 21, 89, 8, 84, 9, 6, 95, 84, 21, 20, 89,
+        7, 6, 84, 7, 84, 8, 84, 85, 9, 20, 19, 88, 9, 85, 10, 19, 18, 88, 10, 85, 11, 18, 17, 87,
+        11, 85, 12, 12, 85, 86, 17, 16, 87, 13, 12, 86, 16, 15, 87, 14, 13, 86, 15, 14, 87, 34, 106, 33,
+        33, 106, 32, 32, 108, 31, 31, 108, 30, 30, 108, 29, 29, 108, 28, 28, 108, 27, 27, 108, 26, 26, 108, 25,
+        25, 108, 24, 24, 108, 23, 35, 106, 34, 36, 106, 35, 37, 106, 36, 107, 38, 45, 107, 45, 46, 107, 46, 47,
+        106, 108, 32, 23, 108, 22, 22, 108, 21, 21, 108, 20, 20, 108, 19, 19, 108, 18, 18, 108, 17, 17, 108, 16,
+        16, 109, 15, 15, 109, 14, 49, 107, 48, 48, 107, 47, 50, 107, 49, 0, 107, 50, 109, 107, 0, 109, 0, 1,
+        109, 1, 2, 109, 2, 3, 109, 3, 4, 109, 4, 5, 109, 5, 6, 109, 6, 7, 109, 7, 8, 10, 109, 9,
+        9, 109, 8, 11, 109, 10, 12, 109, 11, 13, 109, 12, 14, 109, 13, 108, 109, 16,
+};
+
+static const FaceMeshTable SYNTHETIC_MESH_TABLES[] = {
+        {110, 214, SYNTHETIC_MESH_106},
+        {0, 0, nullptr},
+};
+
+static void setupSynthetic(FaceMorph &morph, const MorphConfig &config, bool nv21);
+
+/**
+ * 110 点的合成表在不同分辨率、人脸大小和位置的正脸上有效并且被直接使用，
+ * 缺三角形、方向翻转、边框点换位置时 valid 不通过；没有表时只在第一次和失效时三角化
+ */
+static bool checkMeshTable() {
+    const FaceMeshTable *table = FaceMeshTopology::findTable(110, SYNTHETIC_MESH_TABLES);
+    if (!expect(table != nullptr, "no mesh table for 110 points")) {
+        return false;
+    }
+    std::vector<size_t> triangles(table->triangles, table->triangles + table->triangle_count * 3);
+    bool ok = true;
+    const int sizes[][2] = {{1280, 720}, {1920, 1080}, {3840, 2160}, {720, 1280}, {640, 480}};
+    for (const int *size : sizes) {
+        for (float faceSize : {0.4f, 0.6f, 0.75f}) {
+            for (float cx : {0.4f, 0.5f, 0.6f}) {
+                std::vector<float> points = facePoints106(size[0], size[1], cx, 0.49f, faceSize);
+                ok &= expect(FaceMeshTopology::valid(points.data(), 110, triangles),
+                             "table invalid on %dx%d face %.2f at %.2f", size[0], size[1], faceSize, cx);
+
+                FaceMeshTopology topology(SYNTHETIC_MESH_TABLES);
+                size_t indexSize;
+                topology.triangles(points.data(), 110, indexSize);
+                ok &= expect(topology.triangulations() == 0 && indexSize == triangles.size(),
+                             "table not used on %dx%d", size[0], size[1]);
+            }
+        }
+    }
+
+    // 抖动过的点上表可能失效，这时重新三角化，结果本身必须有效
+    for (uint32_t seed = 1; seed <= 8; ++seed) {
+        std::vector<float> points = facePoints106(1280, 720, 0.5f, 0.5f, 0.6f, 0.02f, seed);
+        FaceMeshTopology topology(SYNTHETIC_MESH_TABLES);
+        size_t indexSize;
+        const size_t *result = topology.triangles(points.data(), 110, indexSize);
+        ok &= expect(FaceMeshTopology::valid(points.data(), 110, {result, result + indexSize}),
+                     "triangulation of jittered face %u invalid", seed);
+    }
+
+    // FaceMorph 跨 setup 复用三角化的结果
+    FaceMorph morph;
+    MorphConfig config;
+    config.verbose = false;
+    for (int i = 0; i < 3; ++i) {
+        setupSynthetic(morph, config, false);
+    }
+    ok &= expect(morph.triangulations() == 1, "FaceMorph triangulated %d times for the same layout",
+                 morph.triangulations());
+
+    std::vector<float> points = facePoints106(1280, 720, 0.5f, 0.5f, 0.6f);
+    std::vector<size_t> missing(triangles.begin(), triangles.end() - 3);
+    ok &= expect(!FaceMeshTopology::valid(points.data(), 110, missing), "table with a missing triangle is valid");
+
+    std::vector<size_t> flipped = triangles;
+    std::swap(flipped[0], flipped[1]);
+    ok &= expect(!FaceMeshTopology::valid(points.data(), 110, flipped), "table with a flipped triangle is valid");
+
+    // GLFaceMorph 的外框点顺序为 左上、右上、右下、左下
+    std::vector<float> reordered = points;
+    std::swap(reordered[107 * 2], reordered[109 * 2]);
+    std::swap(reordered[107 * 2 + 1], reordered[109 * 2 + 1]);
+    ok &= expect(!FaceMeshTopology::valid(reordered.data(), 110, triangles), "table valid on reordered corners");
+    return ok;
+}
+
+/**
+ * GLFaceMorph 静态网格的边界: 外框为人脸包围盒的 2 倍 (Landmark::trianglePoints)，人脸占满图像时超出纹理，
+ * 边界的 8 个三角形不能翻转，和外框一起恰好铺满包住外框和纹理的矩形
+ */
+static bool checkMeshBorder() {
+    struct Face {
+        float cx, cy, w, h;
+    };
+    const Face faces[] = {{0.5f, 0.5f, 0.3f, 0.3f}, {0.5f, 0.5f, 0.9f, 0.95f}, {0.8f, 0.3f, 0.6f, 0.5f},
+                          {0.2f, 0.9f, 0.7f, 0.8f}, {0.5f, 0.45f, 0.5f, 0.5f}};
+    auto cross = [](const float *p, int a, int b, int c) {
+        return ((double) p[b * 2] - p[a * 2]) * ((double) p[c * 2 + 1] - p[a * 2 + 1]) -
+               ((double) p[b * 2 + 1] - p[a * 2 + 1]) * ((double) p[c * 2] - p[a * 2]);
+    };
+    bool ok = true;
+    for (const Face &face : faces) {
+        for (bool flipY : {false, true}) {
+            // 外框顺序为 左上、右上、右下、左下，静态网格中 y 翻转
+            float lx = face.cx - face.w, rx = face.cx + face.w;
+            float ly = face.cy - face.h, ry = face.cy + face.h;
+            float points[16] = {lx, ly, rx, ly, rx, ry, lx, ry};
+            for (int k = 0; flipY && k < 4; ++k) {
+                points[k * 2 + 1] = 1 - points[k * 2 + 1];
+            }
+            FaceMeshTopology::borderCorners(points, points + 8);
+            std::vector<uint16_t> indices;
+            FaceMeshTopology::appendBorder(0, 4, indices);
+
+            double rectArea = cross(points, 0, 1, 2) + cross(points, 0, 2, 3);
+            double sign = rectArea > 0 ? 1 : -1, area = std::fabs(rectArea) / 2;
+            for (size_t t = 0; t < indices.size(); t += 3) {
+                double c = cross(points, indices[t], indices[t + 1], indices[t + 2]) * sign;
+                ok &= expect(c >= -1e-6, "border triangle %zu inverted, face %.2f x %.2f at (%.2f, %.2f)%s",
+                             t / 3, face.w, face.h, face.cx, face.cy, flipY ? " flipped" : "");
+                area += std::fabs(c) / 2;
+            }
+            float top = std::min(points[1], points[5]), bottom = std::max(points[1], points[5]);
+            float minX = std::min(0.f, lx), maxX = std::max(1.f, rx);
+            float minY = std::min(0.f, top), maxY = std::max(1.f, bottom);
+            double box = (double) (maxX - minX) * (maxY - minY);
+            ok &= expect(std::fabs(area - box) <= 1e-5 * box, "border area %.6f != %.6f, face %.2f x %.2f%s",
+                         area, box, face.w, face.h, flipY ? " flipped" : "");
+        }
+    }
+    return ok;
+}
+
+/**
+ * 每个三角形从最小的顶点开始（保持方向），再整体排序，用来比较两次三角化是否相同
+ */
+static std::vector<size_t> canonicalTriangles(const std::vector<size_t> &triangles) {
+    std::vector<std::array<size_t, 3>> list;
+    for (size_t t = 0; t < triangles.size(); t += 3) {
+        std::array<size_t, 3> tri = {triangles[t], triangles[t + 1], triangles[t + 2]};
+        std::rotate(tri.begin(), std::min_element(tri.begin(), tri.end()), tri.end());
+        list.push_back(tri);
+    }
+    std::sort(list.begin(), list.end());
+    std::vector<size_t> out;
+    for (const auto &tri : list) {
+        out.insert(out.end(), tri.begin(), tri.end());
+    }
+    return out;
+}
+
+/**
+ * 三角化覆盖所有点，并且每条内部边对面的点都不在三角形的外接圆内
+ */
+static bool checkTriangulation(const delaunator::BasicDelaunator<float> &dela, const std::vector<float> &points,
+                               const char *name, int step) {
+    const std::vector<size_t> &triangles = dela.triangles;
+    std::vector<bool> used(points.size() / 2, false);
+    for (size_t v : triangles) {
+        used[v] = true;
+    }
+    bool ok = expect(std::find(used.begin(), used.end(), false) == used.end(),
+                     "%s step %d: a point is in no triangle", name, step);
+    auto x = [&](size_t i) { return (double) points[i * 2]; };
+    auto y = [&](size_t i) { return (double) points[i * 2 + 1]; };
+    for (size_t e = 0; e < dela.halfedges.size(); ++e) {
+        size_t o = dela.halfedges[e];
+        if (o == delaunator::INVALID_INDEX) {
+            continue;
+        }
+        size_t t = e - e % 3;
+        size_t p = triangles[o % 3 == 0 ? o + 2 : o - 1];
+        size_t a = triangles[t], b = triangles[t + 1], c = triangles[t + 2];
+        if (delaunator::in_circle(x(a), y(a), x(b), y(b), x(c), y(c), x(p), y(p))) {
+            ok = expect(false, "%s step %d: edge %zu is not Delaunay", name, step, e);
+            break;
+        }
+    }
+    return ok;
+}
+
+/**
+ * BasicDelaunator::update: 点逐步移动时增量翻边的结果满足 Delaunay 性质、覆盖所有点，并且和重新三角化相同；
+ * 上一次被当成重复点跳过的点移开之后必须重新三角化
+ */
+static bool checkDelaunatorUpdate() {
+    const int side = 12;
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<float> jitter(-0.3f, 0.3f), step(-0.04f, 0.04f);
+    std::vector<float> points;
+    for (int y = 0; y < side; ++y) {
+        for (int x = 0; x < side; ++x) {
+            points.push_back((float) x + jitter(rng));
+            points.push_back((float) y + jitter(rng));
+        }
+    }
+
+    bool ok = true;
+    delaunator::BasicDelaunator<float> dela;
+    int reused = 0;
+    size_t flips = 0;
+    for (int k = 0; k < 40; ++k) {
+        for (float &v : points) {
+            v += step(rng);
+        }
+        bool reuse = dela.update(points);
+        reused += reuse ? 1 : 0;
+        flips += reuse ? dela.last_flips() : 0;
+        ok &= checkTriangulation(dela, points, "moving grid", k);
+        delaunator::BasicDelaunator<float> rebuilt(points);
+        ok &= expect(canonicalTriangles(dela.triangles) == canonicalTriangles(rebuilt.triangles),
+                     "moving grid step %d: update differs from a rebuild", k);
+    }
+    ok &= expect(reused > 0 && flips > 0, "incremental path not exercised: %d reused, %zu flips", reused, flips);
+
+    // 第 20 个点和第 21 个点重合，第一次三角化时跳过其中一个
+    points[21 * 2] = points[20 * 2];
+    points[21 * 2 + 1] = points[20 * 2 + 1];
+    dela.update(points);
+    ok &= expect(dela.skipped_points() == 1, "expected 1 skipped point, got %zu", dela.skipped_points());
+    points[21 * 2] += 0.3f;
+    ok &= expect(!dela.update(points), "topology reused although a point was skipped");
+    ok &= checkTriangulation(dela, points, "separated duplicate", 0);
+    ok &= expect(dela.skipped_points() == 0, "skipped points after separating the duplicate");
+    return ok;
+}
+
+/**
+ * 暴力遍历所有三角形: 返回所有三角形中最小重心坐标的最大值，best 为对应的三角形
+ * >= 0 时点在三角化内（在边上时为 0），< 0 时在凸包外
+ */
+static double bruteLocate(const std::vector<size_t> &triangles, const std::vector<float> &points,
+                          double x, double y, size_t &best) {
+    double bestMin = -std::numeric_limits<double>::infinity();
+    best = delaunator::INVALID_INDEX;
+    for (size_t t = 0; t < triangles.size() / 3; ++t) {
+        double ax = points[triangles[t * 3] * 2], ay = points[triangles[t * 3] * 2 + 1];
+        double bx = points[triangles[t * 3 + 1] * 2], by = points[triangles[t * 3 + 1] * 2 + 1];
+        double cx = points[triangles[t * 3 + 2] * 2], cy = points[triangles[t * 3 + 2] * 2 + 1];
+        double area = (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+        double w0 = ((cx - bx) * (y - by) - (cy - by) * (x - bx)) / area;
+        double w1 = ((ax - cx) * (y - cy) - (ay - cy) * (x - cx)) / area;
+        double m = std::min(std::min(w0, w1), 1 - w0 - w1);
+        if (m > bestMin) {
+            bestMin = m;
+            best = t;
+        }
+    }
+    return bestMin;
+}
+
+/**
+ * 定位结果和暴力遍历一致: 明显在内部的点必须找到，明显在外部的点必须找不到，
+ * 找到时重心坐标非负、和为 1，并且能还原出 (x, y)
+ */
+static bool checkLocation(const delaunator::TriangleLocation &loc, const std::vector<size_t> &triangles,
+                          const std::vector<float> &points, double x, double y, bool onBoundary, const char *what) {
+    const double eps = 1e-9;
+    size_t best;
+    double inside = bruteLocate(triangles, points, x, y, best);
+    if (inside > eps || onBoundary) {
+        if (!expect(loc.found(), "%s (%.6f, %.6f) inside triangle %zu not found", what, x, y, best)) {
+            return false;
+        }
+    } else if (inside < -eps) {
+        return expect(!loc.found(), "%s (%.6f, %.6f) outside the hull found in %zu", what, x, y, loc.triangle);
+    }
+    if (!loc.found()) {
+        return true;
+    }
+    const size_t *v = &triangles[loc.triangle * 3];
+    double rx = loc.b0 * points[v[0] * 2] + loc.b1 * points[v[1] * 2] + loc.b2 * points[v[2] * 2];
+    double ry = loc.b0 * points[v[0] * 2 + 1] + loc.b1 * points[v[1] * 2 + 1] + loc.b2 * points[v[2] * 2 + 1];
+    bool ok = std::min(std::min(loc.b0, loc.b1), loc.b2) >= -eps && std::fabs(loc.b0 + loc.b1 + loc.b2 - 1) <= eps &&
+              std::fabs(rx - x) <= 1e-6 && std::fabs(ry - y) <= 1e-6;
+    return expect(ok, "%s (%.6f, %.6f): triangle %zu weights %.6f %.6f %.6f", what, x, y, loc.triangle,
+                  loc.b0, loc.b1, loc.b2);
+}
+
+/**
+ * TriangleLocator 的 locate, locate_row, locate_points 和暴力遍历一致，
+ * 包括凸包外的点、三角形顶点和边上的点；外框是和坐标轴对齐的矩形，凸包边上的点可以精确表示
+ */
+static bool checkTriangleLocator() {
+    std::mt19937 rng(9);
+    std::uniform_real_distribution<float> coord(0.5f, 19.5f);
+    std::vector<float> points = {0, 0, 20, 0, 20, 20, 0, 20, 10, 0, 20, 10, 10, 20, 0, 10};
+    for (int i = 0; i < 150; ++i) {
+        points.push_back(coord(rng));
+        points.push_back(coord(rng));
+    }
+    delaunator::BasicDelaunator<float> dela(points);
+    std::vector<size_t> triangles(dela.triangles.begin(), dela.triangles.end());
+    delaunator::TriangleLocator locator;
+    locator.build(dela);
+    bool ok = expect(locator.triangle_count() == triangles.size() / 3, "triangle count differs");
+
+    // 随机点，一部分在凸包外
+    std::uniform_real_distribution<double> query(-3, 23);
+    delaunator::TriangleLocation loc;
+    for (int i = 0; i < 2000 && ok; ++i) {
+        double x = query(rng), y = query(rng);
+        locator.locate(x, y, loc);
+        ok &= checkLocation(loc, triangles, points, x, y, false, "locate");
+    }
+
+    // 顶点和边的中点，凸包的边和坐标轴对齐，中点正好在边上
+    for (size_t e = 0; e < triangles.size() && ok; ++e) {
+        size_t a = triangles[e], b = triangles[e % 3 == 2 ? e - 2 : e + 1];
+        double ax = points[a * 2], ay = points[a * 2 + 1], bx = points[b * 2], by = points[b * 2 + 1];
+        bool hull = dela.halfedges[e] == delaunator::INVALID_INDEX;
+        locator.locate(ax, ay, loc);
+        ok &= checkLocation(loc, triangles, points, ax, ay, true, "vertex");
+        if (!hull || ax == bx || ay == by) {
+            double mx = (ax + bx) / 2, my = (ay + by) / 2;
+            locator.locate(mx, my, loc);
+            ok &= checkLocation(loc, triangles, points, mx, my, true, hull ? "hull edge" : "edge");
+        }
+    }
+
+    // 扫描线从凸包外开始，穿过内部再出去
+    std::vector<delaunator::TriangleLocation> row(120);
+    for (double y = -1; y <= 21 && ok; y += 0.37) {
+        size_t found = locator.locate_row(y, -2.0, 0.2, row.size(), row.data());
+        size_t count = 0;
+        for (size_t i = 0; i < row.size() && ok; ++i) {
+            ok &= checkLocation(row[i], triangles, points, -2.0 + 0.2 * (double) i, y, false, "locate_row");
+            count += row[i].found() ? 1 : 0;
+        }
+        ok = ok && expect(found == count, "locate_row returned %zu, %zu found", found, count);
+    }
+
+    std::vector<float> xy;
+    for (int i = 0; i < 300; ++i) {
+        xy.push_back((float) query(rng));
+        xy.push_back((float) query(rng));
+    }
+    std::vector<delaunator::TriangleLocation> out(xy.size() / 2);
+    size_t found = locator.locate_points(xy.data(), out.size(), out.data()), count = 0;
+    for (size_t i = 0; i < out.size() && ok; ++i) {
+        ok &= checkLocation(out[i], triangles, points, xy[i * 2], xy[i * 2 + 1], false, "locate_points");
+        count += out[i].found() ? 1 : 0;
+    }
+    return ok && expect(found == count, "locate_points returned %zu, %zu found", found, count);
+}
+
+/**
+ * 模糊后的随机噪声，和 MorphBench 相同
+ */
+static cv::Mat syntheticImage(int width, int height, uint32_t seed, bool nv21) {
+    cv::Mat img = nv21 ? cv::Mat(height * 3 / 2, width, CV_8UC1) : cv::Mat(height, width, CV_8UC3);
+    cv::theRNG().state = seed;
+    cv::randu(img, cv::Scalar(0, 0, 0), cv::Scalar(255, 255, 255));
+    cv::GaussianBlur(img, img, cv::Size(0, 0), 2.0);
+    return img;
+}
+
+/**
+ * 320x240 的合成图和 106 点的合成人脸，src, dst 中人脸的位置和大小不同
+ */
+static void setupSynthetic(FaceMorph &morph, const MorphConfig &config, bool nv21) {
+    const int width = 320, height = 240;
+    cv::Mat src = syntheticImage(width, height, 1, nv21);
+    cv::Mat dst = syntheticImage(width, height, 2, nv21);
+    std::vector<float> face = SyntheticLandmarkProvider::faceShape(106);
+    std::vector<float> srcPoints = SyntheticLandmarkProvider::placeFace(face, width, height, width * 0.45f,
+                                                                        height * 0.5f, height * 0.6f, 0.01f, 3);
+    std::vector<float> dstPoints = SyntheticLandmarkProvider::placeFace(face, width, height, width * 0.55f,
+                                                                        height * 0.48f, height * 0.54f, 0.02f, 4);
+    morph.setConfig(config);
+    if (nv21) {
+        morph.setupNV21(src, srcPoints, dst, dstPoints);
+    } else {
+        morph.setup(src, srcPoints, dst, dstPoints);
+    }
+}
+
+/**
+ * 预热一遍序列之后，再渲染一遍的堆分配次数（operator new + cv::Mat 数据）
+ * @param cacheAllocs 同一遍中 FaceMorph::allocations() 的增量
+ */
+static long steadyAllocations(const MorphConfig &config, bool nv21, bool prepare, long &cacheAllocs) {
+    const int frames = 12;
+    FaceMorph morph;
+    setupSynthetic(morph, config, nv21);
+    if (prepare) {
+        morph.prepareSequence(frames);
+    }
+    auto frameAt = [&](int k) {
+        return nv21 ? morph.getFrameAtNV21(k, frames) : morph.getFrameAt(k, frames);
+    };
+    for (int k = 1; k < frames - 1; ++k) {
+        frameAt(k);
+    }
+    long before = wuta::AllocProbe::count();
+    cacheAllocs = morph.allocations();
+    for (int k = 1; k < frames - 1; ++k) {
+        frameAt(k);
+    }
+    cacheAllocs = morph.allocations() - cacheAllocs;
+    return wuta::AllocProbe::count() - before;
+}
+
+/**
+ * FUSED 引擎预热之后 getFrameAt 没有堆分配，串行、线程池、定点、NV21、预计算序列都要满足
+ * CLASSIC 引擎的 cv::warpAffine 内部 remap 每次都分配分块缓存，这里只检查 FaceMorph 自己的缓存不再增长
+ */
+static bool checkZeroAlloc() {
+    bool ok = true;
+    struct {
+        const char *name;
+        int threads;
+        bool fixedPoint;
+        bool nv21;
+        bool prepare;
+    } cases[] = {
+            {"serial", 1, false, false, false},
+            {"serial fixed", 1, true, false, false},
+            {"pool", 4, false, false, false},
+            {"pool fixed", 4, true, false, false},
+            {"pool nv21", 4, true, true, false},
+            {"pool sequence", 4, true, false, true},
+    };
+    for (const auto &c : cases) {
+        MorphConfig config;
+        config.engine = MORPH_ENGINE_FUSED;
+        config.threads = c.threads;
+        config.fixed_point = c.fixedPoint;
+        config.verbose = false;
+        long cacheAllocs;
+        long allocs = steadyAllocations(config, c.nv21, c.prepare, cacheAllocs);
+        ok &= expect(allocs == 0, "fused %s: %ld heap allocations after warm-up", c.name, allocs);
+    }
+
+    for (int threads : {1, 4}) {
+        MorphConfig config;
+        config.engine = MORPH_ENGINE_CLASSIC;
+        config.threads = threads;
+        config.fixed_point = true;
+        config.verbose = false;
+        long cacheAllocs;
+        steadyAllocations(config, false, false, cacheAllocs);
+        ok &= expect(cacheAllocs == 0, "classic threads=%d: %ld cache allocations after warm-up",
+                     threads, cacheAllocs);
+    }
+    return ok;
+}
+
+/**
+ * 随机内容的 CN 通道图，每行末尾留几个字节的间隔，step 不等于 width * CN
+ */
+static std::vector<uint8_t> randomImage(int width, int height, int cn, std::mt19937 &rng, MorphKernel::Image &img) {
+    size_t step = (size_t) width * cn + 5;
+    std::vector<uint8_t> data(step * height);
+    std::uniform_int_distribution<int> dist(0, 255);
+    for (uint8_t &v : data) {
+        v = (uint8_t) dist(rng);
+    }
+    img = {data.data(), step};
+    return data;
+}
+
+/**
+ * 旋转 + 缩放 + 平移，部分坐标落在图像外，边界像素走标量回退
+ */
+static MorphAffine randomAffine(int width, int height, std::mt19937 &rng) {
+    std::uniform_real_distribution<float> angle(-0.4f, 0.4f), scale(0.7f, 1.3f), shift(-0.15f, 0.15f);
+    float r = angle(rng), k = scale(rng);
+    MorphAffine m;
+    m.a = k * std::cos(r), m.b = -k * std::sin(r), m.c = shift(rng) * (float) width;
+    m.d = k * std::sin(r), m.e = k * std::cos(r), m.f = shift(rng) * (float) height;
+    return m;
+}
+
+/**
+ * 逐像素用标量的 sample / sampleFixed 计算期望值，和 warpDissolve / warpDissolveFixed 的输出比较
+ * @return 最大差值
+ */
+template<int CN>
+static int kernelDiff(bool fixedPoint, uint32_t seed) {
+    const int width = 61, height = 47;
+    std::mt19937 rng(seed);
+    MorphKernel::Image src, dst;
+    std::vector<uint8_t> srcData = randomImage(width, height, CN, rng, src);
+    std::vector<uint8_t> dstData = randomImage(width, height, CN, rng, dst);
+    MorphAffine sm = randomAffine(width, height, rng), dm = randomAffine(width, height, rng);
+    float alpha = std::uniform_real_distribution<float>(0, 1)(rng);
+    int alphaQ8 = MorphKernel::alphaToFixed(alpha);
+
+    int maxDiff = 0;
+    std::vector<uint8_t> out(width * CN);
+    for (int y = 0; y < height; ++y) {
+        if (fixedPoint) {
+            MorphKernel::warpDissolveFixed<CN>(src, dst, width, height, sm, dm, alphaQ8, y, 0, width, out.data());
+        } else {
+            MorphKernel::warpDissolve<CN>(src, dst, width, height, sm, dm, alpha, y, 0, width, out.data());
+        }
+        float fy = (float) y;
+        float sxRow = sm.b * fy + sm.c, syRow = sm.e * fy + sm.f;
+        float dxRow = dm.b * fy + dm.c, dyRow = dm.e * fy + dm.f;
+        for (int x = 0; x < width; ++x) {
+            float fx = (float) x;
+            float sx = sm.a * fx + sxRow, sy = sm.d * fx + syRow;
+            float dx = dm.a * fx + dxRow, dy = dm.d * fx + dyRow;
+            for (int c = 0; c < CN; ++c) {
+                int expected;
+                if (fixedPoint) {
+                    float limitX = (float) (width - 1), limitY = (float) (height - 1);
+                    int s[CN], d[CN];
+                    MorphKernel::sampleFixed<CN>(src, width, height, MorphKernel::toFixed(sx, limitX),
+                                                 MorphKernel::toFixed(sy, limitY), s);
+                    MorphKernel::sampleFixed<CN>(dst, width, height, MorphKernel::toFixed(dx, limitX),
+                                                 MorphKernel::toFixed(dy, limitY), d);
+                    expected = MorphKernel::blendFixed(s[c], d[c], MorphKernel::alphaQ15(alphaQ8));
+                } else {
+                    float s[CN], d[CN];
+                    MorphKernel::sample<CN>(src, width, height, sx, sy, s);
+                    MorphKernel::sample<CN>(dst, width, height, dx, dy, d);
+                    expected = MorphKernel::toByte(s[c] + alpha * (d[c] - s[c]));
+                }
+                maxDiff = std::max(maxDiff, std::abs(out[x * CN + c] - expected));
+            }
+        }
+    }
+    return maxDiff;
+}
+
+/**
+ * 编译进来的 SIMD kernel 和标量参考实现一致: 定点完全相同，浮点只允许舍入差 1
+ */
+static bool checkKernelSIMD() {
+    fprintf(stderr, "    simd: %s\n", MorphKernel::simdName());
+    bool ok = true;
+    for (uint32_t seed = 1; seed <= 16; ++seed) {
+        int diff3 = kernelDiff<3>(false, seed), diff4 = kernelDiff<4>(false, seed);
+        ok &= expect(diff3 <= 1 && diff4 <= 1, "float kernel seed %u: diff %d / %d", seed, diff3, diff4);
+        diff3 = kernelDiff<3>(true, seed), diff4 = kernelDiff<4>(true, seed);
+        ok &= expect(diff3 == 0 && diff4 == 0, "fixed kernel seed %u: diff %d / %d", seed, diff3, diff4);
+    }
+
+    // 长度覆盖 SIMD 主循环和标量尾部
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<int> dist(0, 255);
+    for (int n = 1; n <= 100; ++n) {
+        std::vector<uint8_t> s(n), d(n), o(n);
+        for (int i = 0; i < n; ++i) {
+            s[i] = (uint8_t) dist(rng), d[i] = (uint8_t) dist(rng);
+        }
+        int alphaQ8 = dist(rng) + 1;
+        MorphKernel::dissolveFixed(s.data(), d.data(), o.data(), n, alphaQ8);
+        for (int i = 0; i < n; ++i) {
+            int expected = (s[i] * (MorphKernel::A_ONE - alphaQ8) + d[i] * alphaQ8 + 128) >> 8;
+            ok &= expect(o[i] == expected, "dissolveFixed n=%d i=%d: %d != %d", n, i, o[i], expected);
+        }
+    }
+    return ok;
+}
+
+/**
+ * 定点和浮点 kernel 在没有模糊的随机噪声上逐像素比较，相邻像素差最大，是插值误差最坏的输入
+ * @return 最大差值
+ */
+template<int CN>
+static int fixedFloatDiff(uint32_t seed) {
+    const int width = 61, height = 47;
+    std::mt19937 rng(seed);
+    MorphKernel::Image src, dst;
+    std::vector<uint8_t> srcData = randomImage(width, height, CN, rng, src);
+    std::vector<uint8_t> dstData = randomImage(width, height, CN, rng, dst);
+    MorphAffine sm = randomAffine(width, height, rng), dm = randomAffine(width, height, rng);
+    float alpha = std::uniform_real_distribution<float>(0, 1)(rng);
+
+    int maxDiff = 0;
+    std::vector<uint8_t> f(width * CN), q(width * CN);
+    for (int y = 0; y < height; ++y) {
+        MorphKernel::warpDissolve<CN>(src, dst, width, height, sm, dm, alpha, y, 0, width, f.data());
+        MorphKernel::warpDissolveFixed<CN>(src, dst, width, height, sm, dm, MorphKernel::alphaToFixed(alpha),
+                                           y, 0, width, q.data());
+        for (int i = 0; i < width * CN; ++i) {
+            maxDiff = std::max(maxDiff, std::abs(f[i] - q[i]));
+        }
+    }
+    return maxDiff;
+}
+
+/**
+ * 定点路径和浮点路径的差值不超过 1: 先比较 kernel，再逐帧比较两种引擎的 BGR 和 NV21 输出
+ */
+static bool checkFixedPoint() {
+    bool ok = true;
+    for (uint32_t seed = 1; seed <= 16; ++seed) {
+        int diffs[] = {fixedFloatDiff<1>(seed), fixedFloatDiff<2>(seed), fixedFloatDiff<3>(seed),
+                       fixedFloatDiff<4>(seed)};
+        for (int cn = 1; cn <= 4; ++cn) {
+            ok &= expect(diffs[cn - 1] <= 1, "kernel cn=%d seed %u: fixed point diff %d", cn, seed, diffs[cn - 1]);
+        }
+    }
+
+    const int frames = 12;
+    for (MorphEngine engine : {MORPH_ENGINE_CLASSIC, MORPH_ENGINE_FUSED}) {
+        for (bool nv21 : {false, true}) {
+            MorphConfig config;
+            config.engine = engine;
+            config.verbose = false;
+            FaceMorph floatMorph, fixedMorph;
+            setupSynthetic(floatMorph, config, nv21);
+            config.fixed_point = true;
+            setupSynthetic(fixedMorph, config, nv21);
+
+            double maxDiff = 0;
+            for (int k = 1; k < frames - 1; ++k) {
+                cv::Mat f = nv21 ? floatMorph.getFrameAtNV21(k, frames) : floatMorph.getFrameAt(k, frames);
+                cv::Mat q = nv21 ? fixedMorph.getFrameAtNV21(k, frames) : fixedMorph.getFrameAt(k, frames);
+                maxDiff = std::max(maxDiff, cv::norm(f, q, cv::NORM_INF));
+            }
+            ok &= expect(maxDiff <= 1, "%s %s: fixed point diff %.0f",
+                         engine == MORPH_ENGINE_FUSED ? "fused" : "classic", nv21 ? "nv21" : "bgr", maxDiff);
+        }
+    }
+    return ok;
+}
+
+struct MorphCheckCase {
+    const char *name;
+    bool (*run)();
+};
+
+static const MorphCheckCase CHECKS[] = {
+        {"mesh_table", checkMeshTable},
+        {"mesh_border", checkMeshBorder},
+        {"delaunator_update", checkDelaunatorUpdate},
+        {"triangle_locator", checkTriangleLocator},
+        {"zero_alloc", checkZeroAlloc},
+        {"kernel_simd", checkKernelSIMD},
+        {"fixed_point", checkFixedPoint},
+};
+
+int main(int argc, char **argv) {
+    wuta::CVAllocProbe::install();
+    int failures = 0, runs = 0;
+    for (const MorphCheckCase &check : CHECKS) {
+        bool selected = argc <= 1;
+        for (int i = 1; i < argc; ++i) {
+            selected |= strcmp(argv[i], check.name) == 0;
+        }
+        if (!selected) {
+            continue;
+        }
+        runs += 1;
+        fprintf(stderr, "[ RUN  ] %s\n", check.name);
+        bool ok = check.run();
+        fprintf(stderr, "[ %s ] %s\n", ok ? " OK " : "FAIL", check.name);
+        failures += ok ? 0 : 1;
+    }
+    fprintf(stderr, "%d checks, %d failed\n", runs, failures);
+    return failures == 0 && runs > 0 ? 0 : 1;
+}
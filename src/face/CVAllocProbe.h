@@ -0,0 +1,50 @@
+//
+// Created by LiangKeJin on 2024/8/23.
+//
+
+#pragma once
+
+#include <Playground.h>
+#include <opencv2/opencv.hpp>
+#include "utils/AllocProbe.h"
+
+NAMESPACE_WUTA
+
+/**
+ * 把 cv::Mat 的数据分配计入 AllocProbe
+ * install() 之后新分配的 Mat 都经过这个 allocator，实际的分配和释放仍由 OpenCV 默认的 allocator 完成
+ * 只覆盖 Mat 的数据，OpenCV 函数内部直接使用 cv::AutoBuffer 的临时内存不会计入
+ */
+class CVAllocProbe : public cv::MatAllocator {
+public:
+#if CV_VERSION_MAJOR >= 4
+    typedef cv::AccessFlag AccessFlag;
+#else
+    typedef int AccessFlag;
+#endif
+
+    static void install() {
+        static CVAllocProbe probe;
+        cv::Mat::setDefaultAllocator(&probe);
+    }
+
+    cv::UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step,
+                           AccessFlag flags, cv::UMatUsageFlags usageFlags) const override {
+        // data 不为空时只是包装外部内存
+        if (data == nullptr) {
+            AllocProbe::record();
+        }
+        // UMatData 的 currAllocator 是 std allocator，之后的释放不再经过这里
+        return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usageFlags);
+    }
+
+    bool allocate(cv::UMatData *data, AccessFlag accessFlags, cv::UMatUsageFlags usageFlags) const override {
+        return cv::Mat::getStdAllocator()->allocate(data, accessFlags, usageFlags);
+    }
+
+    void deallocate(cv::UMatData *data) const override {
+        cv::Mat::getStdAllocator()->deallocate(data);
+    }
+};
+
+NAMESPACE_END
@@ -0,0 +1,100 @@
+//
+// Created by LiangKeJin on 2024/8/22.
+//
+
+#pragma once
+
+#include <cstring>
+#include <vector>
+
+/**
+ * 不拥有内存的关键点视图: count 个点，第 i 个点的 x, y 在 data[i * stride], data[i * stride + 1]
+ * 检测结果、Landmark、Landmarks 之间传递关键点时不复制，只有需要修改点的一方才复制到自己的内存
+ * 视图不延长数据的生命周期，数据必须在使用视图期间有效
+ */
+class LandmarkView {
+public:
+    LandmarkView() = default;
+
+    /**
+     * @param stride 相邻两个点之间的 float 个数，交错的 x, y 为 2，cv::Point3f 为 3
+     */
+    LandmarkView(const float *data, int count, int stride = 2)
+            : m_data(data), m_count(data && count > 0 ? count : 0), m_stride(stride) {}
+
+    /**
+     * 交错的 x, y
+     */
+    LandmarkView(const std::vector<float> &points)
+            : LandmarkView(points.data(), (int) points.size() / 2) {}
+
+public:
+    inline int size() const {
+        return m_count;
+    }
+
+    inline bool empty() const {
+        return m_count == 0;
+    }
+
+    inline float x(int i) const {
+        return m_data[i * m_stride];
+    }
+
+    inline float y(int i) const {
+        return m_data[i * m_stride + 1];
+    }
+
+    inline const float *data() const {
+        return m_data;
+    }
+
+    inline int stride() const {
+        return m_stride;
+    }
+
+    /**
+     * 交错的 x, y 连续存放，可以直接当作 float 数组使用
+     */
+    inline bool contiguous() const {
+        return m_stride == 2;
+    }
+
+    /**
+     * 写到 out 中，out 至少有 size() * 2 个 float
+     */
+    void copyTo(float *out) const {
+        if (out == m_data) {
+            return;
+        }
+        if (contiguous()) {
+            if (m_count > 0) {
+                memcpy(out, m_data, sizeof(float) * m_count * 2);
+            }
+            return;
+        }
+        for (int i = 0; i < m_count; ++i) {
+            out[i * 2] = x(i);
+            out[i * 2 + 1] = y(i);
+        }
+    }
+
+    /**
+     * 交错的 x, y 写到 out，已有的容量足够时不会重新分配
+     */
+    void copyTo(std::vector<float> &out) const {
+        out.resize((size_t) m_count * 2);
+        copyTo(out.data());
+    }
+
+    std::vector<float> toVector() const {
+        std::vector<float> out;
+        copyTo(out);
+        return out;
+    }
+
+private:
+    const float *m_data = nullptr;
+    int m_count = 0;
+    int m_stride = 2;
+};
@@ -0,0 +1,131 @@
+//
+// Created by LiangKeJin on 2024/8/18.
+//
+
+#include <cstdio>
+#include <cstring>
+#include <future>
+#include <stdexcept>
+#include "AsyncFaceDetector.h"
+#include "utils/TimeUtils.h"
+
+AsyncFaceDetector::AsyncFaceDetector(const ProviderFactory &factory) : m_thread("async_face_detect") {
+    m_thread.post([this, factory]() {
+        long startMs = TimeUtils::nowMs();
+        try {
+            m_detector = factory();
+        } catch (const std::exception &e) {
+            printf("AsyncFaceDetector init error: %s\n", e.what());
+            return;
+        }
+        printf("AsyncFaceDetector(%s) init cost: %ld ms\n", m_detector ? m_detector->name() : "null",
+               TimeUtils::nowMs() - startMs);
+    });
+}
+
+AsyncFaceDetector::~AsyncFaceDetector() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending = false;
+    }
+    // 等检测线程处理完已经投递的任务，之后不会再访问成员
+    std::promise<void> released;
+    m_thread.post([this, &released]() {
+        m_detector.reset();
+        released.set_value();
+    });
+    released.get_future().wait();
+    m_thread.quit();
+}
+
+void AsyncFaceDetector::setCallback(const Callback &callback) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_callback = callback;
+}
+
+uint64_t AsyncFaceDetector::submit(const uint8_t *data, int width, int height,
+                                   LandmarkRotation rotation, LandmarkImageFormat format) {
+    size_t bytes = landmarkImageBytes(width, height, format);
+    bool schedule;
+    uint64_t seq;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_pending) {
+            m_dropped += 1;
+        }
+        m_input.data.resize(bytes);
+        memcpy(m_input.data.data(), data, bytes);
+        m_input.width = width;
+        m_input.height = height;
+        m_input.rotation = rotation;
+        m_input.format = format;
+        m_input.seq = seq = ++m_seq;
+        m_pending = true;
+        // 检测线程上最多只有一个待处理的任务
+        schedule = !m_scheduled;
+        m_scheduled = true;
+    }
+    if (schedule) {
+        m_thread.post([this]() { process(); });
+    }
+    return seq;
+}
+
+AsyncDetectResultPtr AsyncFaceDetector::latest() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_front;
+}
+
+uint64_t AsyncFaceDetector::droppedFrames() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_dropped;
+}
+
+void AsyncFaceDetector::process() {
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_pending) {
+                m_scheduled = false;
+                return;
+            }
+            // 交换缓冲，不在锁内拷贝图像
+            std::swap(m_input, m_working);
+            m_pending = false;
+        }
+        if (m_detector == nullptr) {
+            continue;
+        }
+
+        // 后台缓冲还被读者持有时换一块新的，不修改已经发布的结果
+        if (m_back == nullptr || m_back.use_count() > 1) {
+            m_back = std::make_shared<AsyncDetectResult>();
+        }
+        long startMs = TimeUtils::nowMs();
+        try {
+            m_back->result = m_detector->detect(m_working.data.data(), m_working.width, m_working.height,
+                                                m_working.rotation, m_working.format);
+        } catch (const std::exception &e) {
+            printf("AsyncFaceDetector detect(%llu) error: %s\n", (unsigned long long) m_working.seq, e.what());
+            continue;
+        }
+        m_back->seq = m_working.seq;
+        m_back->width = m_working.width;
+        m_back->height = m_working.height;
+        m_back->cost_ms = TimeUtils::nowMs() - startMs;
+
+        AsyncDetectResultPtr published;
+        Callback callback;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::shared_ptr<AsyncDetectResult> front = std::const_pointer_cast<AsyncDetectResult>(m_front);
+            m_front = m_back;
+            m_back = front;
+            published = m_front;
+            callback = m_callback;
+        }
+        if (callback) {
+            callback(published);
+        }
+    }
+}
@@ -0,0 +1,99 @@
+//
+// Created by LiangKeJin on 2024/8/18.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "LandmarkProvider.h"
+#include "utils/EventThread.h"
+
+/**
+ * 一次异步检测的结果，发布之后不再修改，可以在任意线程读取
+ */
+struct AsyncDetectResult {
+    uint64_t seq = 0;       ///< 对应 submit 返回的帧序号
+    int width = 0;          ///< 输入图像的宽高
+    int height = 0;
+    long cost_ms = 0;       ///< 检测耗时
+    LandmarkResult result;
+};
+
+typedef std::shared_ptr<const AsyncDetectResult> AsyncDetectResultPtr;
+
+/**
+ * 在独立的 EventThread 上运行 LandmarkProvider，调用线程（渲染、采集）只拷贝一次图像数据，不等待推理
+ *
+ * 输入只有一个槽位: 检测线程还没取走的帧会被新帧覆盖（丢弃旧帧，不排队）
+ * 结果双缓冲: 检测写后台缓冲，完成后和前台交换；读者通过 latest() 拿到的 shared_ptr 在持有期间不会被修改
+ * 检测器（包括模型加载）也在检测线程上创建，由 factory 决定使用哪个 LandmarkProvider
+ */
+class AsyncFaceDetector {
+public:
+    typedef std::function<void(const AsyncDetectResultPtr &)> Callback;
+    typedef LandmarkProviderFactory ProviderFactory;
+
+    explicit AsyncFaceDetector(const ProviderFactory &factory);
+
+    ~AsyncFaceDetector();
+
+public:
+    /**
+     * 检测完成的回调，在检测线程上调用，不要在回调里做耗时操作
+     */
+    void setCallback(const Callback &callback);
+
+    /**
+     * 拷贝图像数据并唤醒检测线程，立即返回
+     * @return 帧序号，从 1 开始递增，和 AsyncDetectResult::seq 对应
+     */
+    uint64_t submit(const uint8_t *data, int width, int height,
+                    LandmarkRotation rotation = LANDMARK_ROTATION_0,
+                    LandmarkImageFormat format = LANDMARK_IMAGE_BGR);
+
+    /**
+     * 最近一次完成的检测结果，还没有结果时为空
+     */
+    AsyncDetectResultPtr latest() const;
+
+    /**
+     * 被新帧覆盖、没有检测的帧数
+     */
+    uint64_t droppedFrames() const;
+
+private:
+    struct Frame {
+        uint64_t seq = 0;
+        std::vector<uint8_t> data;
+        int width = 0;
+        int height = 0;
+        LandmarkRotation rotation = LANDMARK_ROTATION_0;
+        LandmarkImageFormat format = LANDMARK_IMAGE_BGR;
+    };
+
+    void process();
+
+private:
+    mutable std::mutex m_mutex;
+    // 输入槽位，m_pending 为 true 时 m_input 中有未检测的帧
+    Frame m_input;
+    bool m_pending = false;
+    bool m_scheduled = false;
+    uint64_t m_seq = 0;
+    uint64_t m_dropped = 0;
+
+    // 结果双缓冲，m_back 只在检测线程访问
+    AsyncDetectResultPtr m_front;
+    std::shared_ptr<AsyncDetectResult> m_back;
+    Callback m_callback;
+
+    // 只在检测线程访问
+    Frame m_working;
+    std::unique_ptr<LandmarkProvider> m_detector;
+
+    wuta::EventThread m_thread;
+};
@@ -0,0 +1,184 @@
+//
+// Created by LiangKeJin on 2024/8/21.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include "BatchFaceDetector.h"
+#include "utils/TimeUtils.h"
+
+/**
+ * 解码线程和检测线程之间的有界队列，队列满时解码线程等待
+ */
+class BatchFaceDetector::Pipeline {
+public:
+    Pipeline(int capacity, int producers) : m_capacity(std::max(1, capacity)), m_producers(producers) {}
+
+    void push(int index, cv::Mat image) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_not_full.wait(lock, [this]() { return (int) m_queue.size() < m_capacity; });
+        m_queue.emplace_back(index, std::move(image));
+        m_not_empty.notify_one();
+    }
+
+    void producerDone() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_producers -= 1;
+        if (m_producers == 0) {
+            m_not_empty.notify_all();
+        }
+    }
+
+    /**
+     * @return false 时所有图像都已经取完
+     */
+    bool pop(int &index, cv::Mat &image) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_not_empty.wait(lock, [this]() { return !m_queue.empty() || m_producers == 0; });
+        if (m_queue.empty()) {
+            return false;
+        }
+        index = m_queue.front().first;
+        image = std::move(m_queue.front().second);
+        m_queue.pop_front();
+        m_not_full.notify_one();
+        return true;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_not_full;
+    std::condition_variable m_not_empty;
+    std::deque<std::pair<int, cv::Mat>> m_queue;
+    const int m_capacity;
+    int m_producers;
+};
+
+BatchFaceDetector::BatchFaceDetector(const BatchDetectConfig &config, const LandmarkProviderFactory &factory)
+        : m_config(config), m_factory(factory) {
+    int workers = config.workers > 0 ? config.workers : (int) std::thread::hardware_concurrency();
+    m_providers.resize(std::max(1, workers));
+    if (!m_config.decoder) {
+        m_config.decoder = [](const std::string &path) { return cv::imread(path); };
+    }
+}
+
+BatchFaceDetector::~BatchFaceDetector() = default;
+
+std::vector<BatchDetectItem> BatchFaceDetector::detect(const std::vector<std::string> &paths) {
+    std::vector<BatchDetectItem> items(paths.size());
+    for (size_t i = 0; i < paths.size(); ++i) {
+        items[i].path = paths[i];
+    }
+    run(items, nullptr);
+    return items;
+}
+
+std::vector<BatchDetectItem> BatchFaceDetector::detect(const std::vector<cv::Mat> &images) {
+    std::vector<BatchDetectItem> items(images.size());
+    run(items, &images);
+    return items;
+}
+
+void BatchFaceDetector::run(std::vector<BatchDetectItem> &items, const std::vector<cv::Mat> *images) {
+    const int count = (int) items.size();
+    const int workers = std::min((int) m_providers.size(), count);
+    if (workers <= 0) {
+        return;
+    }
+    long startMs = TimeUtils::nowMs();
+    std::vector<std::thread> threads;
+
+    if (images) {
+        // 已经解码，检测线程直接按顺序领取
+        std::atomic<int> next(0);
+        for (int w = 0; w < workers; ++w) {
+            threads.emplace_back([this, w, &next, &items, images, count]() {
+                for (int i = next++; i < count; i = next++) {
+                    detectOne(w, (*images)[i], items[i]);
+                }
+            });
+        }
+    } else {
+        const int decoders = std::max(1, std::min(m_config.decode_threads, count));
+        Pipeline pipeline(workers * std::max(1, m_config.prefetch), decoders);
+        std::atomic<int> next(0);
+        for (int d = 0; d < decoders; ++d) {
+            threads.emplace_back([this, &next, &items, &pipeline, count]() {
+                for (int i = next++; i < count; i = next++) {
+                    long decodeStart = TimeUtils::nowMs();
+                    cv::Mat image;
+                    // 解码失败也要推一张空图，检测线程记为无效图像，decoder 的异常不能逃出线程
+                    try {
+                        image = m_config.decoder(items[i].path);
+                    } catch (const std::exception &e) {
+                        printf("BatchFaceDetector: decode %s error: %s\n", items[i].path.c_str(), e.what());
+                    } catch (...) {
+                        printf("BatchFaceDetector: decode %s error\n", items[i].path.c_str());
+                    }
+                    items[i].decode_ms = TimeUtils::nowMs() - decodeStart;
+                    pipeline.push(i, std::move(image));
+                }
+                pipeline.producerDone();
+            });
+        }
+        for (int w = 0; w < workers; ++w) {
+            threads.emplace_back([this, w, &items, &pipeline]() {
+                int index;
+                cv::Mat image;
+                while (pipeline.pop(index, image)) {
+                    detectOne(w, image, items[index]);
+                    image.release();
+                }
+            });
+        }
+        // pipeline 在线程结束之前不能析构
+        for (std::thread &t : threads) {
+            t.join();
+        }
+        threads.clear();
+    }
+    for (std::thread &t : threads) {
+        t.join();
+    }
+    printf("BatchFaceDetector: %d images, %d workers, cost: %ld ms\n", count, workers, TimeUtils::nowMs() - startMs);
+}
+
+bool BatchFaceDetector::detectOne(int worker, const cv::Mat &image, BatchDetectItem &item) {
+    if (image.empty() || image.type() != CV_8UC3) {
+        printf("BatchFaceDetector: invalid image %s\n", item.path.c_str());
+        return false;
+    }
+    std::unique_ptr<LandmarkProvider> &provider = m_providers[worker];
+    try {
+        if (provider == nullptr) {
+            // factory 不一定是线程安全的（加载模型、打开同一个缓存文件），各检测线程依次创建
+            std::lock_guard<std::mutex> lock(m_factory_mutex);
+            provider = m_factory();
+        }
+        if (provider == nullptr) {
+            printf("BatchFaceDetector: create landmark provider failed\n");
+            return false;
+        }
+        const cv::Mat input = image.isContinuous() ? image : image.clone();
+        long startMs = TimeUtils::nowMs();
+        item.result = provider->detect(input.data, input.cols, input.rows, m_config.rotation, LANDMARK_IMAGE_BGR);
+        item.detect_ms = TimeUtils::nowMs() - startMs;
+    } catch (const std::exception &e) {
+        printf("BatchFaceDetector: detect %s error: %s\n", item.path.c_str(), e.what());
+        return false;
+    }
+    item.width = image.cols;
+    item.height = image.rows;
+    item.ok = true;
+    if (m_config.keep_images) {
+        item.image = image;
+    }
+    return true;
+}
@@ -0,0 +1,77 @@
+//
+// Created by LiangKeJin on 2024/8/21.
+//
+
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "LandmarkProvider.h"
+
+struct BatchDetectConfig {
+    int workers = 0;          ///< 检测线程数，每个线程一个独立的 provider（InspireFace session），<= 0 使用 CPU 核心数
+    int decode_threads = 1;   ///< 解码线程数，只对按路径检测有效
+    int prefetch = 2;         ///< 每个检测线程最多预先解码的图像数，限制内存占用
+    bool keep_images = false; ///< 结果中保留解码后的图像，否则检测完立即释放
+    LandmarkRotation rotation = LANDMARK_ROTATION_0;
+    std::function<cv::Mat(const std::string &)> decoder; ///< 路径 -> BGR 图像，为空时使用 cv::imread
+};
+
+/**
+ * 一张图的检测结果，和输入的顺序一致
+ */
+struct BatchDetectItem {
+    std::string path;
+    cv::Mat image;            ///< keep_images 时为解码后的图像
+    int width = 0;
+    int height = 0;
+    bool ok = false;          ///< 解码和检测都成功
+    long decode_ms = 0;
+    long detect_ms = 0;
+    LandmarkResult result;
+};
+
+/**
+ * 批量检测: 多个检测线程各自持有一个 provider 并行检测，解码线程预先解码，解码和推理重叠
+ * provider 在检测线程上第一次使用时创建，之后的批次继续复用
+ */
+class BatchFaceDetector {
+public:
+    /**
+     * @param factory 创建一个检测 session，例如 InspireLandmarkProvider(detectConfig)；
+     *                每个检测线程调用一次，多个检测线程之间串行调用，
+     *                结果依赖调用顺序的 provider（回放）只能用 1 个检测线程
+     */
+    BatchFaceDetector(const BatchDetectConfig &config, const LandmarkProviderFactory &factory);
+
+    ~BatchFaceDetector();
+
+public:
+    std::vector<BatchDetectItem> detect(const std::vector<std::string> &paths);
+
+    /**
+     * 已经解码的 BGR 图像，跳过解码阶段
+     */
+    std::vector<BatchDetectItem> detect(const std::vector<cv::Mat> &images);
+
+    inline int workers() const {
+        return (int) m_providers.size();
+    }
+
+private:
+    class Pipeline;
+
+    void run(std::vector<BatchDetectItem> &items, const std::vector<cv::Mat> *images);
+
+    bool detectOne(int worker, const cv::Mat &image, BatchDetectItem &item);
+
+private:
+    BatchDetectConfig m_config;
+    LandmarkProviderFactory m_factory;
+    std::mutex m_factory_mutex;
+    std::vector<std::unique_ptr<LandmarkProvider>> m_providers;
+};
@@ -3,14 +3,21 @@
 //
 
 #include <cstdio>
+#include <mutex>
 #include <stdexcept>
 #include "InspireFaceDetector.h"
 
 #include <Playground.h>
 
 static bool g_setup_face_model_flag = false;
+static std::mutex g_setup_face_model_mutex;
 
+/**
+ * 多个线程同时创建 InspireFaceDetector 时（BatchFaceDetector 的检测线程）只加载一次模型，
+ * 失败时下一次创建会重试
+ */
 static bool ginitInspireFace() {
+    std::lock_guard<std::mutex> lock(g_setup_face_model_mutex);
     if (!g_setup_face_model_flag) {
         std::string assetPath = ASSERTS_PATH;
         assetPath += "/inspireface/pack/Megatron";
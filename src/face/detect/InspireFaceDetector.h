@@ -7,6 +7,7 @@
 #include <inspireface.h>
 #include <intypedef.h>
 #include <herror.h>
+#include "face/LandmarkView.h"
 
 struct DetectConfig {
     bool enable_recognition = false;               ///< Enable face recognition feature.
@@ -77,6 +78,13 @@ public:
         return m_points[i].y;
     }
 
+    /**
+     * 直接引用 SDK 写入的点，不复制，在下一次 detect 之前有效
+     */
+    inline LandmarkView landmarks() const {
+        return {&m_points[0].x, m_num_landmarks, (int) (sizeof(HPoint2f) / sizeof(float))};
+    }
+
 private:
     void setup(HFMultipleFaceData &data, int index);
 
@@ -115,6 +123,13 @@ public:
         return nullptr;
     }
 
+    const FaceData *face(int i) const {
+        if (i >= 0 && i < m_num_faces) {
+            return m_face + i;
+        }
+        return nullptr;
+    }
+
 private:
     void onFaceDetected(HFMultipleFaceData &data);
 
@@ -0,0 +1,49 @@
+//
+// Created by LiangKeJin on 2024/8/19.
+//
+
+#include "InspireLandmarkProvider.h"
+#include "utils/HashUtils.h"
+
+InspireLandmarkProvider::InspireLandmarkProvider(const DetectConfig &config, bool pipelineProcess)
+        : m_detector(config), m_pipeline_process(pipelineProcess) {}
+
+const LandmarkResult &InspireLandmarkProvider::detect(const uint8_t *data, int width, int height,
+                                                      LandmarkRotation rotation, LandmarkImageFormat format) {
+    DetectResult &result = m_detector.detect(const_cast<uint8_t *>(data), width, height,
+                                             (HFRotation) rotation, (HFImageFormat) format, m_pipeline_process);
+    convert(result, m_result);
+    return m_result;
+}
+
+void InspireLandmarkProvider::convert(const DetectResult &src, LandmarkResult &dst) {
+    dst.clear();
+    for (int i = 0; i < src.numFaces(); ++i) {
+        const FaceData *f = src.face(i);
+        LandmarkFace *face = dst.addFace();
+        if (face == nullptr) {
+            break;
+        }
+        face->setTrackId(f->trackId());
+        face->setRect(f->x(), f->y(), f->width(), f->height());
+        face->setAngles(f->pitch(), f->yaw(), f->roll());
+        face->setLandmarks(f->landmarks());
+    }
+}
+
+uint64_t InspireLandmarkProvider::configKey(const DetectConfig &config, bool pipelineProcess) {
+    // 逐个字段合并，不受结构体填充字节的影响；换模型包时改这里的名字
+    uint64_t h = HashUtils::hash64("inspireface/Megatron", 20);
+    h = HashUtils::combine(h, config.enable_recognition);
+    h = HashUtils::combine(h, config.enable_liveness);
+    h = HashUtils::combine(h, config.enable_ir_liveness);
+    h = HashUtils::combine(h, config.enable_mask_detect);
+    h = HashUtils::combine(h, config.enable_face_quality);
+    h = HashUtils::combine(h, config.enable_face_attribute);
+    h = HashUtils::combine(h, config.enable_interaction_liveness);
+    h = HashUtils::combine(h, (uint64_t) config.detect_mode);
+    h = HashUtils::combine(h, (uint64_t) config.max_detect_faces);
+    h = HashUtils::combine(h, (uint64_t) config.detect_pixel_level);
+    h = HashUtils::combine(h, (uint64_t) config.track_fps);
+    return HashUtils::combine(h, pipelineProcess);
+}
@@ -0,0 +1,41 @@
+//
+// Created by LiangKeJin on 2024/8/19.
+//
+
+#pragma once
+
+#include "InspireFaceDetector.h"
+#include "LandmarkProvider.h"
+
+/**
+ * InspireFace 检测，结果转成 LandmarkResult
+ */
+class InspireLandmarkProvider : public LandmarkProvider {
+public:
+    explicit InspireLandmarkProvider(const DetectConfig &config, bool pipelineProcess = true);
+
+public:
+    const char *name() const override {
+        return "inspireface";
+    }
+
+    const LandmarkResult &detect(const uint8_t *data, int width, int height,
+                                 LandmarkRotation rotation = LANDMARK_ROTATION_0,
+                                 LandmarkImageFormat format = LANDMARK_IMAGE_BGR) override;
+
+    inline InspireFaceDetector &detector() {
+        return m_detector;
+    }
+
+    static void convert(const DetectResult &src, LandmarkResult &dst);
+
+    /**
+     * 影响检测结果的配置的哈希，作为 LandmarkCache 的 key 的一部分
+     */
+    static uint64_t configKey(const DetectConfig &config, bool pipelineProcess = true);
+
+private:
+    InspireFaceDetector m_detector;
+    bool m_pipeline_process;
+    LandmarkResult m_result;
+};
@@ -0,0 +1,277 @@
+//
+// Created by LiangKeJin on 2024/8/20.
+//
+
+#pragma once
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ReplayLandmarkProvider.h"
+#include "utils/HashUtils.h"
+#include "utils/TimeUtils.h"
+
+/**
+ * 缓存文件格式，小端，只追加:
+ *   header: "LMCA", uint32 version
+ *   entry:  uint64 key, uint32 frame_size, frame（和 ReplayLandmarkProvider 的 frame 相同）
+ */
+#define LANDMARK_CACHE_MAGIC "LMCA"
+#define LANDMARK_CACHE_VERSION 1
+
+/**
+ * 按图像内容缓存检测结果的磁盘文件
+ * 文件整体 mmap，内存中只有 key -> 偏移的索引，查找不读取、不拷贝文件内容
+ * 每个条目用一次 O_APPEND 的 write 写入，多个进程同时追加同一个文件不会交错；
+ * 查不到时会先扫描其它进程新追加的条目
+ * 打开时检查文件头、截断不完整的尾部都持有 flock 独占锁，追加持有共享锁，
+ * 截断不会切掉其它进程正在写入的条目
+ */
+class LandmarkCache {
+public:
+    explicit LandmarkCache(const char *path) : m_path(path) {
+        m_fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+        if (m_fd < 0) {
+            throw std::runtime_error(std::string("LandmarkCache: can't open ") + path);
+        }
+        FileLock lock(m_fd, LOCK_EX);
+        if (fileSize() < 8 || !validHeader()) {
+            // 新文件或者旧版本，重新开始
+            if (ftruncate(m_fd, 0) != 0 || !writeAll(header().data(), 8)) {
+                lock.release();
+                close(m_fd);
+                throw std::runtime_error(std::string("LandmarkCache: can't write ") + path);
+            }
+        }
+        m_scanned = 8;
+        refresh();
+        // 持有独占锁时没有进程在追加，映射失败时没有扫描过，不能截断
+        if (m_map && m_scanned < m_map_size) {
+            // 上次写入时中断留下的不完整条目
+            printf("LandmarkCache: truncate broken tail of %s at %zu\n", path, m_scanned);
+            unmap();
+            if (ftruncate(m_fd, (off_t) m_scanned) != 0) {
+                printf("LandmarkCache: truncate failed\n");
+            }
+            refresh();
+        }
+    }
+
+    ~LandmarkCache() {
+        unmap();
+        if (m_fd >= 0) {
+            close(m_fd);
+            m_fd = -1;
+        }
+    }
+
+    LandmarkCache(const LandmarkCache &) = delete;
+
+    LandmarkCache &operator=(const LandmarkCache &) = delete;
+
+public:
+    /**
+     * 图像内容和所有影响检测结果的参数一起作为 key
+     * @param configKey 检测器及其配置的哈希，见 InspireLandmarkProvider::configKey
+     */
+    static uint64_t key(const uint8_t *data, int width, int height, LandmarkRotation rotation,
+                        LandmarkImageFormat format, uint64_t configKey) {
+        uint64_t h = HashUtils::hash64(data, landmarkImageBytes(width, height, format), configKey);
+        h = HashUtils::combine(h, ((uint64_t) (uint32_t) width << 32) | (uint32_t) height);
+        return HashUtils::combine(h, ((uint64_t) rotation << 8) | (uint64_t) format);
+    }
+
+    /**
+     * @return 指向 mmap 内的 frame 数据，用 ReplayLandmarkProvider::decodeFrame 解码；没有时为空
+     */
+    const uint8_t *find(uint64_t key) {
+        auto it = m_index.find(key);
+        if (it == m_index.end() && fileSize() > m_scanned) {
+            refresh();
+            it = m_index.find(key);
+        }
+        return it == m_index.end() ? nullptr : m_map + it->second;
+    }
+
+    bool append(uint64_t key, const LandmarkResult &result, int width, int height) {
+        std::vector<uint8_t> entry(12);
+        ReplayLandmarkProvider::encodeFrame(entry, result, width, height);
+        uint32_t frameSize = (uint32_t) (entry.size() - 12);
+        memcpy(entry.data(), &key, 8);
+        memcpy(entry.data() + 8, &frameSize, 4);
+        {
+            FileLock lock(m_fd, LOCK_SH);
+            if (!writeAll(entry.data(), entry.size())) {
+                printf("LandmarkCache: append to %s failed\n", m_path.c_str());
+                return false;
+            }
+        }
+        refresh();
+        return true;
+    }
+
+    inline int size() const {
+        return (int) m_index.size();
+    }
+
+private:
+    /**
+     * 作用域内持有 flock，进程退出时内核自动释放
+     */
+    class FileLock {
+    public:
+        FileLock(int fd, int op) : m_fd(fd) {
+            while (flock(m_fd, op) != 0 && errno == EINTR) {}
+        }
+
+        ~FileLock() {
+            release();
+        }
+
+        void release() {
+            if (m_fd >= 0) {
+                flock(m_fd, LOCK_UN);
+                m_fd = -1;
+            }
+        }
+
+    private:
+        int m_fd;
+    };
+
+    static std::vector<uint8_t> header() {
+        std::vector<uint8_t> h(8);
+        uint32_t version = LANDMARK_CACHE_VERSION;
+        memcpy(h.data(), LANDMARK_CACHE_MAGIC, 4);
+        memcpy(h.data() + 4, &version, 4);
+        return h;
+    }
+
+    bool validHeader() const {
+        uint8_t h[8];
+        return pread(m_fd, h, 8, 0) == 8 && memcmp(h, header().data(), 8) == 0;
+    }
+
+    size_t fileSize() const {
+        struct stat st = {};
+        return fstat(m_fd, &st) == 0 ? (size_t) st.st_size : 0;
+    }
+
+    bool writeAll(const uint8_t *data, size_t size) {
+        return write(m_fd, data, size) == (ssize_t) size;
+    }
+
+    /**
+     * 重新映射整个文件并索引 m_scanned 之后的完整条目
+     * 映射失败时保留旧的映射，已有的索引都在旧映射内；没有旧映射时清空索引，之后的 find 都返回空
+     */
+    void refresh() {
+        size_t size = fileSize();
+        if (size != m_map_size) {
+            void *map = mmap(nullptr, size, PROT_READ, MAP_SHARED, m_fd, 0);
+            if (map == MAP_FAILED) {
+                printf("LandmarkCache: mmap %s failed\n", m_path.c_str());
+                if (m_map == nullptr) {
+                    m_index.clear();
+                    m_scanned = 8;
+                }
+                return;
+            }
+            unmap();
+            m_map = (const uint8_t *) map;
+            m_map_size = size;
+        }
+        while (m_scanned + 12 <= m_map_size) {
+            uint64_t key;
+            uint32_t frameSize;
+            memcpy(&key, m_map + m_scanned, 8);
+            memcpy(&frameSize, m_map + m_scanned + 8, 4);
+            size_t frame = m_scanned + 12;
+            if (frame + frameSize > m_map_size ||
+                ReplayLandmarkProvider::frameSize(m_map + frame, frameSize) != frameSize) {
+                break;
+            }
+            m_index[key] = frame;
+            m_scanned = frame + frameSize;
+        }
+    }
+
+    void unmap() {
+        if (m_map) {
+            munmap((void *) m_map, m_map_size);
+            m_map = nullptr;
+            m_map_size = 0;
+        }
+    }
+
+private:
+    std::string m_path;
+    int m_fd = -1;
+    const uint8_t *m_map = nullptr;
+    size_t m_map_size = 0;
+    // 已经索引到的位置
+    size_t m_scanned = 0;
+    std::unordered_map<uint64_t, size_t> m_index;
+};
+
+/**
+ * 先查缓存，查不到时才通过 factory 创建真正的 provider（加载模型）并检测，结果追加到缓存
+ */
+class CachedLandmarkProvider : public LandmarkProvider {
+public:
+    CachedLandmarkProvider(const char *path, uint64_t configKey, const LandmarkProviderFactory &factory)
+            : m_cache(path), m_config_key(configKey), m_factory(factory) {}
+
+public:
+    const char *name() const override {
+        return "cache";
+    }
+
+    const LandmarkResult &detect(const uint8_t *data, int width, int height,
+                                 LandmarkRotation rotation = LANDMARK_ROTATION_0,
+                                 LandmarkImageFormat format = LANDMARK_IMAGE_BGR) override {
+        uint64_t key = LandmarkCache::key(data, width, height, rotation, format, m_config_key);
+        const uint8_t *frame = m_cache.find(key);
+        if (frame) {
+            m_hits += 1;
+            ReplayLandmarkProvider::decodeFrame(frame, 0, 0, m_result);
+            return m_result;
+        }
+
+        m_misses += 1;
+        if (m_provider == nullptr) {
+            long startMs = TimeUtils::nowMs();
+            m_provider = m_factory();
+            printf("CachedLandmarkProvider: create %s cost: %ld ms\n", m_provider->name(),
+                   TimeUtils::nowMs() - startMs);
+        }
+        const LandmarkResult &result = m_provider->detect(data, width, height, rotation, format);
+        m_cache.append(key, result, width, height);
+        return result;
+    }
+
+    inline int hits() const {
+        return m_hits;
+    }
+
+    inline int misses() const {
+        return m_misses;
+    }
+
+private:
+    LandmarkCache m_cache;
+    uint64_t m_config_key;
+    LandmarkProviderFactory m_factory;
+    std::unique_ptr<LandmarkProvider> m_provider;
+    LandmarkResult m_result;
+    int m_hits = 0;
+    int m_misses = 0;
+};
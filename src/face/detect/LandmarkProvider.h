@@ -0,0 +1,228 @@
+//
+// Created by LiangKeJin on 2024/8/19.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include "face/LandmarkView.h"
+
+/**
+ * 关键点来源的抽象，不依赖检测库，FaceMorph / GLFaceMorph / benchmark 只需要这一层
+ *   InspireLandmarkProvider:   InspireFace 检测（只有 macOS 的库）
+ *   ReplayLandmarkProvider:    回放录制的二进制文件，结果确定，不需要检测库
+ *   SyntheticLandmarkProvider: 合成的人脸关键点
+ */
+
+#define MAX_LANDMARK_FACES 5
+#define MAX_FACE_LANDMARKS 256
+
+/**
+ * 取值和 HFRotation 一致
+ */
+enum LandmarkRotation {
+    LANDMARK_ROTATION_0 = 0,
+    LANDMARK_ROTATION_90 = 1,
+    LANDMARK_ROTATION_180 = 2,
+    LANDMARK_ROTATION_270 = 3,
+};
+
+/**
+ * 取值和 HFImageFormat 一致
+ */
+enum LandmarkImageFormat {
+    LANDMARK_IMAGE_RGB = 0,
+    LANDMARK_IMAGE_BGR = 1,
+    LANDMARK_IMAGE_RGBA = 2,
+    LANDMARK_IMAGE_BGRA = 3,
+    LANDMARK_IMAGE_NV12 = 4,
+    LANDMARK_IMAGE_NV21 = 5,
+};
+
+/**
+ * 连续存放的一帧图像的字节数
+ */
+inline size_t landmarkImageBytes(int width, int height, LandmarkImageFormat format) {
+    size_t pixels = (size_t) width * height;
+    switch (format) {
+        case LANDMARK_IMAGE_RGBA:
+        case LANDMARK_IMAGE_BGRA:
+            return pixels * 4;
+        case LANDMARK_IMAGE_NV12:
+        case LANDMARK_IMAGE_NV21:
+            return pixels * 3 / 2;
+        default:
+            return pixels * 3;
+    }
+}
+
+/**
+ * 一张人脸: 人脸框、姿态角、稠密关键点、跟踪 id，和 FaceData 的接口一致
+ */
+class LandmarkFace {
+public:
+    inline int trackId() const {
+        return m_track_id;
+    }
+
+    inline int x() const {
+        return m_x;
+    }
+
+    inline int y() const {
+        return m_y;
+    }
+
+    inline int width() const {
+        return m_width;
+    }
+
+    inline int height() const {
+        return m_height;
+    }
+
+    inline float pitch() const {
+        return m_pitch;
+    }
+
+    inline float yaw() const {
+        return m_yaw;
+    }
+
+    inline float roll() const {
+        return m_roll;
+    }
+
+    inline int numLandmarks() const {
+        return m_num_landmarks;
+    }
+
+    inline float landmarkX(int i) const {
+        return m_points[i * 2];
+    }
+
+    inline float landmarkY(int i) const {
+        return m_points[i * 2 + 1];
+    }
+
+    /**
+     * 交错的 x, y，不复制，和 LandmarkFace 的生命周期相同
+     */
+    inline LandmarkView landmarks() const {
+        return {m_points, m_num_landmarks};
+    }
+
+public:
+    void setTrackId(int id) {
+        m_track_id = id;
+    }
+
+    void setRect(int x, int y, int width, int height) {
+        m_x = x;
+        m_y = y;
+        m_width = width;
+        m_height = height;
+    }
+
+    void setAngles(float pitch, float yaw, float roll) {
+        m_pitch = pitch;
+        m_yaw = yaw;
+        m_roll = roll;
+    }
+
+    /**
+     * @param points 交错的 x, y，超过 MAX_FACE_LANDMARKS 的部分丢弃
+     */
+    void setLandmarks(const float *points, int count) {
+        setLandmarks(LandmarkView(points, count));
+    }
+
+    /**
+     * 连续的视图只做一次 memcpy，超过 MAX_FACE_LANDMARKS 的部分丢弃
+     */
+    void setLandmarks(LandmarkView points) {
+        setNumLandmarks(points.size());
+        LandmarkView(points.data(), m_num_landmarks, points.stride()).copyTo(m_points);
+    }
+
+    void setLandmark(int i, float x, float y) {
+        m_points[i * 2] = x;
+        m_points[i * 2 + 1] = y;
+    }
+
+    void setNumLandmarks(int count) {
+        m_num_landmarks = count < MAX_FACE_LANDMARKS ? (count > 0 ? count : 0) : MAX_FACE_LANDMARKS;
+    }
+
+private:
+    int m_track_id = 0;
+
+    int m_x = 0, m_y = 0, m_width = 0, m_height = 0;
+    float m_pitch = 0.f, m_yaw = 0.f, m_roll = 0.f;
+
+    int m_num_landmarks = 0;
+    float m_points[MAX_FACE_LANDMARKS * 2] = {0};
+};
+
+/**
+ * 一帧的结果，和 DetectResult 的接口一致
+ */
+class LandmarkResult {
+public:
+    inline int numFaces() const { return m_num_faces; }
+
+    LandmarkFace *face(int i) {
+        if (i >= 0 && i < m_num_faces) {
+            return m_face + i;
+        }
+        return nullptr;
+    }
+
+    const LandmarkFace *face(int i) const {
+        if (i >= 0 && i < m_num_faces) {
+            return m_face + i;
+        }
+        return nullptr;
+    }
+
+    void clear() {
+        m_num_faces = 0;
+    }
+
+    /**
+     * 追加一张人脸，超过 MAX_LANDMARK_FACES 时返回空
+     */
+    LandmarkFace *addFace() {
+        if (m_num_faces >= MAX_LANDMARK_FACES) {
+            return nullptr;
+        }
+        m_face[m_num_faces] = LandmarkFace();
+        return m_face + m_num_faces++;
+    }
+
+private:
+    int m_num_faces = 0;
+    LandmarkFace m_face[MAX_LANDMARK_FACES];
+};
+
+class LandmarkProvider {
+public:
+    virtual ~LandmarkProvider() = default;
+
+    virtual const char *name() const = 0;
+
+    /**
+     * 检测一帧，返回的结果在下一次调用之前有效
+     */
+    virtual const LandmarkResult &detect(const uint8_t *data, int width, int height,
+                                         LandmarkRotation rotation = LANDMARK_ROTATION_0,
+                                         LandmarkImageFormat format = LANDMARK_IMAGE_BGR) = 0;
+};
+
+/**
+ * 创建 provider，用于延迟创建（模型加载）或者在其它线程上创建
+ */
+typedef std::function<std::unique_ptr<LandmarkProvider>()> LandmarkProviderFactory;
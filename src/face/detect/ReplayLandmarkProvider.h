@@ -0,0 +1,258 @@
+//
+// Created by LiangKeJin on 2024/8/19.
+//
+
+#pragma once
+
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "LandmarkProvider.h"
+
+/**
+ * 录制文件格式，小端，依次为:
+ *   header: "LMRK", uint32 version
+ *   frame:  int32 width, height, num_faces
+ *     face: int32 track_id, x, y, width, height; float pitch, yaw, roll; int32 num_landmarks; float x, y...
+ */
+#define LANDMARK_RECORD_MAGIC "LMRK"
+#define LANDMARK_RECORD_VERSION 1
+
+/**
+ * 回放录制的关键点，每次 detect 返回下一帧，到结尾后从头开始
+ * 不读取图像内容，图像尺寸和录制时不同时按比例缩放到当前尺寸
+ */
+class ReplayLandmarkProvider : public LandmarkProvider {
+public:
+    explicit ReplayLandmarkProvider(const char *path) {
+        FILE *file = fopen(path, "rb");
+        if (file == nullptr) {
+            throw std::runtime_error(std::string("ReplayLandmarkProvider: can't open ") + path);
+        }
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        m_data.resize(size > 0 ? (size_t) size : 0);
+        size_t read = fread(m_data.data(), 1, m_data.size(), file);
+        fclose(file);
+        if (read != m_data.size() || !parse()) {
+            throw std::runtime_error(std::string("ReplayLandmarkProvider: invalid file ") + path);
+        }
+    }
+
+public:
+    const char *name() const override {
+        return "replay";
+    }
+
+    const LandmarkResult &detect(const uint8_t *data, int width, int height,
+                                 LandmarkRotation rotation = LANDMARK_ROTATION_0,
+                                 LandmarkImageFormat format = LANDMARK_IMAGE_BGR) override {
+        if (m_frames.empty()) {
+            m_result.clear();
+            return m_result;
+        }
+        decode(m_cursor, width, height, m_result);
+        m_cursor = (m_cursor + 1) % (int) m_frames.size();
+        return m_result;
+    }
+
+    inline int frameCount() const {
+        return (int) m_frames.size();
+    }
+
+    void rewind() {
+        m_cursor = 0;
+    }
+
+    /**
+     * 按录制时的尺寸取第 index 帧
+     */
+    const LandmarkResult &frame(int index) {
+        decode(index, 0, 0, m_result);
+        return m_result;
+    }
+
+    static void writeHeader(FILE *file) {
+        uint32_t version = LANDMARK_RECORD_VERSION;
+        fwrite(LANDMARK_RECORD_MAGIC, 1, 4, file);
+        fwrite(&version, sizeof(version), 1, file);
+    }
+
+    static void writeFrame(FILE *file, const LandmarkResult &result, int width, int height) {
+        std::vector<uint8_t> frame;
+        encodeFrame(frame, result, width, height);
+        fwrite(frame.data(), 1, frame.size(), file);
+    }
+
+    /**
+     * 把一帧追加到 out 的末尾
+     */
+    static void encodeFrame(std::vector<uint8_t> &out, const LandmarkResult &result, int width, int height) {
+        int32_t head[3] = {width, height, result.numFaces()};
+        append(out, head, sizeof(head));
+        for (int i = 0; i < result.numFaces(); ++i) {
+            const LandmarkFace *f = result.face(i);
+            int32_t rect[5] = {f->trackId(), f->x(), f->y(), f->width(), f->height()};
+            float angles[3] = {f->pitch(), f->yaw(), f->roll()};
+            int32_t num = f->numLandmarks();
+            append(out, rect, sizeof(rect));
+            append(out, angles, sizeof(angles));
+            append(out, &num, sizeof(num));
+            append(out, f->landmarks().data(), sizeof(float) * 2 * num);
+        }
+    }
+
+    /**
+     * 校验从 data 开始的一帧
+     * @return 这一帧的字节数，数据不完整或者无效时返回 0
+     */
+    static size_t frameSize(const uint8_t *data, size_t size) {
+        if (size < 12) {
+            return 0;
+        }
+        int32_t numFaces = read<int32_t>(data + 8);
+        if (numFaces < 0 || numFaces > MAX_LANDMARK_FACES) {
+            return 0;
+        }
+        size_t pos = 12;
+        for (int i = 0; i < numFaces; ++i) {
+            if (pos + 36 > size) {
+                return 0;
+            }
+            int32_t num = read<int32_t>(data + pos + 32);
+            if (num < 0 || num > MAX_FACE_LANDMARKS) {
+                return 0;
+            }
+            pos += 36 + sizeof(float) * 2 * num;
+        }
+        return pos <= size ? pos : 0;
+    }
+
+    /**
+     * 解码 frameSize 校验过的一帧，width, height > 0 时缩放到该尺寸
+     */
+    static void decodeFrame(const uint8_t *data, int width, int height, LandmarkResult &out) {
+        out.clear();
+        int frameWidth = read<int32_t>(data), frameHeight = read<int32_t>(data + 4);
+        int numFaces = read<int32_t>(data + 8);
+        float sx = width > 0 && frameWidth > 0 ? (float) width / (float) frameWidth : 1.f;
+        float sy = height > 0 && frameHeight > 0 ? (float) height / (float) frameHeight : 1.f;
+        const uint8_t *p = data + 12;
+        for (int i = 0; i < numFaces; ++i) {
+            LandmarkFace *f = out.addFace();
+            f->setTrackId(read<int32_t>(p));
+            f->setRect((int) ((float) read<int32_t>(p + 4) * sx), (int) ((float) read<int32_t>(p + 8) * sy),
+                       (int) ((float) read<int32_t>(p + 12) * sx), (int) ((float) read<int32_t>(p + 16) * sy));
+            f->setAngles(read<float>(p + 20), read<float>(p + 24), read<float>(p + 28));
+            int num = read<int32_t>(p + 32);
+            p += 36;
+            f->setNumLandmarks(num);
+            for (int k = 0; k < num; ++k, p += 8) {
+                f->setLandmark(k, read<float>(p) * sx, read<float>(p + 4) * sy);
+            }
+        }
+    }
+
+private:
+    /**
+     * 只建立每一帧的偏移，detect 时再解码
+     */
+    bool parse() {
+        if (m_data.size() < 8 || memcmp(m_data.data(), LANDMARK_RECORD_MAGIC, 4) != 0 ||
+            read<uint32_t>(m_data.data() + 4) != LANDMARK_RECORD_VERSION) {
+            return false;
+        }
+        size_t pos = 8;
+        while (pos < m_data.size()) {
+            size_t size = frameSize(m_data.data() + pos, m_data.size() - pos);
+            if (size == 0) {
+                return false;
+            }
+            m_frames.push_back(pos);
+            pos += size;
+        }
+        return true;
+    }
+
+    void decode(int index, int width, int height, LandmarkResult &out) const {
+        if (index < 0 || index >= (int) m_frames.size()) {
+            out.clear();
+            return;
+        }
+        decodeFrame(m_data.data() + m_frames[index], width, height, out);
+    }
+
+    template<typename T>
+    static inline T read(const uint8_t *p) {
+        T v;
+        memcpy(&v, p, sizeof(T));
+        return v;
+    }
+
+    static void append(std::vector<uint8_t> &out, const void *data, size_t size) {
+        const uint8_t *p = (const uint8_t *) data;
+        out.insert(out.end(), p, p + size);
+    }
+
+private:
+    std::vector<uint8_t> m_data;
+    // 每一帧在 m_data 中的偏移
+    std::vector<size_t> m_frames;
+    int m_cursor = 0;
+    LandmarkResult m_result;
+};
+
+/**
+ * 透传另一个 provider 的结果，同时写到录制文件，之后用 ReplayLandmarkProvider 回放
+ */
+class LandmarkRecorder : public LandmarkProvider {
+public:
+    LandmarkRecorder(LandmarkProvider &provider, const char *path) : m_provider(provider) {
+        open(path);
+    }
+
+    /**
+     * 持有 provider，用于 LandmarkProviderFactory
+     */
+    LandmarkRecorder(std::unique_ptr<LandmarkProvider> provider, const char *path)
+            : m_owned(std::move(provider)), m_provider(*m_owned) {
+        open(path);
+    }
+
+    ~LandmarkRecorder() override {
+        if (m_file) {
+            fclose(m_file);
+            m_file = nullptr;
+        }
+    }
+
+public:
+    const char *name() const override {
+        return m_provider.name();
+    }
+
+    const LandmarkResult &detect(const uint8_t *data, int width, int height,
+                                 LandmarkRotation rotation = LANDMARK_ROTATION_0,
+                                 LandmarkImageFormat format = LANDMARK_IMAGE_BGR) override {
+        const LandmarkResult &result = m_provider.detect(data, width, height, rotation, format);
+        ReplayLandmarkProvider::writeFrame(m_file, result, width, height);
+        fflush(m_file);
+        return result;
+    }
+
+private:
+    void open(const char *path) {
+        m_file = fopen(path, "wb");
+        if (m_file == nullptr) {
+            throw std::runtime_error(std::string("LandmarkRecorder: can't open ") + path);
+        }
+        ReplayLandmarkProvider::writeHeader(m_file);
+    }
+
+private:
+    std::unique_ptr<LandmarkProvider> m_owned;
+    LandmarkProvider &m_provider;
+    FILE *m_file = nullptr;
+};
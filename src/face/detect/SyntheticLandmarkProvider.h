@@ -0,0 +1,154 @@
+//
+// Created by LiangKeJin on 2024/8/19.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+#include "LandmarkProvider.h"
+
+struct SyntheticFaceConfig {
+    int points = 106;         ///< 关键点个数，见 SyntheticLandmarkProvider::faceShape
+    float center_x = 0.5f;    ///< 人脸中心，相对图像宽高
+    float center_y = 0.5f;
+    float size = 0.6f;        ///< 人脸高度，相对图像高度
+    float jitter = 0.01f;     ///< 每个点的随机偏移，相对人脸高度
+    uint32_t seed = 1;        ///< 第 k 次 detect 使用 seed + k，结果可复现
+};
+
+/**
+ * 合成的人脸关键点，不读取图像内容，benchmark 和无检测库的环境使用
+ */
+class SyntheticLandmarkProvider : public LandmarkProvider {
+public:
+    explicit SyntheticLandmarkProvider(const SyntheticFaceConfig &config = {}) : m_config(config) {
+        m_shape = faceShape(config.points);
+    }
+
+public:
+    const char *name() const override {
+        return "synthetic";
+    }
+
+    const LandmarkResult &detect(const uint8_t *data, int width, int height,
+                                 LandmarkRotation rotation = LANDMARK_ROTATION_0,
+                                 LandmarkImageFormat format = LANDMARK_IMAGE_BGR) override {
+        float size = (float) height * m_config.size;
+        std::vector<float> points = placeFace(m_shape, width, height, (float) width * m_config.center_x,
+                                              (float) height * m_config.center_y, size, m_config.jitter,
+                                              m_config.seed + m_frames);
+        m_frames += 1;
+
+        m_result.clear();
+        LandmarkFace *face = m_result.addFace();
+        face->setTrackId(1);
+        face->setLandmarks(points.data(), (int) points.size() / 2);
+        float minX = (float) width, minY = (float) height, maxX = 0, maxY = 0;
+        for (size_t i = 0; i + 1 < points.size(); i += 2) {
+            minX = std::min(minX, points[i]);
+            maxX = std::max(maxX, points[i]);
+            minY = std::min(minY, points[i + 1]);
+            maxY = std::max(maxY, points[i + 1]);
+        }
+        face->setRect((int) minX, (int) minY, (int) (maxX - minX), (int) (maxY - minY));
+        return m_result;
+    }
+
+    inline const std::vector<float> &shape() const {
+        return m_shape;
+    }
+
+    /**
+     * 合成关键点，坐标归一化到以人脸中心为原点、人脸高度为 1 的坐标系
+     *   3: 两眼和下巴，对应 getMorphKeyPoints(false)
+     *   106: 脸颊 33 + 眉毛 18 + 眼睛 18 + 鼻子 15 + 嘴 20 + 瞳孔 2
+     *   其它: 覆盖人脸框的 n x n 网格
+     */
+    static std::vector<float> faceShape(int points) {
+        const float PI = 3.14159265f;
+        std::vector<float> out;
+        if (points == 3) {
+            out = {-0.18f, -0.12f, 0.18f, -0.12f, 0.f, 0.45f};
+        } else if (points == 106) {
+            pushEllipse(out, 0, 0, 0.38f, 0.5f, 0, PI, 33);
+            pushEllipse(out, -0.18f, -0.2f, 0.12f, 0.04f, PI, 2 * PI, 9);
+            pushEllipse(out, 0.18f, -0.2f, 0.12f, 0.04f, PI, 2 * PI, 9);
+            pushEllipse(out, -0.17f, -0.1f, 0.08f, 0.035f, 0, 2 * PI * 8 / 9, 9);
+            pushEllipse(out, 0.17f, -0.1f, 0.08f, 0.035f, 0, 2 * PI * 8 / 9, 9);
+            for (int i = 0; i < 9; ++i) {
+                out.push_back(0);
+                out.push_back(-0.08f + 0.025f * (float) i);
+            }
+            pushEllipse(out, 0, 0.16f, 0.07f, 0.03f, 0, PI, 6);
+            pushEllipse(out, 0, 0.3f, 0.14f, 0.05f, 0, 2 * PI * 11 / 12, 12);
+            pushEllipse(out, 0, 0.3f, 0.08f, 0.02f, 0, 2 * PI * 7 / 8, 8);
+            out.insert(out.end(), {-0.17f, -0.1f, 0.17f, -0.1f});
+        } else {
+            int n = std::max(2, (int) std::lround(std::sqrt((double) points)));
+            for (int y = 0; y < n; ++y) {
+                for (int x = 0; x < n; ++x) {
+                    out.push_back(-0.4f + 0.8f * (float) x / (float) (n - 1));
+                    out.push_back(-0.5f + 1.0f * (float) y / (float) (n - 1));
+                }
+            }
+        }
+        return out;
+    }
+
+    /**
+     * 把归一化的关键点放到图中，jitter 为每个点的随机偏移（人脸高度的比例），模拟两张脸的形状差异
+     */
+    static std::vector<float> placeFace(const std::vector<float> &face, int width, int height,
+                                        float cx, float cy, float size, float jitter, uint32_t seed) {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> dist(-jitter, jitter);
+        std::vector<float> out(face.size());
+        for (size_t i = 0; i + 1 < face.size(); i += 2) {
+            out[i] = std::min(std::max(cx + (face[i] + dist(rng)) * size, 1.f), (float) width - 2);
+            out[i + 1] = std::min(std::max(cy + (face[i + 1] + dist(rng)) * size, 1.f), (float) height - 2);
+        }
+        return out;
+    }
+
+    /**
+     * 离两眼中心和鼻尖最近的点，作为 GLFaceMorph::set*KeyPoints 的 3 个索引
+     */
+    static void keyIndices(const std::vector<float> &face, int &leftEye, int &rightEye, int &nose) {
+        leftEye = nearest(face, -0.17f, -0.1f);
+        rightEye = nearest(face, 0.17f, -0.1f);
+        nose = nearest(face, 0.f, 0.12f);
+    }
+
+private:
+    static void pushEllipse(std::vector<float> &out, float cx, float cy, float rx, float ry,
+                            float from, float to, int count) {
+        for (int i = 0; i < count; ++i) {
+            float t = count == 1 ? from : from + (to - from) * (float) i / (float) (count - 1);
+            out.push_back(cx + rx * std::cos(t));
+            out.push_back(cy + ry * std::sin(t));
+        }
+    }
+
+    static int nearest(const std::vector<float> &face, float x, float y) {
+        int best = 0;
+        float bestDist = INFINITY;
+        for (size_t i = 0; i + 1 < face.size(); i += 2) {
+            float dx = face[i] - x, dy = face[i + 1] - y;
+            float dist = dx * dx + dy * dy;
+            if (dist < bestDist) {
+                bestDist = dist;
+                best = (int) i / 2;
+            }
+        }
+        return best;
+    }
+
+private:
+    SyntheticFaceConfig m_config;
+    std::vector<float> m_shape;
+    uint32_t m_frames = 0;
+    LandmarkResult m_result;
+};
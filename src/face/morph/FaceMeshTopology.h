@@ -0,0 +1,268 @@
+//
+// Created by LiangKeJin on 2024/8/15.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "utils/Delaunator.h"
+
+/**
+ * 预先生成的人脸网格: 顶点数（包括边框点）和三角形索引
+ */
+struct FaceMeshTable {
+    int points;
+    int triangle_count;
+    const uint16_t *triangles;
+};
+
+/**
+ * 固定点位布局的三角形表，由 FaceMeshTopology::dumpTable 在正脸上生成后粘贴到这里，
+ * 点数匹配且 valid 时直接使用，完全跳过三角化
+ *   GLFaceMorph: InspireFace 稠密点 + Landmark::trianglePoints 的 4 个外框点
+ *   FaceMorph:   关键点 + Landmarks 的 4 个图像角点
+ * 表必须来自真实检测器的点位: 用 LandmarkRecorder 录制 assets/images，打开 FaceMorphTest 的 DUMP_MESH_TABLE 输出，
+ * 合成人脸的表对 InspireFace 的点位无效。还没有录制的表，现在全部走三角化（只在第一次和失效时）
+ * 以 points == 0 结束
+ */
+constexpr FaceMeshTable FACE_MESH_TABLES[] = {
+        {0, 0, nullptr},
+};
+
+/**
+ * 人脸网格的拓扑，同一组点位布局的所有帧共用一套三角形，避免逐帧三角化的耗时和三角形跳变
+ * 优先使用 FACE_MESH_TABLES 中的表，没有时第一次调用时三角化并固定下来
+ * 固定的拓扑在当前点位下出现翻转或退化的三角形时才重新三角化
+ */
+class FaceMeshTopology {
+public:
+    /**
+     * @param tables 以 points == 0 结束的表，默认 FACE_MESH_TABLES
+     */
+    explicit FaceMeshTopology(const FaceMeshTable *tables = FACE_MESH_TABLES) : m_tables(tables) {}
+
+    static const FaceMeshTable *findTable(int points, const FaceMeshTable *tables = FACE_MESH_TABLES) {
+        for (const FaceMeshTable *table = tables; table && table->points != 0; ++table) {
+            if (table->points == points) {
+                return table;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * @param points 交错的 x, y
+     * @param indexSize 三角形索引个数，三个一组
+     * @return 三角形顶点索引，下一次调用或 reset 之前有效
+     */
+    const size_t *triangles(const float *points, int count, size_t &indexSize) {
+        if (count != m_points) {
+            m_points = count;
+            m_triangles.clear();
+            const FaceMeshTable *table = findTable(count, m_tables);
+            if (table) {
+                m_triangles.assign(table->triangles, table->triangles + table->triangle_count * 3);
+            }
+        }
+        if (m_triangles.empty() || !valid(points, count, m_triangles)) {
+            triangulate(points, count);
+        }
+        indexSize = m_triangles.size();
+        return m_triangles.data();
+    }
+
+    /**
+     * 点位布局变化时调用（换了检测模型、换了边框点）
+     */
+    void reset() {
+        m_points = 0;
+        m_triangles.clear();
+    }
+
+    /**
+     * 把当前固定的拓扑输出为可以粘贴到 FACE_MESH_TABLES 的 C++ 代码
+     */
+    void dumpTable(FILE *file, const char *name) const {
+        dumpTable(file, name, m_points, m_triangles.data(), m_triangles.size());
+    }
+
+    static void dumpTable(FILE *file, const char *name, int points, const size_t *triangles, size_t indexSize) {
+        fprintf(file, "constexpr uint16_t %s[] = {\n", name);
+        for (size_t i = 0; i < indexSize; i += 3) {
+            fprintf(file, "%s%d, %d, %d,%s", i % 24 == 0 ? "        " : " ",
+                    (int) triangles[i], (int) triangles[i + 1], (int) triangles[i + 2],
+                    (i + 3) % 24 == 0 || i + 3 >= indexSize ? "\n" : "");
+        }
+        fprintf(file, "};\n");
+        fprintf(file, "// {%d, %d, %s},\n", points, (int) indexSize / 3, name);
+    }
+
+    inline int triangulations() const {
+        return m_triangulations;
+    }
+
+    /**
+     * 和坐标轴对齐的外框 4 个点 rect 对应的 4 个边界角点: 包住外框和 [0, 1] 的矩形上和 rect[k] 同一侧的角
+     * 人脸超过图像一半时外框会超出 [0, 1]，角点跟着外扩（和 GLFaceMorph::fixBorder 相同），边界三角形不会翻转
+     */
+    static void borderCorners(const float *rect, float *corners) {
+        float minX = 0, minY = 0, maxX = 1, maxY = 1, cx = 0, cy = 0;
+        for (int k = 0; k < 4; ++k) {
+            minX = std::min(minX, rect[k * 2]);
+            maxX = std::max(maxX, rect[k * 2]);
+            minY = std::min(minY, rect[k * 2 + 1]);
+            maxY = std::max(maxY, rect[k * 2 + 1]);
+            cx += rect[k * 2] / 4;
+            cy += rect[k * 2 + 1] / 4;
+        }
+        for (int k = 0; k < 4; ++k) {
+            corners[k * 2] = rect[k * 2] < cx ? minX : maxX;
+            corners[k * 2 + 1] = rect[k * 2 + 1] < cy ? minY : maxY;
+        }
+    }
+
+    /**
+     * 外框 rect ~ rect + 3 到角点 corner ~ corner + 3 之间的 8 个三角形
+     */
+    template<typename Index>
+    static void appendBorder(int rect, int corner, std::vector<Index> &indices) {
+        for (int k = 0; k < 4; ++k) {
+            int next = (k + 1) % 4;
+            const int border[] = {corner + k, corner + next, rect + k, rect + k, corner + next, rect + next};
+            for (int i : border) {
+                indices.push_back((Index) i);
+            }
+        }
+    }
+
+    /**
+     * 固定的拓扑能否直接用在 points 上:
+     *   所有三角形的方向和 Delaunator 输出一致且面积不为 0
+     *   恰好覆盖凸包: 有向边不重复，没有反向边的边界边都在凸包上，面积之和等于凸包面积
+     * 只检查方向时，缺了三角形或者边框点换了位置的表也会被当成有效的
+     */
+    static bool valid(const float *points, int count, const std::vector<size_t> &triangles) {
+        if (count < 3 || triangles.empty() || triangles.size() % 3 != 0) {
+            return false;
+        }
+        std::vector<uint64_t> edges;
+        edges.reserve(triangles.size());
+        double area = 0;
+        for (size_t t = 0, size = triangles.size(); t < size; t += 3) {
+            size_t a = triangles[t], b = triangles[t + 1], c = triangles[t + 2];
+            if (a >= (size_t) count || b >= (size_t) count || c >= (size_t) count) {
+                return false;
+            }
+            if (!delaunator::orient(points[c * 2], points[c * 2 + 1],
+                                    points[b * 2], points[b * 2 + 1],
+                                    points[a * 2], points[a * 2 + 1])) {
+                return false;
+            }
+            // Delaunator 的三角形在 y 轴向上时为顺时针，叉积为负
+            area -= cross(points, a, b, c);
+            edges.push_back(edgeKey(a, b));
+            edges.push_back(edgeKey(b, c));
+            edges.push_back(edgeKey(c, a));
+        }
+        std::sort(edges.begin(), edges.end());
+        if (std::adjacent_find(edges.begin(), edges.end()) != edges.end()) {
+            // 同一条有向边属于两个三角形，三角形有重叠
+            return false;
+        }
+
+        float minX = points[0], maxX = points[0], minY = points[1], maxY = points[1];
+        for (int i = 1; i < count; ++i) {
+            minX = std::min(minX, points[i * 2]);
+            maxX = std::max(maxX, points[i * 2]);
+            minY = std::min(minY, points[i * 2 + 1]);
+            maxY = std::max(maxY, points[i * 2 + 1]);
+        }
+        double extent = std::max(maxX - minX, maxY - minY);
+        for (uint64_t e : edges) {
+            size_t u = (size_t) (e >> 32), v = (size_t) (e & 0xffffffffu);
+            if (std::binary_search(edges.begin(), edges.end(), edgeKey(v, u))) {
+                continue;
+            }
+            // 边界边: 所有点都在三角形所在的一侧（右侧）或者边上
+            double tolerance = 1e-4 * extent * std::hypot(points[v * 2] - points[u * 2],
+                                                          points[v * 2 + 1] - points[u * 2 + 1]);
+            for (int p = 0; p < count; ++p) {
+                if (cross(points, u, v, (size_t) p) > tolerance) {
+                    return false;
+                }
+            }
+        }
+        double hull = hullArea(points, count);
+        return std::fabs(area - hull) <= 1e-4 * hull;
+    }
+
+private:
+    static inline uint64_t edgeKey(size_t from, size_t to) {
+        return ((uint64_t) from << 32) | (uint64_t) to;
+    }
+
+    /**
+     * (b - a) x (c - a)，三角形面积的两倍，逆时针（y 轴向上）为正
+     */
+    static inline double cross(const float *points, size_t a, size_t b, size_t c) {
+        double ax = points[a * 2], ay = points[a * 2 + 1];
+        return ((double) points[b * 2] - ax) * ((double) points[c * 2 + 1] - ay) -
+               ((double) points[b * 2 + 1] - ay) * ((double) points[c * 2] - ax);
+    }
+
+    /**
+     * 凸包面积的两倍，Andrew 单调链
+     */
+    static double hullArea(const float *points, int count) {
+        std::vector<int> order(count);
+        for (int i = 0; i < count; ++i) {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [points](int i, int j) {
+            return points[i * 2] < points[j * 2] ||
+                   (points[i * 2] == points[j * 2] && points[i * 2 + 1] < points[j * 2 + 1]);
+        });
+        std::vector<int> hull(2 * count);
+        int k = 0;
+        for (int n = 0; n < count; ++n) {
+            while (k >= 2 && cross(points, hull[k - 2], hull[k - 1], order[n]) <= 0) {
+                --k;
+            }
+            hull[k++] = order[n];
+        }
+        for (int n = count - 2, lower = k + 1; n >= 0; --n) {
+            while (k >= lower && cross(points, hull[k - 2], hull[k - 1], order[n]) <= 0) {
+                --k;
+            }
+            hull[k++] = order[n];
+        }
+        // 最后一个点和第一个点相同
+        k -= 1;
+        double area = 0;
+        for (int i = 0; i < k; ++i) {
+            int a = hull[i], b = hull[(i + 1) % k];
+            area += (double) points[a * 2] * points[b * 2 + 1] - (double) points[b * 2] * points[a * 2 + 1];
+        }
+        return std::fabs(area);
+    }
+
+    void triangulate(const float *points, int count) {
+        m_triangles.clear();
+        m_triangulations += 1;
+        if (count < 3) {
+            return;
+        }
+        delaunator::BasicDelaunator<float> dela({points, (size_t) count});
+        m_triangles.assign(dela.triangles.begin(), dela.triangles.end());
+    }
+
+private:
+    const FaceMeshTable *m_tables;
+    int m_points = 0;
+    std::vector<size_t> m_triangles;
+    int m_triangulations = 0;
+};
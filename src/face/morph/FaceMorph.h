@@ -6,8 +6,41 @@
 
 #include <opencv2/opencv.hpp>
 #include <vector>
-#include <utils/Delaunator.h>
+#include "FaceMeshTopology.h"
+#include "face/LandmarkView.h"
+#include "LandmarkLOD.h"
 #include "utils/TimeUtils.h"
+#include "utils/ThreadPool.h"
+#include "MorphTiles.h"
+#include "FusedMorph.h"
+#include "MorphScratch.h"
+
+enum MorphEngine {
+    MORPH_ENGINE_CLASSIC = 0,   ///< 每个三角形 warpAffine + blendLinear，src, dst 各一遍再 addWeighted
+    MORPH_ENGINE_FUSED = 1,     ///< 单遍光栅化，逐像素双线性采样并混合
+};
+
+struct MorphConfig {
+    int threads = 1;          ///< 工作线程数，1 为串行路径，<= 0 使用全部 CPU 核心
+    int tile_size = 128;      ///< 并行模式下输出 tile 的边长（像素），需要能放进 L2 cache
+    MorphEngine engine = MORPH_ENGINE_CLASSIC; ///< 中间帧的生成方式
+    bool fixed_point = false; ///< 8bit 定点路径: 定点双线性权重、u8 mask、整数混合，和浮点结果相差不超过 1
+    float static_threshold = 0; ///< 三角形顶点位移都小于该值（像素）时不做仿射，直接保留原图或只做溶解，<= 0 关闭
+    int pyramid_levels = 0;   ///< setup 时额外构建的金字塔层数，每层边长减半，用于快速预览
+    int lod_level = 0;        ///< 关键点 LOD 级别，第 k 级保留约 1/2^k 的点，0 使用全部关键点
+    int lod_triangles = 0;    ///< 三角形预算，> 0 时去掉关键点直到三角形个数不超过该值（不含边框点）
+    float lod_max_error = 0;  ///< LOD 相对完整网格的最大形变误差（像素），> 0 时优先满足
+    bool verbose = true;      ///< 打印各阶段耗时，跑 benchmark 时关闭
+};
+
+/**
+ * 最近一次 getFrameAt 各条路径处理的像素数，CLASSIC 模式下是 src, dst 两遍之和
+ */
+struct MorphStats {
+    long warp_pixels = 0;     ///< 做了仿射采样的像素
+    long copy_pixels = 0;     ///< 几乎不动，直接保留原图的像素 (CLASSIC)
+    long dissolve_pixels = 0; ///< 不做仿射，只在原位置交叉溶解的像素 (FUSED)
+};
 
 class Landmarks {
 public:
@@ -15,21 +48,20 @@ public:
         m_points.push_back(v);
     }
 
-    void setup(std::vector<float> &points) {
-        m_points = points;
+    void setup(LandmarkView points) {
+        points.copyTo(m_points);
     }
 
     // 加上边框上 8 个点
-    void setup(float w, float h, std::vector<float> &points) {
+    void setup(float w, float h, LandmarkView points) {
         m_points.clear();
         if (points.empty()) {
             return;
         }
 
         // 尽可能减少点的个数
-        for (float &f: points) {
-            m_points.push_back(f);
-        }
+        m_points.reserve((size_t) points.size() * 2 + 8);
+        points.copyTo(m_points);
         m_points.push_back(0);
         m_points.push_back(0);
 
@@ -75,16 +107,47 @@ public:
         return m_points[2 * i + 1];
     }
 
+    inline const float *data() const {
+        return m_points.data();
+    }
+
+    /**
+     * (1 - alpha) * a + alpha * b，点数不变时不会重新分配
+     */
+    void interpolate(const Landmarks &a, const Landmarks &b, float alpha) {
+        m_points.resize(a.m_points.size());
+        for (size_t i = 0, size = m_points.size(); i < size; ++i) {
+            m_points[i] = (1 - alpha) * a.m_points[i] + alpha * b.m_points[i];
+        }
+    }
+
+    /**
+     * 三个顶点相对 other 的最大位移 (x, y 分量的最大绝对值)
+     */
+    inline float maxDisplacement(int ai, int bi, int ci, const Landmarks &other) const {
+        float d = 0;
+        for (int i : {ai, bi, ci}) {
+            d = std::max(d, std::fabs(px(i) - other.px(i)));
+            d = std::max(d, std::fabs(py(i) - other.py(i)));
+        }
+        return d;
+    }
+
+    inline float triangleArea(int ai, int bi, int ci) const {
+        float cross = (px(bi) - px(ai)) * (py(ci) - py(ai)) - (py(bi) - py(ai)) * (px(ci) - px(ai));
+        return std::fabs(cross) * 0.5f;
+    }
+
     void getTriangles(int ai, int bi, int ci,
                       cv::Rect &boundRect,
                       std::vector<cv::Point2f> &cropPoints) const {
-        std::vector<cv::Point2f> srcPoints = {
+        cv::Point2f srcPoints[3] = {
                 cv::Point2f(px(ai), py(ai)),
                 cv::Point2f(px(bi), py(bi)),
                 cv::Point2f(px(ci), py(ci)),
         };
 
-        cv::Rect2f outRect = cv::boundingRect(srcPoints);
+        cv::Rect2f outRect = cv::boundingRect(cv::Mat(3, 1, CV_32FC2, srcPoints));
         boundRect = outRect;
 
         cropPoints.emplace_back(px(ai) - outRect.x, py(ai) - outRect.y);
@@ -98,7 +161,7 @@ private:
 
 class MorphImage {
 public:
-    void setup(cv::Mat &src, std::vector<float> &points, bool addBoarderPoint=true) {
+    void setup(cv::Mat &src, LandmarkView points, bool addBoarderPoint=true) {
         img = src;
         if (addBoarderPoint) {
             landmarks.setup((float)img.cols, (float)img.rows, points);
@@ -111,8 +174,24 @@ public:
         return landmarks.vSize() == 0;
     }
 
-    cv::Mat morphTriangles(std::vector<size_t> &triangles, Landmarks &dst, bool debug = false) const {
-        cv::Mat out = img.clone();
+    cv::Mat morphTriangles(const std::vector<size_t> &triangles, const Landmarks &dst, bool debug = false) const {
+        cv::Mat out;
+        MorphScratch scratch;
+        MorphTriangle tri;
+        morphTriangles(triangles, dst, out, scratch, tri, MorphConfig(), nullptr, debug);
+        return out;
+    }
+
+    /**
+     * 结果写到 out，临时的 mask, warp 图都从 scratch 中获取，out 大小不变时稳定之后没有堆分配
+     * @param tri 单个三角形的中间结果，跨帧复用
+     * @param config fixed_point 时使用 u8 mask 直接拷贝，static_threshold 以下的三角形保留原图
+     * @param stats 不为空时累加各路径的像素数
+     */
+    void morphTriangles(const std::vector<size_t> &triangles, const Landmarks &dst, cv::Mat &out,
+                        MorphScratch &scratch, MorphTriangle &tri, const MorphConfig &config,
+                        MorphStats *stats = nullptr, bool debug = false) const {
+        img.copyTo(out);
 //        mask_img = cv::Mat(img.rows, img.cols, CV_8UC1);
 //        dst_img = cv::Mat(img.rows, img.cols, img.type());
         int triSize = (int) triangles.size() / 3;
@@ -123,72 +202,85 @@ public:
             int ci = (int) triangles[i * 3 + 2];
 //            printf("triangles index[%d,%d,%d]\n", ai, bi, ci);
 //            long start = TimeUtils::nowMs();
-            morphTriangle(ai, bi, ci, dst, out, debug);
+            // out 一开始就是原图，几乎不动的三角形直接跳过
+            bool moving = isMoving(ai, bi, ci, dst, config.static_threshold);
+            if (stats) {
+                (moving ? stats->warp_pixels : stats->copy_pixels) += (long) dst.triangleArea(ai, bi, ci);
+            }
+            if (!moving) {
+                continue;
+            }
+            scratch.reset();
+            morphTriangle(ai, bi, ci, dst, out, scratch, tri, config.fixed_point, debug);
 //            long costMs = TimeUtils::nowMs() - start;
             //printf("iterator(%d) cost: %ld ms\n", i, costMs);
         }
-
-        return out;
     }
 
-    void morphTriangle(int ai, int bi, int ci, Landmarks &dst, cv::Mat &outMat, bool debug = false) const {
-        // 原图的三角形点
-        cv::Rect srcRect;
-        // 以外接矩形为原点的做标点
-        std::vector<cv::Point2f> srcCropPoints;
-        srcCropPoints.reserve(3);
-        landmarks.getTriangles(ai, bi, ci, srcRect, srcCropPoints);
-//        printf("src bound rect: %d, %d - %d, %d\n", srcRect.x, srcRect.y, srcRect.width, srcRect.height);
-//        for (auto &p: srcCropPoints) {
-//            printf("src crop p[%.2f, %.2f]\n", p.x, p.y);
-//        }
+    /**
+     * 并行模式: 先并行计算每个三角形的仿射结果，再按 tile 并行混合
+     * 每个三角形只仿射一次，tile 内保持三角形顺序，输出和 morphTriangles 完全一致
+     */
+    void morphTrianglesTiled(const std::vector<size_t> &triangles, const Landmarks &dst, cv::Mat &out,
+                             wuta::ThreadPool &pool, MorphTileGrid &grid,
+                             std::vector<MorphTriangle> &tris, MorphScratch &scratch,
+                             const MorphConfig &config, MorphStats *stats = nullptr) const {
+        img.copyTo(out);
+        int triSize = (int) triangles.size() / 3;
+        tris.resize(triSize);
+
+        pool.parallelFor(triSize, [&](int i) {
+            int ai = (int) triangles[i * 3], bi = (int) triangles[i * 3 + 1], ci = (int) triangles[i * 3 + 2];
+            tris[i].active = isMoving(ai, bi, ci, dst, config.static_threshold);
+            prepareTriangle(ai, bi, ci, dst, tris[i]);
+        });
+        // scratch 不是线程安全的，先串行切好每个三角形的内存
+        scratch.reset();
+        for (int i = 0; i < triSize; ++i) {
+            MorphTriangle &tri = tris[i];
+            if (stats) {
+                long area = (long) dst.triangleArea((int) triangles[i * 3], (int) triangles[i * 3 + 1],
+                                                    (int) triangles[i * 3 + 2]);
+                (tri.active ? stats->warp_pixels : stats->copy_pixels) += area;
+            }
+            if (tri.active) {
+                allocTriangle(tri, scratch, config.fixed_point);
+            }
+        }
+        pool.parallelFor(triSize, [&](int i) {
+            if (tris[i].active) {
+                warpTriangle(tris[i]);
+            }
+        });
 
-        // 目标图的三角形点
-        cv::Rect dstRect;
-        std::vector<cv::Point2f> dstCropPoints;
-        dstCropPoints.reserve(3);
-        dst.getTriangles(ai, bi, ci, dstRect, dstCropPoints);
-//        printf("dst bound rect: %d, %d - %d, %d\n", dstRect.x, dstRect.y, dstRect.width, dstRect.height);
-//        for (auto &p: dstCropPoints) {
-//            printf("dst crop p[%.2f, %.2f]\n", p.x, p.y);
-//        }
+        grid.bin(tris);
+        pool.parallelFor(grid.tileCount(), [&](int tile) {
+            grid.compose(tile, tris, out);
+        });
+    }
 
-        /// 生成 mask 图
-        std::vector<cv::Point> dstCropPointsInt;
-        dstCropPointsInt.reserve(dstCropPoints.size());
-        for (cv::Point2f p: dstCropPoints) {
-            dstCropPointsInt.emplace_back((int) p.x, (int) p.y);
-        }
-        cv::Mat mask = cv::Mat::zeros(dstRect.height, dstRect.width, CV_32FC1);
-        cv::fillConvexPoly(mask, dstCropPointsInt, cv::Scalar(1), 8, 0);
+    void morphTriangle(int ai, int bi, int ci, const Landmarks &dst, cv::Mat &outMat,
+                       MorphScratch &scratch, MorphTriangle &tri, bool fixedPoint = false,
+                       bool debug = false) const {
+        prepareTriangle(ai, bi, ci, dst, tri);
+//        printf("src bound rect: %d, %d - %d, %d\n", tri.srcRect.x, tri.srcRect.y, tri.srcRect.width, tri.srcRect.height);
+//        printf("dst bound rect: %d, %d - %d, %d\n", tri.dstRect.x, tri.dstRect.y, tri.dstRect.width, tri.dstRect.height);
+        allocTriangle(tri, scratch, fixedPoint);
+        warpTriangle(tri);
         if (debug) {
-            cv::imshow("mask", mask);
+            cv::imshow("mask", tri.mask);
             cv::waitKey();
-        }
 
-        cv::Mat srcCropImg = img(cv::Range(srcRect.y, srcRect.y + srcRect.height),
-                                 cv::Range(srcRect.x, srcRect.x + srcRect.width));
-        if (debug) {
-            cv::imshow("srcCropImg", srcCropImg);
+            cv::imshow("srcCropImg", img(tri.srcRect));
             cv::waitKey();
-        }
 
-        /// 生成映射矩阵
-        cv::Mat trans = cv::getAffineTransform(srcCropPoints, dstCropPoints);
-        cv::Mat dstCropImg;
-        /// 仿射变换
-        cv::warpAffine(srcCropImg, dstCropImg, trans,
-                       cv::Size(dstRect.width, dstRect.height),
-                       cv::INTER_LINEAR,cv::BORDER_REFLECT_101);
-        if (debug) {
-            cv::imshow("dstCropImg", dstCropImg);
+            cv::imshow("dstCropImg", tri.warped);
             cv::waitKey();
         }
 
         // 将 dstCropImg 混合 mask blend 到 outMat
-        cv::Mat roi = outMat(dstRect);
-        cv::Mat vertMask = 1 - mask;
-        cv::blendLinear(roi, dstCropImg, vertMask, mask, roi);
+        cv::Mat roi = outMat(tri.dstRect);
+        tri.blendTo(roi, tri.warped, tri.mask, tri.invMask);
 
         if (debug) {
             cv::imshow("outMat", outMat);
@@ -196,103 +288,579 @@ public:
         }
     }
 
+    void prepareTriangle(int ai, int bi, int ci, const Landmarks &dst, MorphTriangle &tri) const {
+        // 原图的三角形点, 以外接矩形为原点的做标点
+        tri.srcCrop.clear();
+        tri.srcCrop.reserve(3);
+        landmarks.getTriangles(ai, bi, ci, tri.srcRect, tri.srcCrop);
+
+        // 目标图的三角形点
+        tri.dstCrop.clear();
+        tri.dstCrop.reserve(3);
+        dst.getTriangles(ai, bi, ci, tri.dstRect, tri.dstCrop);
+    }
+
+    /**
+     * 顶点相对 dst 的位移超过 threshold 才需要仿射，threshold <= 0 时全部仿射
+     */
+    inline bool isMoving(int ai, int bi, int ci, const Landmarks &dst, float threshold) const {
+        return threshold <= 0 || landmarks.maxDisplacement(ai, bi, ci, dst) >= threshold;
+    }
+
+    /**
+     * 从 scratch 中切出 mask, invMask, warped
+     * 定点模式下 mask 为 CV_8UC1，不需要 invMask
+     */
+    void allocTriangle(MorphTriangle &tri, MorphScratch &scratch, bool fixedPoint = false) const {
+        int w = tri.dstRect.width, h = tri.dstRect.height;
+        if (fixedPoint) {
+            tri.mask = scratch.take(h, w, CV_8UC1);
+            tri.invMask = cv::Mat();
+        } else {
+            tri.mask = scratch.take(h, w, CV_32FC1);
+            tri.invMask = scratch.take(h, w, CV_32FC1);
+        }
+        tri.warped = scratch.take(h, w, img.type());
+    }
+
+    void warpTriangle(MorphTriangle &tri) const {
+        /// 生成 mask 图
+        cv::Point dstCropPointsInt[3];
+        for (int i = 0; i < 3; ++i) {
+            dstCropPointsInt[i] = cv::Point((int) tri.dstCrop[i].x, (int) tri.dstCrop[i].y);
+        }
+        tri.mask.setTo(cv::Scalar(0));
+        if (tri.mask.type() == CV_8UC1) {
+            cv::fillConvexPoly(tri.mask, dstCropPointsInt, 3, cv::Scalar(255), 8, 0);
+        } else {
+            cv::fillConvexPoly(tri.mask, dstCropPointsInt, 3, cv::Scalar(1), 8, 0);
+            cv::subtract(cv::Scalar(1), tri.mask, tri.invMask);
+        }
+
+        cv::Mat srcCropImg = img(cv::Range(tri.srcRect.y, tri.srcRect.y + tri.srcRect.height),
+                                 cv::Range(tri.srcRect.x, tri.srcRect.x + tri.srcRect.width));
+
+        /// 生成映射矩阵，和 cv::getAffineTransform 相同，但不分配内存
+        double m[6];
+        MorphAffine::solve(&tri.srcCrop[0].x, &tri.dstCrop[0].x, m);
+        cv::Mat trans(2, 3, CV_64F, m);
+        /// 仿射变换，warped 已经是目标大小，不会重新分配
+        cv::warpAffine(srcCropImg, tri.warped, trans,
+                       cv::Size(tri.dstRect.width, tri.dstRect.height),
+                       cv::INTER_LINEAR,cv::BORDER_REFLECT_101);
+    }
+
 public:
     Landmarks landmarks;
     cv::Mat img;
 };
 
+/**
+ * 金字塔的一层: 缩小后的 src, dst 和对应缩放的关键点，以及该层 getFrameAt 复用的内存
+ */
+struct MorphLevel {
+    MorphImage src;
+    MorphImage dst;
+
+    cv::Mat srcWarp;
+    cv::Mat dstWarp;
+    MorphFramePool framePool;
+};
+
 class FaceMorph {
 public:
-    void setup(cv::Mat &src, std::vector<float> srcFacePoints,
-               cv::Mat &dst, std::vector<float> dstFacePoints) {
+    void setConfig(const MorphConfig &config) {
+        m_config = config;
+        if (config.threads == 1) {
+            m_pool.reset();
+        } else {
+            int threads = config.threads > 0 ? config.threads : (int) std::thread::hardware_concurrency();
+            if (m_pool == nullptr || m_pool->size() != threads) {
+                m_pool = std::make_unique<wuta::ThreadPool>(threads, "face_morph");
+            }
+        }
+    }
+
+    inline const MorphConfig &config() const {
+        return m_config;
+    }
+
+    /**
+     * 关键点只在这里复制一次到 Landmarks，调用返回之后不再引用 srcFacePoints, dstFacePoints
+     */
+    void setup(cv::Mat &src, LandmarkView srcFacePoints,
+               cv::Mat &dst, LandmarkView dstFacePoints) {
         if (src.cols != dst.cols || src.rows != dst.rows) {
             throw std::runtime_error("src size != dst size");
         }
+        // LOD 取子集时才需要自己的内存
+        std::vector<float> srcLOD, dstLOD;
+        if (applyLOD(srcFacePoints, dstFacePoints, srcLOD, dstLOD)) {
+            srcFacePoints = srcLOD;
+            dstFacePoints = dstLOD;
+        }
         m_src_img.setup(src, srcFacePoints);
         m_dst_img.setup(dst, dstFacePoints);
+        buildPyramid(srcFacePoints, dstFacePoints);
 
         if (srcFacePoints.size() == dstFacePoints.size()) {
-            std::vector<double> averagePoints;
-            for (int i = 0, size = m_src_img.landmarks.vSize(); i < size; ++i) {
-                averagePoints.push_back((m_src_img.landmarks.v(i) + m_dst_img.landmarks.v(i)) / 2.);
-            }
-            // 生成三角形
-            delaunator::Delaunator dela(averagePoints);
-            m_triangles_indexes = dela.triangles;
+            // 生成三角形，点位布局有预生成的表或者上一次 setup 的三角形，在平均点位上仍然有效时直接使用，否则三角化
+            Landmarks &averagePoints = m_weight_landmarks;
+            averagePoints.interpolate(m_src_img.landmarks, m_dst_img.landmarks, 0.5f);
+            size_t indexSize;
+            const size_t *triangles = m_topology.triangles(averagePoints.data(), averagePoints.pSize(), indexSize);
+            m_triangles_indexes.assign(triangles, triangles + indexSize);
         } else {
             m_triangles_indexes.clear();
         }
 
-        printf("FaceMorph triangles size: %d\n", (int)m_triangles_indexes.size()/3);
+        m_sequence.clear();
+        m_chroma_sequence.clear();
+        m_src_nv21.release();
+        m_dst_nv21.release();
+        if (m_config.verbose) {
+            printf("FaceMorph triangles size: %d\n", (int)m_triangles_indexes.size()/3);
+        }
+    }
+
+    /**
+     * NV21 输入: (height * 3 / 2) x width 的 CV_8UC1，前 height 行为 Y，之后为交错的 VU
+     * Y 平面按原图处理，VU 平面当作 (width / 2) x (height / 2) 的 2 通道图，
+     * 顶点坐标 (包括边框点) 取 Y 的一半，和 Y 共用同一套三角形
+     * 之后用 getFrameAtNV21 取帧，不需要和 BGR 互转，每像素只处理 1.5 字节
+     */
+    void setupNV21(const cv::Mat &src, LandmarkView srcFacePoints,
+                   const cv::Mat &dst, LandmarkView dstFacePoints) {
+        if (src.type() != CV_8UC1 || src.size() != dst.size() || dst.type() != src.type() ||
+            src.rows % 3 != 0 || src.cols % 2 != 0 || (src.rows / 3) % 2 != 0) {
+            throw std::runtime_error("FaceMorph: invalid nv21 image");
+        }
+        int height = src.rows * 2 / 3;
+        cv::Mat srcY = src.rowRange(0, height);
+        cv::Mat dstY = dst.rowRange(0, height);
+        setup(srcY, srcFacePoints, dstY, dstFacePoints);
+        m_src_nv21 = src;
+        m_dst_nv21 = dst;
+
+        m_chroma.framePool.clear();
+        setupChroma(m_chroma.src, src, m_src_img.landmarks);
+        setupChroma(m_chroma.dst, dst, m_dst_img.landmarks);
+    }
+
+    inline bool isNV21() const {
+        return !m_src_nv21.empty();
+    }
+
+    /**
+     * 预先计算 sumFrames 帧序列里每一帧的 span 和仿射系数，之后 getFrameAt(index, sumFrames) 不再做光栅化和仿射求解
+     * 只对 MORPH_ENGINE_FUSED 有效；CLASSIC 每帧按三角形 warpAffine，没有可以预先计算的部分，直接返回
+     */
+    void prepareSequence(int sumFrames) {
+        m_sequence.clear();
+        m_chroma_sequence.clear();
+        if (m_config.engine != MORPH_ENGINE_FUSED) {
+            if (m_config.verbose) {
+                printf("prepare sequence(%d) skipped: only MORPH_ENGINE_FUSED uses it\n", sumFrames);
+            }
+            return;
+        }
+        if (m_triangles_indexes.empty() || m_src_img.noFace() || m_dst_img.noFace()) {
+            return;
+        }
+        long startMs = TimeUtils::nowMs();
+        m_sequence.prepare(m_src_img.img.cols, m_src_img.img.rows,
+                           m_src_img.landmarks.data(), m_dst_img.landmarks.data(), m_src_img.landmarks.pSize(),
+                           m_triangles_indexes, sumFrames,
+                           [sumFrames](int index) { return alphaAt(index, sumFrames); }, m_pool.get(),
+                           m_config.static_threshold);
+        if (isNV21()) {
+            m_chroma_sequence.prepare(m_chroma.src.img.cols, m_chroma.src.img.rows,
+                                      m_chroma.src.landmarks.data(), m_chroma.dst.landmarks.data(),
+                                      m_chroma.src.landmarks.pSize(), m_triangles_indexes, sumFrames,
+                                      [sumFrames](int index) { return alphaAt(index, sumFrames); }, m_pool.get(),
+                                      m_config.static_threshold / 2);
+        }
+        if (m_config.verbose) {
+            printf("prepare sequence(%d) cost: %ld ms\n", sumFrames, TimeUtils::nowMs() - startMs);
+        }
     }
 
     cv::Mat getFrameAt(int index, int sumFrames, bool debug = false) {
-        float alpha = sumFrames < 1 ? 0 : (float) (index+1) / (float) (sumFrames);
+        return getFrameAt(index, sumFrames, 0, debug);
+    }
+
+    /**
+     * 从金字塔第 level 层渲染，第 k 层边长为原图的 1/2^k，耗时约为 1/4^k
+     * 预览、拖动进度条和缩略图用高层，只对最终保留的帧用第 0 层渲染
+     */
+    cv::Mat getFrameAt(int index, int sumFrames, int level, bool debug = false) {
+        if (m_levels.empty()) {
+            // 还没有 setup
+            return {};
+        }
+        MorphLevel &lv = m_levels[std::min(std::max(level, 0), levels() - 1)];
+        float alpha = alphaAt(index, sumFrames);
         if (index <= 0) {
-            return m_src_img.img;
+            return lv.src.img;
         }
 
         if (index >= sumFrames-1) {
-            return m_dst_img.img;
+            return lv.dst.img;
         }
 
-        if (m_triangles_indexes.empty() || m_src_img.noFace() || m_dst_img.noFace()) {
-            cv::Mat blendMat;
-            cv::addWeighted(m_src_img.img, 1 - alpha,
-                            m_dst_img.img, alpha, 0, blendMat);
+        // 输出帧从帧池中获取，调用方释放之后复用
+        cv::Mat blendMat = lv.framePool.obtain(lv.src.img.rows, lv.src.img.cols, lv.src.img.type());
+        m_stats = MorphStats();
+        morphLevel(lv, &lv == &m_levels[0] ? &m_sequence : nullptr, index, sumFrames, alpha, blendMat, debug);
+        return blendMat;
+    }
+
+    /**
+     * setupNV21 之后使用，返回和输入相同格式的 NV21 帧，Y 和 VU 分别在各自的平面上形变
+     */
+    cv::Mat getFrameAtNV21(int index, int sumFrames) {
+        if (!isNV21()) {
+            throw std::runtime_error("FaceMorph: getFrameAtNV21 needs setupNV21");
+        }
+        if (index <= 0) {
+            return m_src_nv21;
+        }
+        if (index >= sumFrames-1) {
+            return m_dst_nv21;
+        }
+
+        float alpha = alphaAt(index, sumFrames);
+        int width = m_src_img.img.cols, height = m_src_img.img.rows;
+        cv::Mat frame = m_chroma.framePool.obtain(m_src_nv21.rows, width, CV_8UC1);
+        cv::Mat y = frame.rowRange(0, height);
+        cv::Mat vu(height / 2, width / 2, CV_8UC2, frame.ptr<uint8_t>(height), frame.step);
+        m_stats = MorphStats();
+        morphLevel(m_levels[0], &m_sequence, index, sumFrames, alpha, y, false);
+        morphLevel(m_chroma, &m_chroma_sequence, index, sumFrames, alpha, vu, false);
+        return frame;
+    }
+
+    /**
+     * 线程安全版本的 getFrameAt: 不使用内部线程池和共享缓存，可以在多个线程里同时渲染不同的帧
+     * 已经 prepareSequence 过的帧直接按计划渲染
+     */
+    cv::Mat renderFrame(int index, int sumFrames, int level = 0) const {
+        if (m_levels.empty()) {
+            return {};
+        }
+        const MorphLevel &lv = m_levels[std::min(std::max(level, 0), levels() - 1)];
+        float alpha = alphaAt(index, sumFrames);
+        if (index <= 0) {
+            return lv.src.img;
+        }
+        if (index >= sumFrames-1) {
+            return lv.dst.img;
+        }
+
+        cv::Mat blendMat;
+        if (m_triangles_indexes.empty() || lv.src.noFace() || lv.dst.noFace()) {
+            dissolve(lv.src.img, lv.dst.img, alpha, blendMat);
+            return blendMat;
+        }
+
+        if (m_config.engine == MORPH_ENGINE_FUSED) {
+            blendMat.create(lv.src.img.rows, lv.src.img.cols, lv.src.img.type());
+            if (&lv == &m_levels[0] && m_sequence.has(index, sumFrames)) {
+                FusedMorph::execute(m_sequence.frame(index), lv.src.img, lv.dst.img, blendMat,
+                                    nullptr, m_config.fixed_point);
+            } else {
+                Landmarks weightLandmarks;
+                weightLandmarks.interpolate(lv.src.landmarks, lv.dst.landmarks, alpha);
+                FusedMorph fused;
+                fused.render(lv.src.img, lv.src.landmarks.data(),
+                             lv.dst.img, lv.dst.landmarks.data(),
+                             weightLandmarks.data(), m_triangles_indexes, alpha, blendMat,
+                             nullptr, m_config.fixed_point, m_config.static_threshold);
+            }
+            return blendMat;
+        }
+
+        Landmarks weightLandmarks;
+        weightLandmarks.interpolate(lv.src.landmarks, lv.dst.landmarks, alpha);
+        MorphScratch scratch;
+        MorphTriangle tri;
+        cv::Mat srcWrap, dstWrap;
+        lv.src.morphTriangles(m_triangles_indexes, weightLandmarks, srcWrap, scratch, tri, m_config);
+        lv.dst.morphTriangles(m_triangles_indexes, weightLandmarks, dstWrap, scratch, tri, m_config);
+        dissolve(srcWrap, dstWrap, alpha, blendMat);
+        return blendMat;
+    }
+
+    inline int width(int level = 0) const {
+        return level >= 0 && level < levels() ? m_levels[level].src.img.cols : 0;
+    }
+
+    inline int height(int level = 0) const {
+        return level >= 0 && level < levels() ? m_levels[level].src.img.rows : 0;
+    }
+
+    inline int type() const {
+        return m_src_img.img.type();
+    }
+
+    /**
+     * 输出当前三角形，生成 FACE_MESH_TABLES 用
+     */
+    void dumpMeshTable(FILE *file, const char *name) const {
+        FaceMeshTopology::dumpTable(file, name, m_src_img.landmarks.pSize(),
+                                    m_triangles_indexes.data(), m_triangles_indexes.size());
+    }
+
+    inline int triangleCount() const {
+        return (int) m_triangles_indexes.size() / 3;
+    }
+
+    /**
+     * setup 时实际三角化的次数，点位布局不变且上一次的三角形仍然有效时不增加
+     */
+    inline int triangulations() const {
+        return m_topology.triangulations();
+    }
+
+    /**
+     * 最近一次 setup 使用 LOD 之后相对完整关键点网格的最大形变误差（像素），没有使用 LOD 时为 0
+     */
+    inline float lodError() const {
+        return m_lod_error;
+    }
+
+    /**
+     * 金字塔层数，包括原图
+     */
+    inline int levels() const {
+        return (int) m_levels.size();
+    }
+
+    /**
+     * 最近一次 getFrameAt 各路径的像素数
+     */
+    inline const MorphStats &stats() const {
+        return m_stats;
+    }
+
+    /**
+     * getFrameAt 内部缓存的分配次数，稳定之后每帧应该不再增加
+     * 完整的堆分配统计见 wuta::AllocProbe
+     */
+    inline long allocations() const {
+        long count = m_scratch.allocations();
+        for (const MorphLevel &lv : m_levels) {
+            count += lv.framePool.allocations();
+        }
+        count += m_chroma.framePool.allocations();
+        return count;
+    }
+
+private:
+    /**
+     * 按配置的 LOD 去掉两端对应的关键点，两端点数不同时不处理
+     * @return true 时子集写在 srcOut, dstOut 中
+     */
+    bool applyLOD(LandmarkView srcFacePoints, LandmarkView dstFacePoints,
+                  std::vector<float> &srcOut, std::vector<float> &dstOut) {
+        m_lod_error = 0;
+        if ((m_config.lod_level <= 0 && m_config.lod_triangles <= 0 && m_config.lod_max_error <= 0) ||
+            srcFacePoints.empty() || srcFacePoints.size() != dstFacePoints.size()) {
+            return false;
+        }
+        long startMs = TimeUtils::nowMs();
+        int count = srcFacePoints.size();
+        // LandmarkLOD 需要连续的点，跨步的视图先展开
+        if (!srcFacePoints.contiguous()) {
+            srcFacePoints.copyTo(srcOut);
+            srcFacePoints = srcOut;
+        }
+        if (!dstFacePoints.contiguous()) {
+            dstFacePoints.copyTo(dstOut);
+            dstFacePoints = dstOut;
+        }
+        LandmarkLOD lod;
+        lod.build(srcFacePoints.data(), dstFacePoints.data(), count);
+        std::vector<int> indices = lod.selectBudget(m_config.lod_level, m_config.lod_triangles,
+                                                    m_config.lod_max_error);
+        m_lod_error = lod.error((int) indices.size());
+        srcOut = LandmarkLOD::gather(srcFacePoints.data(), indices);
+        dstOut = LandmarkLOD::gather(dstFacePoints.data(), indices);
+        if (m_config.verbose) {
+            printf("FaceMorph LOD: %d -> %d points, error: %.2f px, cost: %ld ms\n",
+                   count, (int) indices.size(), m_lod_error, TimeUtils::nowMs() - startMs);
+        }
+        return true;
+    }
+
+    /**
+     * nv21 后半部分的 VU 平面，顶点为 luma 的顶点坐标减半
+     */
+    static void setupChroma(MorphImage &image, const cv::Mat &nv21, const Landmarks &luma) {
+        int height = nv21.rows * 2 / 3;
+        cv::Mat vu(height / 2, nv21.cols / 2, CV_8UC2, (void *) nv21.ptr<uint8_t>(height), nv21.step);
+        std::vector<float> points(luma.data(), luma.data() + luma.vSize());
+        for (float &v : points) {
+            v *= 0.5f;
+        }
+        image.setup(vu, points, false);
+    }
+
+    /**
+     * 把 lv 的第 index 帧渲染到 out，out 已经分配好，可以是更大的 Mat 中的一块
+     * @param sequence lv 对应的序列计划，没有时为空
+     */
+    void morphLevel(MorphLevel &lv, const MorphSequencePlan *sequence, int index, int sumFrames, float alpha,
+                    cv::Mat &blendMat, bool debug) {
+        if (m_triangles_indexes.empty() || lv.src.noFace() || lv.dst.noFace()) {
+            dissolve(lv.src.img, lv.dst.img, alpha, blendMat);
+            m_stats.dissolve_pixels += (long) blendMat.rows * blendMat.cols;
             if (debug) {
                 cv::imshow("blend", blendMat);
                 cv::waitKey();
             }
-            return blendMat;
+            return;
         }
 
-        Landmarks weightLandmarks;
-        for (int i = 0, size = m_src_img.landmarks.vSize(); i < size; ++i) {
-            float a = m_src_img.landmarks.v(i);
-            float b = m_dst_img.landmarks.v(i);
-            float n = (1 - alpha) * a + alpha * b;
-            weightLandmarks.push(n);
+        if (m_config.engine == MORPH_ENGINE_FUSED && sequence && sequence->has(index, sumFrames)) {
+            long startMs = TimeUtils::nowMs();
+            const MorphFramePlan &plan = sequence->frame(index);
+            FusedMorph::execute(plan, lv.src.img, lv.dst.img, blendMat, m_pool.get(), m_config.fixed_point);
+            m_stats.warp_pixels += plan.warpPixels;
+            m_stats.dissolve_pixels += plan.dissolvePixels;
+            if (m_config.verbose) {
+                printf("fused morph(planned) cost: %ld ms\n", TimeUtils::nowMs() - startMs);
+            }
+            return;
+        }
+
+        Landmarks &weightLandmarks = m_weight_landmarks;
+        weightLandmarks.interpolate(lv.src.landmarks, lv.dst.landmarks, alpha);
+
+        if (m_config.engine == MORPH_ENGINE_FUSED) {
+            long startMs = TimeUtils::nowMs();
+            m_fused.render(lv.src.img, lv.src.landmarks.data(),
+                           lv.dst.img, lv.dst.landmarks.data(),
+                           weightLandmarks.data(), m_triangles_indexes, alpha, blendMat, m_pool.get(),
+                           m_config.fixed_point, m_config.static_threshold);
+            m_stats.warp_pixels += m_fused.lastPlan().warpPixels;
+            m_stats.dissolve_pixels += m_fused.lastPlan().dissolvePixels;
+            if (m_config.verbose) {
+                printf("fused morph cost: %ld ms, warp pixels: %ld, dissolve pixels: %ld\n", TimeUtils::nowMs() - startMs,
+                       m_stats.warp_pixels, m_stats.dissolve_pixels);
+            }
+            if (debug) {
+                cv::imshow("blend", blendMat);
+                cv::waitKey();
+            }
+            return;
         }
 
         if (debug) {
-            cv::imshow("src", m_src_img.img);
+            cv::imshow("src", lv.src.img);
             cv::waitKey();
         }
 
         long startMs = TimeUtils::nowMs();
-        cv::Mat srcWrap = m_src_img.morphTriangles(m_triangles_indexes, weightLandmarks);
+        cv::Mat &srcWrap = lv.srcWarp;
+        morphTriangles(lv.src, weightLandmarks, srcWrap);
         if (debug) {
             cv::imshow("srcWrap", srcWrap);
             cv::waitKey();
         }
         long costMs = TimeUtils::nowMs() - startMs;
-        printf("src morph cost: %ld ms\n", costMs);
+        if (m_config.verbose) {
+            printf("src morph cost: %ld ms\n", costMs);
+        }
 
         if (debug) {
-            cv::imshow("dst", m_dst_img.img);
+            cv::imshow("dst", lv.dst.img);
             cv::waitKey();
         }
         startMs = TimeUtils::nowMs();
-        cv::Mat dstWrap = m_dst_img.morphTriangles(m_triangles_indexes, weightLandmarks);
+        cv::Mat &dstWrap = lv.dstWarp;
+        morphTriangles(lv.dst, weightLandmarks, dstWrap);
         if (debug) {
             cv::imshow("dstWrap", dstWrap);
             cv::waitKey();
         }
         costMs = TimeUtils::nowMs() - startMs;
-        printf("dst morph cost: %ld ms\n", costMs);
+        if (m_config.verbose) {
+            printf("dst morph cost: %ld ms\n", costMs);
+        }
 
         startMs = TimeUtils::nowMs();
-        cv::Mat blendMat;
-        cv::addWeighted(srcWrap, 1 - alpha, dstWrap, alpha, 0, blendMat);
+        dissolve(srcWrap, dstWrap, alpha, blendMat);
         if (debug) {
             cv::imshow("blend", blendMat);
             cv::waitKey();
         }
         costMs = TimeUtils::nowMs() - startMs;
-        printf("blend cost: %ld ms\n", costMs);
+        if (m_config.verbose) {
+            printf("blend cost: %ld ms, warp pixels: %ld, copy pixels: %ld\n", costMs,
+                   m_stats.warp_pixels, m_stats.copy_pixels);
+        }
 
-        return blendMat;
+    }
+
+    /**
+     * 第 0 层直接引用原图，之后每层 pyrDown 一次，关键点按 0.5 缩放 (pyrDown 后 i 像素对应上一层 2i)，
+     * 边框点按该层的尺寸重新生成，三角形拓扑所有层共用
+     */
+    void buildPyramid(LandmarkView srcFacePoints, LandmarkView dstFacePoints) {
+        m_levels.clear();
+        m_levels.resize(1 + std::max(0, m_config.pyramid_levels));
+        m_levels[0].src = m_src_img;
+        m_levels[0].dst = m_dst_img;
+        if (m_levels.size() == 1) {
+            return;
+        }
+
+        // 逐层缩放需要修改点，复制一份
+        std::vector<float> srcPoints = srcFacePoints.toVector(), dstPoints = dstFacePoints.toVector();
+        for (int k = 1, size = (int) m_levels.size(); k < size; ++k) {
+            for (float &v : srcPoints) {
+                v *= 0.5f;
+            }
+            for (float &v : dstPoints) {
+                v *= 0.5f;
+            }
+            cv::Mat srcImg, dstImg;
+            cv::pyrDown(m_levels[k - 1].src.img, srcImg);
+            cv::pyrDown(m_levels[k - 1].dst.img, dstImg);
+            m_levels[k].src.setup(srcImg, srcPoints);
+            m_levels[k].dst.setup(dstImg, dstPoints);
+        }
+    }
+
+    /**
+     * out = a * (1 - alpha) + b * alpha，定点模式下用 u16 整数混合代替 float 的 addWeighted
+     */
+    void dissolve(const cv::Mat &a, const cv::Mat &b, float alpha, cv::Mat &out) const {
+        if (!m_config.fixed_point || a.depth() != CV_8U) {
+            cv::addWeighted(a, 1 - alpha, b, alpha, 0, out);
+            return;
+        }
+        out.create(a.rows, a.cols, a.type());
+        int alphaQ8 = MorphKernel::alphaToFixed(alpha);
+        int rowBytes = a.cols * a.channels();
+        for (int y = 0; y < a.rows; ++y) {
+            MorphKernel::dissolveFixed(a.ptr<uint8_t>(y), b.ptr<uint8_t>(y), out.ptr<uint8_t>(y), rowBytes, alphaQ8);
+        }
+    }
+
+    static inline float alphaAt(int index, int sumFrames) {
+        return sumFrames < 1 ? 0 : (float) (index+1) / (float) (sumFrames);
+    }
+
+    void morphTriangles(const MorphImage &image, const Landmarks &dst, cv::Mat &out) {
+        if (m_pool == nullptr) {
+            image.morphTriangles(m_triangles_indexes, dst, out, m_scratch, m_scratch_triangle, m_config, &m_stats);
+            return;
+        }
+        m_tile_grid.setup(image.img.cols, image.img.rows, m_config.tile_size);
+        image.morphTrianglesTiled(m_triangles_indexes, dst, out, *m_pool, m_tile_grid, m_tile_triangles, m_scratch,
+                                  m_config, &m_stats);
     }
 
 private:
@@ -302,6 +870,31 @@ private:
 
     // 三角形索引
     std::vector<std::size_t> m_triangles_indexes;
+    // 跨 setup 复用的网格拓扑，点位布局不变且仍然有效时不重新三角化
+    FaceMeshTopology m_topology;
+
+    MorphConfig m_config;
+    std::unique_ptr<wuta::ThreadPool> m_pool;
+    MorphTileGrid m_tile_grid;
+    std::vector<MorphTriangle> m_tile_triangles;
+    FusedMorph m_fused;
+    MorphSequencePlan m_sequence;
+
+    // getFrameAt 跨帧复用的内存
+    Landmarks m_weight_landmarks;
+    MorphScratch m_scratch;
+    MorphTriangle m_scratch_triangle;
+    // 金字塔，第 0 层为原图
+    std::vector<MorphLevel> m_levels;
+
+    // setupNV21 时的原始输入和 VU 平面，Y 平面即 m_src_img, m_dst_img
+    cv::Mat m_src_nv21;
+    cv::Mat m_dst_nv21;
+    MorphLevel m_chroma;
+    MorphSequencePlan m_chroma_sequence;
+
+    MorphStats m_stats;
+    float m_lod_error = 0;
 };
 
 class FaceMorphTest {
@@ -5,8 +5,12 @@
 #include <sys/stat.h>
 #include <Playground.h>
 #include "FaceMorph.h"
+#include "MorphSequence.h"
 #include "utils/TimeUtils.h"
-#include "face/detect/InspireFaceDetector.h"
+#include "face/detect/BatchFaceDetector.h"
+#include "face/detect/InspireLandmarkProvider.h"
+#include "face/detect/LandmarkCache.h"
+#include "face/detect/ReplayLandmarkProvider.h"
 
 
 const char *DST_IMG_DIR = "output";
@@ -14,6 +18,16 @@ const char *DST_IMG_DIR = "output";
 int FPS = 30;
 float duration = 1.0f;
 int FRAME_TOTAL_FRAMES = (int) (FPS * duration);
+// 输出全量关键点的三角形表，粘贴到 FaceMeshTopology.h 的 FACE_MESH_TABLES
+bool DUMP_MESH_TABLE = false;
+// 稠密关键点的 LOD 级别，> 0 时按级别去掉形变接近线性的点
+int MORPH_LOD_LEVEL = 0;
+// 不为空时回放录制的关键点，不加载 InspireFace
+const char *LANDMARK_REPLAY_FILE = nullptr;
+// 不为空时把检测结果录制到该文件，之后可以用 LANDMARK_REPLAY_FILE 或 MorphBench --landmarks 回放
+const char *LANDMARK_RECORD_FILE = nullptr;
+// 按图像内容缓存检测结果，命中时不加载模型，为空时关闭
+const char *LANDMARK_CACHE_FILE = "output/landmarks.cache";
 
 void saveToFile(cv::Mat &mat, int i, int subI) {
     char filePath[128] = {0};
@@ -28,12 +42,7 @@ public:
         cv::resize(m, img, cv::Size(m.cols/2, m.rows/2));
     }
 
-    void detect(InspireFaceDetector &detector, bool debug = false) {
-        long start = TimeUtils::nowMs();
-        DetectResult &result = detector.detect(img.data, img.cols, img.rows,
-                                               HF_CAMERA_ROTATION_0, HF_STREAM_BGR, true);
-
-        long costMs = TimeUtils::nowMs() - start;
+    void onDetected(const LandmarkResult &result, long costMs, bool debug = false) {
         printf("detect(%s) cost : %ld ms\n", path.c_str(), costMs);
         printf("result: num faces: %d\n", result.numFaces());
 
@@ -42,7 +51,7 @@ public:
             return;
         }
 
-        FaceData *f = result.face(0);
+        const LandmarkFace *f = result.face(0);
         printf("face data: track id: %d, num landmarks: %d\n", f->trackId(), f->numLandmarks());
 
         if (debug) {
@@ -65,46 +74,58 @@ public:
             cv::waitKey(0);
         }
 
-        for (int k = 0; k < f->numLandmarks(); ++k) {
-            cv::Point2f p(f->landmarkX(k), f->landmarkY(k));
-            landmarks.push_back(p);
-        }
+        // 检测结果在下一次检测时会被覆盖，这里复制一次，之后都用视图
+        landmarks.resize(f->numLandmarks());
+        f->landmarks().copyTo((float *) landmarks.data());
     }
 
-    std::vector<float> getMorphKeyPoints(bool full) {
-        std::vector<float> points;
+    /**
+     * 返回的视图引用 landmarks 或 keyPoints，在下一次调用之前有效
+     */
+    LandmarkView getMorphKeyPoints(bool full) {
         if (landmarks.empty()) {
-            return points;
+            return {};
         }
         if (full) {
-            for (auto & p : landmarks) {
-                points.push_back(p.x);
-                points.push_back(p.y);
-            }
-        } else {
-            points.push_back(landmarks[55].x);
-            points.push_back(landmarks[55].y);
-            points.push_back(landmarks[52].x);
-            points.push_back(landmarks[52].y);
-            points.push_back(landmarks[9].x);
-            points.push_back(landmarks[9].y);
+            return {&landmarks[0].x, (int) landmarks.size()};
         }
-        return points;
+        keyPoints.clear();
+        for (int k : {55, 52, 9}) {
+            keyPoints.push_back(landmarks[k].x);
+            keyPoints.push_back(landmarks[k].y);
+        }
+        return keyPoints;
     }
 
-    void morph(FaceImage &b, bool fullPoints=false) {
+    void morph(FaceImage &b, bool fullPoints=false, bool preview=false) {
+        MorphConfig config;
+        config.pyramid_levels = preview ? 1 : 0;
+        config.lod_level = MORPH_LOD_LEVEL;
+        faceMorph.setConfig(config);
         faceMorph.setup(img, getMorphKeyPoints(fullPoints),
                         b.img, b.getMorphKeyPoints(fullPoints));
+        if (!preview) {
+            // 并行渲染，编码和渲染重叠
+            char pattern[128] = {0};
+            sprintf(pattern, "%s/frame_%d-%%d.jpg", DST_IMG_DIR, 0);
+            ImageFileSink sink(pattern);
+            MorphSequenceRenderer renderer(faceMorph);
+            renderer.render(FPS, sink);
+            return;
+        }
+        // 预览用半分辨率，按 s 保留的帧再渲染原图
         for (int k = 0; k < FPS; ++k) {
             long startMs = TimeUtils::nowMs();
-            cv::Mat mat = faceMorph.getFrameAt(k, FPS, false);
+            long allocs = faceMorph.allocations();
+            cv::Mat mat = faceMorph.getFrameAt(k, FPS, faceMorph.levels() - 1);
             long costMs = TimeUtils::nowMs() - startMs;
-            printf("generate frame(%d),cost: %ld ms\n", k, costMs);
+            printf("generate frame(%d),cost: %ld ms, allocations: %ld\n", k, costMs, faceMorph.allocations() - allocs);
 
             cv::imshow("final", mat);
-            cv::waitKey();
-
-            saveToFile(mat, 0, k);
+            if (cv::waitKey() == 's') {
+                cv::Mat full = faceMorph.getFrameAt(k, FPS, 0);
+                saveToFile(full, 0, k);
+            }
         }
     }
 
@@ -114,6 +135,7 @@ public:
 
     cv::Mat img;
     std::vector<cv::Point2f> landmarks;
+    std::vector<float> keyPoints;
 };
 
 void FaceMorphTest::test() {
@@ -124,15 +146,36 @@ void FaceMorphTest::test() {
     std::string bImgPath = imageDir + "/2001:05.jpg";
     FaceImage bimage(bImgPath.c_str());
 
+    // 每个检测线程一个 session，两张图并行检测；回放的结果依赖调用顺序，只能用一个线程
     DetectConfig detectConfig = {};
-
-    long start = TimeUtils::nowMs();
-    InspireFaceDetector faceDetector(detectConfig);
-    long costMs = TimeUtils::nowMs() - start;
-    printf("init face detector cost : %ld ms\n", costMs);
-
-    aimage.detect(faceDetector);
-    bimage.detect(faceDetector);
+    BatchDetectConfig batchConfig;
+    batchConfig.workers = LANDMARK_REPLAY_FILE || LANDMARK_RECORD_FILE ? 1 : 2;
+    BatchFaceDetector batchDetector(batchConfig, [detectConfig]() -> std::unique_ptr<LandmarkProvider> {
+        if (LANDMARK_REPLAY_FILE) {
+            return std::make_unique<ReplayLandmarkProvider>(LANDMARK_REPLAY_FILE);
+        }
+        std::unique_ptr<LandmarkProvider> provider;
+        if (LANDMARK_CACHE_FILE) {
+            // 模型只在第一次查不到缓存时加载
+            provider = std::make_unique<CachedLandmarkProvider>(
+                    LANDMARK_CACHE_FILE, InspireLandmarkProvider::configKey(detectConfig),
+                    [detectConfig]() { return std::make_unique<InspireLandmarkProvider>(detectConfig); });
+        } else {
+            long start = TimeUtils::nowMs();
+            provider = std::make_unique<InspireLandmarkProvider>(detectConfig);
+            printf("init face detector cost : %ld ms\n", TimeUtils::nowMs() - start);
+        }
+        if (LANDMARK_RECORD_FILE) {
+            return std::make_unique<LandmarkRecorder>(std::move(provider), LANDMARK_RECORD_FILE);
+        }
+        return provider;
+    });
+    std::vector<BatchDetectItem> items = batchDetector.detect(std::vector<cv::Mat>{aimage.img, bimage.img});
+    aimage.onDetected(items[0].result, items[0].detect_ms);
+    bimage.onDetected(items[1].result, items[1].detect_ms);
 
     aimage.morph(bimage, true);
+    if (DUMP_MESH_TABLE) {
+        aimage.faceMorph.dumpMeshTable(stdout, "INSPIRE_FACE_MESH");
+    }
 }
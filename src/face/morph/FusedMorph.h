@@ -0,0 +1,282 @@
+//
+// Created by LiangKeJin on 2024/8/11.
+//
+
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <stdexcept>
+#include <vector>
+#include "utils/ThreadPool.h"
+#include "MorphRaster.h"
+#include "MorphKernel.h"
+
+/**
+ * 一帧的渲染计划: 每行的 span 列表和每个三角形到 src, dst 的逆仿射
+ * 只和顶点位置有关，和像素无关，同一对图片的序列可以提前算好反复使用
+ */
+struct MorphFramePlan {
+    int width = 0;
+    int height = 0;
+    float alpha = 0;
+
+    // 第 y 行为 spans[rowStart[y], rowStart[y + 1])
+    std::vector<MorphSpan> spans;
+    std::vector<int> rowStart;
+
+    std::vector<MorphAffine> srcAffines;
+    std::vector<MorphAffine> dstAffines;
+
+    // 开启 staticThreshold 时参与光栅化的三角形，span.tri 是它的下标
+    std::vector<size_t> activeTriangles;
+
+    // 做仿射采样的像素和只在原位置溶解的像素
+    long warpPixels = 0;
+    long dissolvePixels = 0;
+};
+
+/**
+ * 单遍融合形变
+ * 中间帧的网格只光栅化一次，每个像素用所在三角形的两个逆仿射分别到 src, dst 中双线性采样，
+ * 混合后直接写到输出，不产生中间的 warp 图、mask 图
+ */
+class FusedMorph {
+public:
+    /**
+     * @param srcPoints, dstPoints, curPoints 交错的 x, y 顶点坐标，顶点个数相同
+     * @param out 和 src 相同大小、类型，由调用方分配
+     * @param pool 不为空时按行块并行
+     * @param fixedPoint 使用定点 kernel，和浮点结果相差不超过 1
+     * @param staticThreshold 见 buildPlan
+     */
+    void render(const cv::Mat &src, const float *srcPoints,
+                const cv::Mat &dst, const float *dstPoints,
+                const float *curPoints, const std::vector<size_t> &triangles,
+                float alpha, cv::Mat &out, wuta::ThreadPool *pool = nullptr, bool fixedPoint = false,
+                float staticThreshold = 0) {
+        buildPlan(m_raster, src.cols, src.rows, srcPoints, dstPoints, curPoints, triangles, alpha, m_plan,
+                  staticThreshold);
+        execute(m_plan, src, dst, out, pool, fixedPoint);
+    }
+
+    inline const MorphFramePlan &lastPlan() const {
+        return m_plan;
+    }
+
+    /**
+     * 计算一帧的渲染计划，raster 为光栅化用的临时缓存
+     * @param staticThreshold 顶点相对 src, dst 的位移都小于该值的三角形不做仿射，
+     *                        不进入光栅化，它覆盖的像素和网格外的像素一样只在原位置溶解
+     */
+    static void buildPlan(MorphRaster &raster, int width, int height,
+                          const float *srcPoints, const float *dstPoints, const float *curPoints,
+                          const std::vector<size_t> &allTriangles, float alpha, MorphFramePlan &plan,
+                          float staticThreshold = 0) {
+        const std::vector<size_t> *tris = &allTriangles;
+        if (staticThreshold > 0) {
+            plan.activeTriangles.clear();
+            for (size_t t = 0, size = allTriangles.size(); t + 2 < size; t += 3) {
+                if (isMoving(&allTriangles[t], srcPoints, dstPoints, curPoints, staticThreshold)) {
+                    plan.activeTriangles.insert(plan.activeTriangles.end(), &allTriangles[t], &allTriangles[t] + 3);
+                }
+            }
+            tris = &plan.activeTriangles;
+        }
+        const std::vector<size_t> &triangles = *tris;
+
+        int triSize = (int) triangles.size() / 3;
+        raster.rasterize(width, height, curPoints, triangles.data(), triSize);
+        raster.flatten(plan.spans, plan.rowStart);
+        plan.width = width;
+        plan.height = height;
+        plan.alpha = alpha;
+
+        plan.warpPixels = 0;
+        for (const MorphSpan &span : plan.spans) {
+            plan.warpPixels += span.x1 - span.x0;
+        }
+        plan.dissolvePixels = (long) width * height - plan.warpPixels;
+
+        plan.srcAffines.resize(triSize);
+        plan.dstAffines.resize(triSize);
+        for (int t = 0; t < triSize; ++t) {
+            float cur[6], s[6], d[6];
+            for (int k = 0; k < 3; ++k) {
+                size_t vi = triangles[t * 3 + k];
+                cur[k * 2] = curPoints[vi * 2];
+                cur[k * 2 + 1] = curPoints[vi * 2 + 1];
+                s[k * 2] = srcPoints[vi * 2];
+                s[k * 2 + 1] = srcPoints[vi * 2 + 1];
+                d[k * 2] = dstPoints[vi * 2];
+                d[k * 2 + 1] = dstPoints[vi * 2 + 1];
+            }
+            plan.srcAffines[t] = MorphAffine::fromTriangles(cur, s);
+            plan.dstAffines[t] = MorphAffine::fromTriangles(cur, d);
+        }
+    }
+
+    /**
+     * 按计划渲染一帧，不再做任何光栅化和仿射求解
+     */
+    static void execute(const MorphFramePlan &plan, const cv::Mat &src, const cv::Mat &dst,
+                        cv::Mat &out, wuta::ThreadPool *pool = nullptr, bool fixedPoint = false) {
+        if (src.depth() != CV_8U || src.type() != dst.type() || src.size() != dst.size() ||
+            src.type() != out.type() || src.size() != out.size()) {
+            throw std::runtime_error("FusedMorph: src, dst, out must be 8bit with the same size and type");
+        }
+        if (src.cols != plan.width || src.rows != plan.height) {
+            throw std::runtime_error("FusedMorph: plan size != image size");
+        }
+
+        switch (src.channels()) {
+            case 1:
+                executeAll<1>(plan, src, dst, out, pool, fixedPoint);
+                break;
+            case 2:
+                executeAll<2>(plan, src, dst, out, pool, fixedPoint);
+                break;
+            case 3:
+                executeAll<3>(plan, src, dst, out, pool, fixedPoint);
+                break;
+            case 4:
+                executeAll<4>(plan, src, dst, out, pool, fixedPoint);
+                break;
+            default:
+                throw std::runtime_error("FusedMorph: unsupported channels");
+        }
+    }
+
+private:
+    static inline bool isMoving(const size_t *tri, const float *srcPoints, const float *dstPoints,
+                                const float *curPoints, float threshold) {
+        for (int k = 0; k < 3; ++k) {
+            for (size_t i = tri[k] * 2, end = i + 2; i < end; ++i) {
+                if (std::fabs(curPoints[i] - srcPoints[i]) >= threshold ||
+                    std::fabs(curPoints[i] - dstPoints[i]) >= threshold) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    template<int CN>
+    static void executeAll(const MorphFramePlan &plan, const cv::Mat &src, const cv::Mat &dst,
+                           cv::Mat &out, wuta::ThreadPool *pool, bool fixedPoint) {
+        int rows = src.rows;
+        auto run = fixedPoint ? executeRows<CN, true> : executeRows<CN, false>;
+        if (pool == nullptr) {
+            run(plan, src, dst, 0, rows, out);
+            return;
+        }
+        int blocks = (rows + ROW_BLOCK - 1) / ROW_BLOCK;
+        pool->parallelFor(blocks, [&](int b) {
+            run(plan, src, dst, b * ROW_BLOCK, std::min(rows, (b + 1) * ROW_BLOCK), out);
+        });
+    }
+
+    template<int CN, bool FIXED>
+    static void executeRows(const MorphFramePlan &plan, const cv::Mat &src, const cv::Mat &dst,
+                            int y0, int y1, cv::Mat &out) {
+        MorphKernel::Image s{src.data, src.step};
+        MorphKernel::Image d{dst.data, dst.step};
+        int width = src.cols, height = src.rows;
+        float alpha = plan.alpha;
+        int alphaQ8 = MorphKernel::alphaToFixed(alpha);
+        for (int y = y0; y < y1; ++y) {
+            uint8_t *outRow = out.ptr<uint8_t>(y);
+            int x = 0;
+            for (int i = plan.rowStart[y], end = plan.rowStart[y + 1]; i < end; ++i) {
+                const MorphSpan &span = plan.spans[i];
+                if (span.x0 > x) {
+                    dissolve<CN, FIXED>(s, d, alpha, alphaQ8, y, x, span.x0, outRow);
+                }
+                if (FIXED) {
+                    MorphKernel::warpDissolveFixed<CN>(s, d, width, height,
+                                                       plan.srcAffines[span.tri], plan.dstAffines[span.tri],
+                                                       alphaQ8, y, span.x0, span.x1, outRow);
+                } else {
+                    MorphKernel::warpDissolve<CN>(s, d, width, height,
+                                                  plan.srcAffines[span.tri], plan.dstAffines[span.tri], alpha,
+                                                  y, span.x0, span.x1, outRow);
+                }
+                x = span.x1;
+            }
+            if (x < width) {
+                dissolve<CN, FIXED>(s, d, alpha, alphaQ8, y, x, width, outRow);
+            }
+        }
+    }
+
+    template<int CN, bool FIXED>
+    static inline void dissolve(const MorphKernel::Image &s, const MorphKernel::Image &d, float alpha, int alphaQ8,
+                                int y, int x0, int x1, uint8_t *outRow) {
+        if (FIXED) {
+            MorphKernel::dissolveFixed(s.data + y * s.step + x0 * CN, d.data + y * d.step + x0 * CN,
+                                       outRow + x0 * CN, (x1 - x0) * CN, alphaQ8);
+        } else {
+            MorphKernel::dissolve<CN>(s, d, alpha, y, x0, x1, outRow);
+        }
+    }
+
+private:
+    static constexpr int ROW_BLOCK = 16;
+
+    MorphRaster m_raster;
+    MorphFramePlan m_plan;
+};
+
+/**
+ * 同一对图片整段序列的渲染计划
+ * 拓扑在 FaceMorph::setup 时已经固定，每帧只有顶点位置随 alpha 变化，
+ * 所以光栅化和仿射求解只在 prepare 时做一次，之后每帧只剩采样和混合
+ */
+class MorphSequencePlan {
+public:
+    /**
+     * @param alphaAt 第 index 帧对应的 alpha
+     */
+    template<typename AlphaFunc>
+    void prepare(int width, int height, const float *srcPoints, const float *dstPoints, int vertexSize,
+                 const std::vector<size_t> &triangles, int sumFrames, AlphaFunc alphaAt,
+                 wuta::ThreadPool *pool = nullptr, float staticThreshold = 0) {
+        m_frames.clear();
+        m_frames.resize(std::max(0, sumFrames));
+        m_sum_frames = sumFrames;
+
+        auto build = [&](int index) {
+            float alpha = alphaAt(index);
+            std::vector<float> cur(vertexSize * 2);
+            for (int i = 0, size = vertexSize * 2; i < size; ++i) {
+                cur[i] = (1 - alpha) * srcPoints[i] + alpha * dstPoints[i];
+            }
+            MorphRaster raster;
+            FusedMorph::buildPlan(raster, width, height, srcPoints, dstPoints, cur.data(),
+                                  triangles, alpha, m_frames[index], staticThreshold);
+        };
+        if (pool) {
+            pool->parallelFor(sumFrames, build);
+        } else {
+            for (int i = 0; i < sumFrames; ++i) {
+                build(i);
+            }
+        }
+    }
+
+    void clear() {
+        m_frames.clear();
+        m_sum_frames = 0;
+    }
+
+    inline bool has(int index, int sumFrames) const {
+        return sumFrames == m_sum_frames && index >= 0 && index < m_sum_frames;
+    }
+
+    inline const MorphFramePlan &frame(int index) const {
+        return m_frames[index];
+    }
+
+private:
+    int m_sum_frames = 0;
+    std::vector<MorphFramePlan> m_frames;
+};
@@ -0,0 +1,311 @@
+//
+// Created by LiangKeJin on 2024/8/17.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+#include "utils/Delaunator.h"
+#include "utils/TriangleLocator.h"
+
+/**
+ * 稠密关键点的 LOD: 按对形变结果影响从小到大的顺序依次去掉点，得到任意点数 / 三角形数 / 误差预算下的子集
+ *
+ * 去掉一个点的误差: 去掉之后它（以及已经去掉、落在它周围三角形里的点）只能由周围剩下的点做仿射插值，
+ * 用 src 上的重心坐标在 dst 上插值得到的位置和真实 dst 位置的距离（dst 像素），即相对完整网格的形变误差
+ * 眼睛、嘴巴、脸的轮廓这种形变不是线性的区域误差大，会被保留；平坦区域的点先被去掉
+ * 凸包上的点和调用方指定的点（两眼、鼻子）不会被去掉，网格的覆盖范围不变
+ */
+class LandmarkLOD {
+public:
+    /**
+     * 计算完整的去点顺序，之后按不同的预算取子集都不需要重新计算
+     * @param src, dst 交错的 x, y，count 个点
+     * @param keep 必须保留的点的下标
+     */
+    void build(const float *src, const float *dst, int count, const std::vector<int> &keep = {}) {
+        m_count = count;
+        m_order.clear();
+        m_errors.clear();
+        m_hull_count = 0;
+        if (count < 4) {
+            return;
+        }
+        m_src.assign(src, src + count * 2);
+        m_dst.assign(dst, dst + count * 2);
+
+        std::vector<bool> locked(count, false);
+        for (int i : keep) {
+            if (i >= 0 && i < count) {
+                locked[i] = true;
+            }
+        }
+        delaunator::BasicDelaunator<float> full({m_src.data(), (size_t) count});
+        size_t e = full.hull_start;
+        do {
+            locked[e] = true;
+            m_hull_count += 1;
+            e = full.hull_next[e];
+        } while (e != full.hull_start);
+
+        std::vector<bool> removed(count, false);
+        float maxError = 0;
+        while (true) {
+            int best = -1;
+            float bestError = FLT_MAX;
+            prepare(removed);
+            for (int local = 0, size = (int) m_kept.size(); local < size; ++local) {
+                int c = m_kept[local];
+                if (locked[c]) {
+                    continue;
+                }
+                float err = removeError(local);
+                if (err < bestError) {
+                    bestError = err;
+                    best = c;
+                }
+            }
+            if (best < 0 || bestError == FLT_MAX) {
+                break;
+            }
+            removed[best] = true;
+            maxError = std::max(maxError, bestError);
+            m_order.push_back(best);
+            m_errors.push_back(maxError);
+        }
+    }
+
+    inline int count() const {
+        return m_count;
+    }
+
+    /**
+     * 最少能保留的点数（凸包和必须保留的点）
+     */
+    inline int minPoints() const {
+        return m_count - (int) m_order.size();
+    }
+
+    /**
+     * 第 level 级保留约 count / 2^level 个点，level 0 为全部
+     */
+    int levelPoints(int level) const {
+        int points = level <= 0 ? m_count : (m_count >> std::min(level, 30));
+        return std::max(points, minPoints());
+    }
+
+    /**
+     * 三角形个数约为 2n - h - 2，h 为凸包点数
+     */
+    int trianglePoints(int triangles) const {
+        return std::max((triangles + m_hull_count + 3) / 2, minPoints());
+    }
+
+    /**
+     * 保留 points 个点，maxError > 0 时误差不超过 maxError（可能保留更多的点）
+     * @return 保留的点的下标，从小到大
+     */
+    std::vector<int> select(int points, float maxError = 0) const {
+        int removeCount = std::max(0, std::min(m_count - points, (int) m_order.size()));
+        if (maxError > 0) {
+            while (removeCount > 0 && m_errors[removeCount - 1] > maxError) {
+                removeCount -= 1;
+            }
+        }
+        std::vector<bool> removed(m_count, false);
+        for (int i = 0; i < removeCount; ++i) {
+            removed[m_order[i]] = true;
+        }
+        std::vector<int> indices;
+        for (int i = 0; i < m_count; ++i) {
+            if (!removed[i]) {
+                indices.push_back(i);
+            }
+        }
+        return indices;
+    }
+
+    /**
+     * 按 LOD 级别、三角形预算和误差预算取子集，<= 0 的项不限制
+     * 只给了误差预算时在误差范围内尽可能少保留点
+     */
+    std::vector<int> selectBudget(int level, int triangles, float maxError) const {
+        int points = level > 0 || triangles > 0 ? levelPoints(level) : (maxError > 0 ? 0 : m_count);
+        if (triangles > 0) {
+            points = std::min(points, trianglePoints(triangles));
+        }
+        return select(points, maxError);
+    }
+
+    /**
+     * 保留 points 个点时相对完整网格的最大形变误差（dst 像素）
+     */
+    float error(int points) const {
+        int removeCount = std::max(0, std::min(m_count - points, (int) m_order.size()));
+        return removeCount == 0 ? 0 : m_errors[removeCount - 1];
+    }
+
+    /**
+     * 按下标取出交错的 x, y
+     */
+    static std::vector<float> gather(const float *points, const std::vector<int> &indices) {
+        std::vector<float> out;
+        out.reserve(indices.size() * 2);
+        for (int i : indices) {
+            out.push_back(points[i * 2]);
+            out.push_back(points[i * 2 + 1]);
+        }
+        return out;
+    }
+
+private:
+    /**
+     * 三角化剩下的点，把已经去掉的点分配到 src 上包含它的三角形
+     */
+    void prepare(const std::vector<bool> &removed) {
+        m_kept.clear();
+        m_kept_src.clear();
+        for (int i = 0; i < m_count; ++i) {
+            if (!removed[i]) {
+                m_kept.push_back(i);
+                m_kept_src.push_back(m_src[i * 2]);
+                m_kept_src.push_back(m_src[i * 2 + 1]);
+            }
+        }
+        m_mesh.update({m_kept_src.data(), m_kept.size()});
+        const size_t triangleCount = m_mesh.triangles.size() / 3;
+
+        // 每个三角形包含的已去掉的点，CSR 形式
+        m_locator.build(m_mesh);
+        std::vector<int> owner(m_count, -1);
+        m_tri_start.assign(triangleCount + 1, 0);
+        for (int i = 0; i < m_count; ++i) {
+            delaunator::TriangleLocation loc;
+            if (removed[i] && m_locator.locate(m_src[i * 2], m_src[i * 2 + 1], loc)) {
+                owner[i] = (int) loc.triangle;
+                m_tri_start[loc.triangle + 1] += 1;
+            }
+        }
+        for (size_t t = 0; t < triangleCount; ++t) {
+            m_tri_start[t + 1] += m_tri_start[t];
+        }
+        m_tri_points.resize(m_tri_start[triangleCount]);
+        std::vector<int> fill(m_tri_start.begin(), m_tri_start.end() - 1);
+        for (int i = 0; i < m_count; ++i) {
+            if (owner[i] >= 0) {
+                m_tri_points[fill[owner[i]]++] = i;
+            }
+        }
+
+        // 每个点所在的三角形
+        m_star_start.assign(m_kept.size() + 1, 0);
+        for (size_t v : m_mesh.triangles) {
+            m_star_start[v + 1] += 1;
+        }
+        for (size_t v = 0; v < m_kept.size(); ++v) {
+            m_star_start[v + 1] += m_star_start[v];
+        }
+        m_star.resize(m_mesh.triangles.size());
+        fill.assign(m_star_start.begin(), m_star_start.end() - 1);
+        for (size_t e = 0; e < m_mesh.triangles.size(); ++e) {
+            m_star[fill[m_mesh.triangles[e]]++] = (int) (e / 3);
+        }
+    }
+
+    /**
+     * 去掉第 local 个保留点之后，它和它周围三角形中已去掉的点的最大误差，无法插值时返回 FLT_MAX
+     */
+    float removeError(int local) {
+        m_ring.clear();
+        m_ring_src.clear();
+        m_check.clear();
+        m_check.push_back(m_kept[local]);
+        for (int s = m_star_start[local]; s < m_star_start[local + 1]; ++s) {
+            int t = m_star[s];
+            for (int k = 0; k < 3; ++k) {
+                int v = m_kept[m_mesh.triangles[t * 3 + k]];
+                if (v != m_kept[local] && std::find(m_ring.begin(), m_ring.end(), v) == m_ring.end()) {
+                    m_ring.push_back(v);
+                    m_ring_src.push_back(m_src[v * 2]);
+                    m_ring_src.push_back(m_src[v * 2 + 1]);
+                }
+            }
+            m_check.insert(m_check.end(), m_tri_points.begin() + m_tri_start[t],
+                           m_tri_points.begin() + m_tri_start[t + 1]);
+        }
+        if (m_ring.size() < 3) {
+            return FLT_MAX;
+        }
+        try {
+            m_ring_mesh.update({m_ring_src.data(), m_ring.size()});
+        } catch (const std::runtime_error &) {
+            return FLT_MAX;
+        }
+
+        float maxError = 0;
+        for (int q : m_check) {
+            float err = interpolateError(q);
+            if (err == FLT_MAX) {
+                return FLT_MAX;
+            }
+            maxError = std::max(maxError, err);
+        }
+        return maxError;
+    }
+
+    /**
+     * 在环上的三角形中找到包含 q 的一个，用 src 上的重心坐标插值 dst
+     */
+    float interpolateError(int q) const {
+        const double x = m_src[q * 2], y = m_src[q * 2 + 1];
+        const auto &tris = m_ring_mesh.triangles;
+        for (size_t t = 0, size = tris.size(); t < size; t += 3) {
+            int a = m_ring[tris[t]], b = m_ring[tris[t + 1]], c = m_ring[tris[t + 2]];
+            double ax = m_src[a * 2], ay = m_src[a * 2 + 1];
+            double bx = m_src[b * 2], by = m_src[b * 2 + 1];
+            double cx = m_src[c * 2], cy = m_src[c * 2 + 1];
+            double area = (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+            if (std::fabs(area) < 1e-12) {
+                continue;
+            }
+            double wb = ((x - ax) * (cy - ay) - (y - ay) * (cx - ax)) / area;
+            double wc = ((bx - ax) * (y - ay) - (by - ay) * (x - ax)) / area;
+            double wa = 1 - wb - wc;
+            const double eps = -1e-6;
+            if (wa < eps || wb < eps || wc < eps) {
+                continue;
+            }
+            double px = wa * m_dst[a * 2] + wb * m_dst[b * 2] + wc * m_dst[c * 2];
+            double py = wa * m_dst[a * 2 + 1] + wb * m_dst[b * 2 + 1] + wc * m_dst[c * 2 + 1];
+            return (float) std::hypot(px - m_dst[q * 2], py - m_dst[q * 2 + 1]);
+        }
+        return FLT_MAX;
+    }
+
+private:
+    int m_count = 0;
+    int m_hull_count = 0;
+    std::vector<float> m_src;
+    std::vector<float> m_dst;
+    // 去点的顺序和每一步之后的最大误差
+    std::vector<int> m_order;
+    std::vector<float> m_errors;
+
+    // build 过程中的临时数据
+    std::vector<int> m_kept;
+    std::vector<float> m_kept_src;
+    delaunator::BasicDelaunator<float> m_mesh;
+    delaunator::TriangleLocator m_locator;
+    std::vector<int> m_tri_start;
+    std::vector<int> m_tri_points;
+    std::vector<int> m_star_start;
+    std::vector<int> m_star;
+    std::vector<int> m_ring;
+    std::vector<float> m_ring_src;
+    std::vector<int> m_check;
+    delaunator::BasicDelaunator<float> m_ring_mesh;
+};
@@ -0,0 +1,605 @@
+//
+// Created by LiangKeJin on 2024/8/11.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MORPH_KERNEL_SIMD "avx2"
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#define MORPH_KERNEL_SIMD "sse4.1"
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define MORPH_KERNEL_SIMD "neon"
+#endif
+
+// CMake 的 MORPH_SIMD 不为 none 时定义，编译参数没有生效时直接报错，而不是悄悄退回标量
+#if defined(MORPH_SIMD_REQUIRED) && !defined(MORPH_KERNEL_SIMD)
+#error "MORPH_SIMD is enabled, but the compiler targets neither AVX2, SSE4.1 nor arm64 NEON"
+#endif
+
+/**
+ * 2x3 仿射: sx = a * x + b * y + c, sy = d * x + e * y + f
+ */
+struct MorphAffine {
+    float a = 1, b = 0, c = 0;
+    float d = 0, e = 1, f = 0;
+
+    /**
+     * 计算把三角形 p 映射到三角形 q 的仿射，p, q 为三个顶点交错的 x, y
+     * 退化的三角形不会覆盖任何像素，返回单位变换
+     */
+    static MorphAffine fromTriangles(const float *p, const float *q) {
+        double m[6];
+        MorphAffine affine;
+        if (solve(p, q, m)) {
+            affine.a = (float) m[0];
+            affine.b = (float) m[1];
+            affine.c = (float) m[2];
+            affine.d = (float) m[3];
+            affine.e = (float) m[4];
+            affine.f = (float) m[5];
+        }
+        return affine;
+    }
+
+    /**
+     * 和 cv::getAffineTransform(p, q) 相同的 2x3 矩阵，按行存放，不分配内存
+     * 三角形退化时返回 false，m 为单位变换
+     */
+    static bool solve(const float *p, const float *q, double m[6]) {
+        double e1x = p[2] - p[0], e1y = p[3] - p[1];
+        double e2x = p[4] - p[0], e2y = p[5] - p[1];
+        double det = e1x * e2y - e1y * e2x;
+        if (std::fabs(det) < 1e-12) {
+            m[0] = 1, m[1] = 0, m[2] = 0;
+            m[3] = 0, m[4] = 1, m[5] = 0;
+            return false;
+        }
+        // 重心坐标 u, v 关于 x, y 的偏导
+        double inv = 1.0 / det;
+        double ux = e2y * inv, uy = -e2x * inv;
+        double vx = -e1y * inv, vy = e1x * inv;
+
+        double f1x = q[2] - q[0], f1y = q[3] - q[1];
+        double f2x = q[4] - q[0], f2y = q[5] - q[1];
+        m[0] = f1x * ux + f2x * vx;
+        m[1] = f1x * uy + f2x * vy;
+        m[2] = q[0] - m[0] * p[0] - m[1] * p[1];
+        m[3] = f1y * ux + f2y * vx;
+        m[4] = f1y * uy + f2y * vy;
+        m[5] = q[1] - m[3] * p[0] - m[4] * p[1];
+        return true;
+    }
+};
+
+/**
+ * 融合形变的逐像素 kernel: 在 src, dst 中分别双线性采样，然后直接写出混合结果
+ * 图像都是 8bit CN 通道，越界坐标按 BORDER_REPLICATE 处理
+ * 编译时按 __AVX2__ > __SSE4_1__ > NEON (arm64) > 标量 选择实现，CN 为 3, 4 时才走 SIMD
+ * x86 上需要 CMake 的 MORPH_SIMD 打开对应的指令集，arm64 默认就有 NEON
+ */
+class MorphKernel {
+public:
+    struct Image {
+        const uint8_t *data;
+        size_t step;
+    };
+
+    /**
+     * 编译进来的 SIMD 实现: avx2, sse4.1, neon，没有时为 scalar
+     */
+    static const char *simdName() {
+#ifdef MORPH_KERNEL_SIMD
+        return MORPH_KERNEL_SIMD;
+#else
+        return "scalar";
+#endif
+    }
+
+    /**
+     * 输出行的 [x0, x1) 区间，out 指向输出行首
+     * 输出 = src(sm(x, y)) * (1 - alpha) + dst(dm(x, y)) * alpha
+     */
+    template<int CN>
+    static void warpDissolve(const Image &src, const Image &dst, int width, int height,
+                             const MorphAffine &sm, const MorphAffine &dm, float alpha,
+                             int y, int x0, int x1, uint8_t *out) {
+        float fy = (float) y;
+        float sxRow = sm.b * fy + sm.c, syRow = sm.e * fy + sm.f;
+        float dxRow = dm.b * fy + dm.c, dyRow = dm.e * fy + dm.f;
+        // 4 字节读取 (x0 + 1) 的像素时不能越过行尾
+        float maxX = (float) (width - 2), maxY = (float) (height - 1);
+
+        for (int x = x0; x < x1; ++x) {
+            float fx = (float) x;
+            float sx = sm.a * fx + sxRow, sy = sm.d * fx + syRow;
+            float dx = dm.a * fx + dxRow, dy = dm.d * fx + dyRow;
+            uint8_t *pixel = out + x * CN;
+#ifdef MORPH_KERNEL_SIMD
+            if (CN >= 3 && sx >= 0 && sx < maxX && sy >= 0 && sy < maxY &&
+                dx >= 0 && dx < maxX && dy >= 0 && dy < maxY) {
+                blendSIMD<CN>(src, dst, sx, sy, dx, dy, alpha, pixel);
+                continue;
+            }
+#endif
+            float s[CN], d[CN];
+            sample<CN>(src, width, height, sx, sy, s);
+            sample<CN>(dst, width, height, dx, dy, d);
+            for (int c = 0; c < CN; ++c) {
+                pixel[c] = toByte(s[c] + alpha * (d[c] - s[c]));
+            }
+        }
+    }
+
+    /**
+     * 没有被网格覆盖的像素不做形变，直接交叉溶解
+     */
+    template<int CN>
+    static void dissolve(const Image &src, const Image &dst, float alpha, int y, int x0, int x1, uint8_t *out) {
+        const uint8_t *s = src.data + y * src.step;
+        const uint8_t *d = dst.data + y * dst.step;
+        for (int i = x0 * CN, end = x1 * CN; i < end; ++i) {
+            out[i] = toByte(s[i] + alpha * (float) (d[i] - s[i]));
+        }
+    }
+
+    /**
+     * 标量双线性采样
+     */
+    template<int CN>
+    static inline void sample(const Image &img, int width, int height, float x, float y, float *out) {
+        x = std::min(std::max(x, 0.f), (float) (width - 1));
+        y = std::min(std::max(y, 0.f), (float) (height - 1));
+        int x0 = (int) x, y0 = (int) y;
+        float fx = x - (float) x0, fy = y - (float) y0;
+        int x1 = std::min(x0 + 1, width - 1), y1 = std::min(y0 + 1, height - 1);
+
+        const uint8_t *r0 = img.data + y0 * img.step, *r1 = img.data + y1 * img.step;
+        const uint8_t *p00 = r0 + x0 * CN, *p01 = r0 + x1 * CN;
+        const uint8_t *p10 = r1 + x0 * CN, *p11 = r1 + x1 * CN;
+        for (int c = 0; c < CN; ++c) {
+            float top = p00[c] + fx * (float) (p01[c] - p00[c]);
+            float bot = p10[c] + fx * (float) (p11[c] - p10[c]);
+            out[c] = top + fy * (bot - top);
+        }
+    }
+
+    static inline uint8_t toByte(float v) {
+        int i = (int) std::lrintf(v);
+        return (uint8_t) std::min(std::max(i, 0), 255);
+    }
+
+    /**
+     * 定点版本的 warpDissolve: 坐标 Q15，双线性权重 Q15，中间结果 Q6，坐标以外全程 16 位整数运算
+     * 每次插值的舍入误差不超过 1/128，输出和浮点版本相差不超过 1；图像宽高不能超过 65535
+     * SIMD 每次处理 4 个像素，4 个像素的全部通道放在 u16 通道里一起插值和混合，
+     * 标量路径按相同的舍入计算，两者结果完全一致
+     */
+    template<int CN>
+    static void warpDissolveFixed(const Image &src, const Image &dst, int width, int height,
+                                  const MorphAffine &sm, const MorphAffine &dm, int alphaQ8,
+                                  int y, int x0, int x1, uint8_t *out) {
+        float fy = (float) y;
+        float sxRow = sm.b * fy + sm.c, syRow = sm.e * fy + sm.f;
+        float dxRow = dm.b * fy + dm.c, dyRow = dm.e * fy + dm.f;
+        float limitX = (float) (width - 1), limitY = (float) (height - 1);
+        int alpha = alphaQ15(alphaQ8);
+        int x = x0;
+#ifdef MORPH_KERNEL_SIMD
+        // 每个邻点读 4 字节，读取 (x0 + 1) 的像素时不能越过行尾
+        int maxX = (width - 2) << W_BITS, maxY = (height - 1) << W_BITS;
+        for (; CN >= 3 && x + 4 <= x1; x += 4) {
+            int sx[4], sy[4], dx[4], dy[4];
+            bool inside = true;
+            for (int i = 0; i < 4; ++i) {
+                float fx = (float) (x + i);
+                sx[i] = toFixed(sm.a * fx + sxRow, limitX), sy[i] = toFixed(sm.d * fx + syRow, limitY);
+                dx[i] = toFixed(dm.a * fx + dxRow, limitX), dy[i] = toFixed(dm.d * fx + dyRow, limitY);
+                inside = inside && sx[i] < maxX && sy[i] < maxY && dx[i] < maxX && dy[i] < maxY;
+            }
+            if (inside) {
+                blendQuadSIMD<CN>(src, dst, sx, sy, dx, dy, alpha, out + x * CN);
+                continue;
+            }
+            for (int i = 0; i < 4; ++i) {
+                blendFixedPixel<CN>(src, dst, width, height, sx[i], sy[i], dx[i], dy[i], alpha,
+                                    out + (x + i) * CN);
+            }
+        }
+#endif
+        for (; x < x1; ++x) {
+            float fx = (float) x;
+            blendFixedPixel<CN>(src, dst, width, height,
+                                toFixed(sm.a * fx + sxRow, limitX), toFixed(sm.d * fx + syRow, limitY),
+                                toFixed(dm.a * fx + dxRow, limitX), toFixed(dm.d * fx + dyRow, limitY),
+                                alpha, out + x * CN);
+        }
+    }
+
+    /**
+     * 整数交叉溶解 n 个字节: (s * (256 - a) + d * a + 128) >> 8
+     * 中间结果不超过 16 位，SIMD 按 u16 通道计算，一次处理 16 (SSE4.1, NEON) / 32 (AVX2) 个字节
+     */
+    static void dissolveFixed(const uint8_t *s, const uint8_t *d, uint8_t *o, int n, int alphaQ8) {
+        int i = 0;
+#if defined(__AVX2__)
+        __m256i wd = _mm256_set1_epi16((short) alphaQ8), ws = _mm256_set1_epi16((short) (A_ONE - alphaQ8));
+        __m256i half = _mm256_set1_epi16(128), zero = _mm256_setzero_si256();
+        for (; i + 32 <= n; i += 32) {
+            __m256i vs = _mm256_loadu_si256((const __m256i *) (s + i));
+            __m256i vd = _mm256_loadu_si256((const __m256i *) (d + i));
+            __m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(vs, zero), ws),
+                                          _mm256_mullo_epi16(_mm256_unpacklo_epi8(vd, zero), wd));
+            __m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(vs, zero), ws),
+                                          _mm256_mullo_epi16(_mm256_unpackhi_epi8(vd, zero), wd));
+            lo = _mm256_srli_epi16(_mm256_add_epi16(lo, half), 8);
+            hi = _mm256_srli_epi16(_mm256_add_epi16(hi, half), 8);
+            _mm256_storeu_si256((__m256i *) (o + i), _mm256_packus_epi16(lo, hi));
+        }
+#elif defined(__SSE4_1__)
+        __m128i wd = _mm_set1_epi16((short) alphaQ8), ws = _mm_set1_epi16((short) (A_ONE - alphaQ8));
+        __m128i half = _mm_set1_epi16(128), zero = _mm_setzero_si128();
+        for (; i + 16 <= n; i += 16) {
+            __m128i vs = _mm_loadu_si128((const __m128i *) (s + i));
+            __m128i vd = _mm_loadu_si128((const __m128i *) (d + i));
+            __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(vs, zero), ws),
+                                       _mm_mullo_epi16(_mm_unpacklo_epi8(vd, zero), wd));
+            __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(vs, zero), ws),
+                                       _mm_mullo_epi16(_mm_unpackhi_epi8(vd, zero), wd));
+            lo = _mm_srli_epi16(_mm_add_epi16(lo, half), 8);
+            hi = _mm_srli_epi16(_mm_add_epi16(hi, half), 8);
+            _mm_storeu_si128((__m128i *) (o + i), _mm_packus_epi16(lo, hi));
+        }
+#elif defined(MORPH_KERNEL_SIMD)
+        uint16x8_t wd = vdupq_n_u16((uint16_t) alphaQ8), ws = vdupq_n_u16((uint16_t) (A_ONE - alphaQ8));
+        for (; i + 16 <= n; i += 16) {
+            uint8x16_t vs = vld1q_u8(s + i), vd = vld1q_u8(d + i);
+            uint16x8_t lo = vmlaq_u16(vmulq_u16(vmovl_u8(vget_low_u8(vs)), ws), vmovl_u8(vget_low_u8(vd)), wd);
+            uint16x8_t hi = vmlaq_u16(vmulq_u16(vmovl_u8(vget_high_u8(vs)), ws), vmovl_u8(vget_high_u8(vd)), wd);
+            // vrshrn 即 (v + 128) >> 8
+            vst1q_u8(o + i, vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8)));
+        }
+#endif
+        for (; i < n; ++i) {
+            o[i] = (uint8_t) ((s[i] * (A_ONE - alphaQ8) + d[i] * alphaQ8 + 128) >> 8);
+        }
+    }
+
+    /**
+     * 定点插值 a + (b - a) * w，w 为 Q15 [0, 32767]
+     * 舍入和 SSSE3 的 mulhrs、NEON 的 vqrdmulh 相同: ((b - a) * w + 2^14) >> 15
+     */
+    static inline int lerpFixed(int a, int b, int w) {
+        return a + (((b - a) * w + (1 << 14)) >> 15);
+    }
+
+    /**
+     * 标量定点双线性采样，x, y 为 Q15 坐标，输出 Q6 (最大 255 << 6)，中间结果都在 16 位以内
+     */
+    template<int CN>
+    static inline void sampleFixed(const Image &img, int width, int height, int x, int y, int *out) {
+        int x0 = x >> W_BITS, y0 = y >> W_BITS;
+        int fx = x & (W_ONE - 1), fy = y & (W_ONE - 1);
+        int x1 = std::min(x0 + 1, width - 1), y1 = std::min(y0 + 1, height - 1);
+
+        const uint8_t *r0 = img.data + y0 * img.step, *r1 = img.data + y1 * img.step;
+        const uint8_t *p00 = r0 + x0 * CN, *p01 = r0 + x1 * CN;
+        const uint8_t *p10 = r1 + x0 * CN, *p11 = r1 + x1 * CN;
+        for (int c = 0; c < CN; ++c) {
+            int top = lerpFixed(p00[c] << 6, p01[c] << 6, fx);
+            int bot = lerpFixed(p10[c] << 6, p11[c] << 6, fx);
+            out[c] = lerpFixed(top, bot, fy);
+        }
+    }
+
+    /**
+     * Q6 的 s, d 按 Q15 的 alpha 混合，四舍五入到 8 位
+     */
+    static inline uint8_t blendFixed(int s, int d, int alphaQ15) {
+        return (uint8_t) ((lerpFixed(s, d, alphaQ15) + (1 << 5)) >> 6);
+    }
+
+    /**
+     * warpDissolveFixed 内部的 Q15 alpha，A_ONE 对应 32767，和 dissolveFixed 共用同一个 Q8 alpha
+     */
+    static inline int alphaQ15(int alphaQ8) {
+        return std::min(alphaQ8 << 7, W_ONE - 1);
+    }
+
+    static inline int alphaToFixed(float alpha) {
+        return std::min(std::max((int) std::lrintf(alpha * A_ONE), 0), A_ONE);
+    }
+
+    static constexpr int W_BITS = 15;
+    static constexpr int W_ONE = 1 << W_BITS;
+    static constexpr int A_ONE = 256;
+
+    /**
+     * 先在浮点下 clamp 到图像内 (BORDER_REPLICATE)，再转成 Q15
+     * clamp 之后非负，+0.5 截断即四舍五入，不用 lrintf: 没有 -fno-math-errno 时它是一次 libm 调用
+     */
+    static inline int toFixed(float v, float limit) {
+        return (int) (std::min(std::max(v, 0.f), limit) * (float) W_ONE + 0.5f);
+    }
+
+private:
+    template<int CN>
+    static inline void blendFixedPixel(const Image &src, const Image &dst, int width, int height,
+                                       int sx, int sy, int dx, int dy, int alphaQ15, uint8_t *pixel) {
+        int s[CN], d[CN];
+        sampleFixed<CN>(src, width, height, sx, sy, s);
+        sampleFixed<CN>(dst, width, height, dx, dy, d);
+        for (int c = 0; c < CN; ++c) {
+            pixel[c] = blendFixed(s[c], d[c], alphaQ15);
+        }
+    }
+
+#if defined(__AVX2__)
+    // 低 128 位是 src 的一个像素，高 128 位是 dst 的一个像素
+    static inline __m256 loadPair(const uint8_t *s, const uint8_t *d) {
+        int32_t si, di;
+        memcpy(&si, s, 4);
+        memcpy(&di, d, 4);
+        return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_set_epi32(0, 0, di, si)));
+    }
+
+    template<int CN>
+    static inline void blendSIMD(const Image &src, const Image &dst, float sx, float sy, float dx, float dy,
+                                 float alpha, uint8_t *pixel) {
+        int sx0 = (int) sx, sy0 = (int) sy, dx0 = (int) dx, dy0 = (int) dy;
+        float sfx = sx - (float) sx0, sfy = sy - (float) sy0;
+        float dfx = dx - (float) dx0, dfy = dy - (float) dy0;
+        const uint8_t *s0 = src.data + sy0 * src.step + sx0 * CN, *s1 = s0 + src.step;
+        const uint8_t *d0 = dst.data + dy0 * dst.step + dx0 * CN, *d1 = d0 + dst.step;
+
+        __m256 wx = _mm256_setr_ps(sfx, sfx, sfx, sfx, dfx, dfx, dfx, dfx);
+        __m256 wy = _mm256_setr_ps(sfy, sfy, sfy, sfy, dfy, dfy, dfy, dfy);
+        __m256 p00 = loadPair(s0, d0), p01 = loadPair(s0 + CN, d0 + CN);
+        __m256 p10 = loadPair(s1, d1), p11 = loadPair(s1 + CN, d1 + CN);
+        __m256 top = _mm256_add_ps(p00, _mm256_mul_ps(wx, _mm256_sub_ps(p01, p00)));
+        __m256 bot = _mm256_add_ps(p10, _mm256_mul_ps(wx, _mm256_sub_ps(p11, p10)));
+        __m256 v = _mm256_add_ps(top, _mm256_mul_ps(wy, _mm256_sub_ps(bot, top)));
+
+        __m128 vs = _mm256_castps256_ps128(v), vd = _mm256_extractf128_ps(v, 1);
+        __m128 o = _mm_add_ps(vs, _mm_mul_ps(_mm_set1_ps(alpha), _mm_sub_ps(vd, vs)));
+        storePixel<CN>(_mm_cvtps_epi32(o), pixel);
+    }
+#elif defined(__SSE4_1__)
+    static inline __m128 loadPixel(const uint8_t *p) {
+        int32_t i;
+        memcpy(&i, p, 4);
+        return _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(i)));
+    }
+
+    template<int CN>
+    static inline __m128 bilinear(const uint8_t *r0, size_t step, float fx, float fy) {
+        __m128 wx = _mm_set1_ps(fx), wy = _mm_set1_ps(fy);
+        __m128 p00 = loadPixel(r0), p01 = loadPixel(r0 + CN);
+        __m128 p10 = loadPixel(r0 + step), p11 = loadPixel(r0 + step + CN);
+        __m128 top = _mm_add_ps(p00, _mm_mul_ps(wx, _mm_sub_ps(p01, p00)));
+        __m128 bot = _mm_add_ps(p10, _mm_mul_ps(wx, _mm_sub_ps(p11, p10)));
+        return _mm_add_ps(top, _mm_mul_ps(wy, _mm_sub_ps(bot, top)));
+    }
+
+    template<int CN>
+    static inline void blendSIMD(const Image &src, const Image &dst, float sx, float sy, float dx, float dy,
+                                 float alpha, uint8_t *pixel) {
+        int sx0 = (int) sx, sy0 = (int) sy, dx0 = (int) dx, dy0 = (int) dy;
+        __m128 vs = bilinear<CN>(src.data + sy0 * src.step + sx0 * CN, src.step,
+                                 sx - (float) sx0, sy - (float) sy0);
+        __m128 vd = bilinear<CN>(dst.data + dy0 * dst.step + dx0 * CN, dst.step,
+                                 dx - (float) dx0, dy - (float) dy0);
+        __m128 o = _mm_add_ps(vs, _mm_mul_ps(_mm_set1_ps(alpha), _mm_sub_ps(vd, vs)));
+        storePixel<CN>(_mm_cvtps_epi32(o), pixel);
+    }
+#elif defined(MORPH_KERNEL_SIMD)
+    static inline uint32x4_t loadPixelU32(const uint8_t *p) {
+        uint32_t i;
+        memcpy(&i, p, 4);
+        return vmovl_u16(vget_low_u16(vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(i)))));
+    }
+
+    template<int CN>
+    static inline float32x4_t bilinear(const uint8_t *r0, size_t step, float fx, float fy) {
+        float32x4_t p00 = vcvtq_f32_u32(loadPixelU32(r0)), p01 = vcvtq_f32_u32(loadPixelU32(r0 + CN));
+        float32x4_t p10 = vcvtq_f32_u32(loadPixelU32(r0 + step));
+        float32x4_t p11 = vcvtq_f32_u32(loadPixelU32(r0 + step + CN));
+        float32x4_t top = vaddq_f32(p00, vmulq_n_f32(vsubq_f32(p01, p00), fx));
+        float32x4_t bot = vaddq_f32(p10, vmulq_n_f32(vsubq_f32(p11, p10), fx));
+        return vaddq_f32(top, vmulq_n_f32(vsubq_f32(bot, top), fy));
+    }
+
+    template<int CN>
+    static inline void blendSIMD(const Image &src, const Image &dst, float sx, float sy, float dx, float dy,
+                                 float alpha, uint8_t *pixel) {
+        int sx0 = (int) sx, sy0 = (int) sy, dx0 = (int) dx, dy0 = (int) dy;
+        float32x4_t vs = bilinear<CN>(src.data + sy0 * src.step + sx0 * CN, src.step,
+                                      sx - (float) sx0, sy - (float) sy0);
+        float32x4_t vd = bilinear<CN>(dst.data + dy0 * dst.step + dx0 * CN, dst.step,
+                                      dx - (float) dx0, dy - (float) dy0);
+        float32x4_t o = vaddq_f32(vs, vmulq_n_f32(vsubq_f32(vd, vs), alpha));
+        // 和 lrintf 一样就近舍入到偶数
+        storePixel<CN>(vcvtnq_s32_f32(o), pixel);
+    }
+
+    // a + (b - a) * w，和 lerpFixed 相同
+    static inline int16x8_t lerp16(int16x8_t a, int16x8_t b, int16x8_t w) {
+        return vaddq_s16(a, vqrdmulhq_s16(vsubq_s16(b, a), w));
+    }
+
+    static inline uint32_t load32(const uint8_t *p) {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        return v;
+    }
+
+    // 4 个像素的 4 个邻点，每个邻点 4 个字节，按像素顺序排列
+    template<int CN>
+    static inline void gatherQuad(const Image &img, const int *x, const int *y, uint8x16_t *p) {
+        const uint8_t *r[4];
+        for (int i = 0; i < 4; ++i) {
+            r[i] = img.data + (y[i] >> W_BITS) * img.step + (x[i] >> W_BITS) * CN;
+        }
+        const size_t offsets[4] = {0, CN, img.step, img.step + CN};
+        for (int k = 0; k < 4; ++k) {
+            uint32x4_t v = vdupq_n_u32(load32(r[0] + offsets[k]));
+            v = vsetq_lane_u32(load32(r[1] + offsets[k]), v, 1);
+            v = vsetq_lane_u32(load32(r[2] + offsets[k]), v, 2);
+            v = vsetq_lane_u32(load32(r[3] + offsets[k]), v, 3);
+            p[k] = vreinterpretq_u8_u32(v);
+        }
+    }
+
+    // 4 个像素的 Q15 分数部分，按通道重复 4 次: w[0] 为像素 0, 1，w[1] 为像素 2, 3
+    static inline void spreadWeights(const int *v, int16x8_t *w) {
+        const int mask = W_ONE - 1;
+        w[0] = vcombine_s16(vdup_n_s16((int16_t) (v[0] & mask)), vdup_n_s16((int16_t) (v[1] & mask)));
+        w[1] = vcombine_s16(vdup_n_s16((int16_t) (v[2] & mask)), vdup_n_s16((int16_t) (v[3] & mask)));
+    }
+
+    // 像素 half * 2, half * 2 + 1 的 8 个通道的定点双线性，输出 Q6
+    static inline int16x8_t bilinearPair(const uint8x16_t *p, int16x8_t wx, int16x8_t wy, int half) {
+        int16x8_t v[4];
+        for (int k = 0; k < 4; ++k) {
+            uint16x8_t wide = vmovl_u8(half ? vget_high_u8(p[k]) : vget_low_u8(p[k]));
+            v[k] = vshlq_n_s16(vreinterpretq_s16_u16(wide), 6);
+        }
+        return lerp16(lerp16(v[0], v[1], wx), lerp16(v[2], v[3], wx), wy);
+    }
+
+    template<int CN>
+    static inline void blendQuadSIMD(const Image &src, const Image &dst, const int *sx, const int *sy,
+                                     const int *dx, const int *dy, int alphaQ15, uint8_t *pixels) {
+        uint8x16_t sp[4], dp[4];
+        int16x8_t sfx[2], sfy[2], dfx[2], dfy[2];
+        gatherQuad<CN>(src, sx, sy, sp);
+        gatherQuad<CN>(dst, dx, dy, dp);
+        spreadWeights(sx, sfx);
+        spreadWeights(sy, sfy);
+        spreadWeights(dx, dfx);
+        spreadWeights(dy, dfy);
+        int16x8_t alpha = vdupq_n_s16((int16_t) alphaQ15);
+        uint8x8_t o[2];
+        for (int h = 0; h < 2; ++h) {
+            int16x8_t vs = bilinearPair(sp, sfx[h], sfy[h], h), vd = bilinearPair(dp, dfx[h], dfy[h], h);
+            // vrshr 即 (v + 32) >> 6
+            o[h] = vqmovun_s16(vrshrq_n_s16(lerp16(vs, vd, alpha), 6));
+        }
+        uint8x16_t v = vcombine_u8(o[0], o[1]);
+        if (CN == 4) {
+            vst1q_u8(pixels, v);
+            return;
+        }
+        // 去掉每个像素的第 4 个字节，只写 12 个字节
+        static const uint8_t PACK3[16] = {0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 0, 0, 0, 0};
+        v = vqtbl1q_u8(v, vld1q_u8(PACK3));
+        vst1_u8(pixels, vget_low_u8(v));
+        vst1q_lane_u32((uint32_t *) (pixels + 8), vreinterpretq_u32_u8(v), 2);
+    }
+
+    // 只写 CN 个字节，行尾像素不会碰到其他线程负责的下一行
+    template<int CN>
+    static inline void storePixel(int32x4_t v, uint8_t *pixel) {
+        uint16x4_t h = vqmovun_s32(v);
+        uint32_t packed = vget_lane_u32(vreinterpret_u32_u8(vqmovn_u16(vcombine_u16(h, h))), 0);
+        memcpy(pixel, &packed, CN);
+    }
+#endif
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+    // 只写 CN 个字节，行尾像素不会碰到其他线程负责的下一行
+    template<int CN>
+    static inline void storePixel(__m128i v, uint8_t *pixel) {
+        v = _mm_packus_epi32(v, v);
+        v = _mm_packus_epi16(v, v);
+        int32_t packed = _mm_cvtsi128_si32(v);
+        memcpy(pixel, &packed, CN);
+    }
+
+    static inline int32_t load32(const uint8_t *p) {
+        int32_t v;
+        memcpy(&v, p, 4);
+        return v;
+    }
+
+    // 4 个像素的 4 个邻点，每个邻点 4 个字节，按像素顺序排列
+    // 直接拼成寄存器，不先写到内存再整块读取，避免 store forwarding 失败
+    template<int CN>
+    static inline void gatherQuad(const Image &img, const int *x, const int *y, __m128i *p) {
+        const uint8_t *r[4];
+        for (int i = 0; i < 4; ++i) {
+            r[i] = img.data + (y[i] >> W_BITS) * img.step + (x[i] >> W_BITS) * CN;
+        }
+        const size_t offsets[4] = {0, CN, img.step, img.step + CN};
+        for (int k = 0; k < 4; ++k) {
+            p[k] = _mm_setr_epi32(load32(r[0] + offsets[k]), load32(r[1] + offsets[k]),
+                                  load32(r[2] + offsets[k]), load32(r[3] + offsets[k]));
+        }
+    }
+
+    // 4 个像素的 Q15 分数部分，按通道重复 4 次: lo 为像素 0, 1，hi 为像素 2, 3
+    static inline void spreadWeights(const int *v, __m128i &lo, __m128i &hi) {
+        __m128i w = _mm_and_si128(_mm_setr_epi32(v[0], v[1], v[2], v[3]), _mm_set1_epi32(W_ONE - 1));
+        w = _mm_packs_epi32(w, w);
+        w = _mm_unpacklo_epi16(w, w);
+        lo = _mm_unpacklo_epi32(w, w);
+        hi = _mm_unpackhi_epi32(w, w);
+    }
+
+    // 4 个像素依次排列的 16 字节，CN 为 3 时去掉每个像素的第 4 个字节，只写 12 个字节
+    template<int CN>
+    static inline void storeQuad(__m128i v, uint8_t *pixels) {
+        if (CN == 4) {
+            _mm_storeu_si128((__m128i *) pixels, v);
+            return;
+        }
+        v = _mm_shuffle_epi8(v, _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1));
+        _mm_storel_epi64((__m128i *) pixels, v);
+        int32_t tail = _mm_extract_epi32(v, 2);
+        memcpy(pixels + 8, &tail, 4);
+    }
+
+    // a + (b - a) * w，和 lerpFixed 相同
+    // AVX2 下同样用 128 位: 一个寄存器正好是 2 个像素的 u16 通道，256 位需要跨 lane 展开，实测更慢
+    static inline __m128i lerp16(__m128i a, __m128i b, __m128i w) {
+        return _mm_add_epi16(a, _mm_mulhrs_epi16(_mm_sub_epi16(b, a), w));
+    }
+
+    // 像素 half * 2, half * 2 + 1 的 8 个通道的定点双线性，输出 Q6
+    static inline __m128i bilinearPair(const __m128i *p, __m128i wx, __m128i wy, int half) {
+        __m128i v[4];
+        for (int k = 0; k < 4; ++k) {
+            v[k] = half ? _mm_unpackhi_epi8(p[k], _mm_setzero_si128()) : _mm_cvtepu8_epi16(p[k]);
+            v[k] = _mm_slli_epi16(v[k], 6);
+        }
+        return lerp16(lerp16(v[0], v[1], wx), lerp16(v[2], v[3], wx), wy);
+    }
+
+    template<int CN>
+    static inline void blendQuadSIMD(const Image &src, const Image &dst, const int *sx, const int *sy,
+                                     const int *dx, const int *dy, int alphaQ15, uint8_t *pixels) {
+        __m128i sp[4], dp[4], sfx[2], sfy[2], dfx[2], dfy[2];
+        gatherQuad<CN>(src, sx, sy, sp);
+        gatherQuad<CN>(dst, dx, dy, dp);
+        spreadWeights(sx, sfx[0], sfx[1]);
+        spreadWeights(sy, sfy[0], sfy[1]);
+        spreadWeights(dx, dfx[0], dfx[1]);
+        spreadWeights(dy, dfy[0], dfy[1]);
+        __m128i alpha = _mm_set1_epi16((short) alphaQ15), half = _mm_set1_epi16(1 << 5);
+        __m128i o[2];
+        for (int h = 0; h < 2; ++h) {
+            __m128i vs = bilinearPair(sp, sfx[h], sfy[h], h), vd = bilinearPair(dp, dfx[h], dfy[h], h);
+            o[h] = _mm_srai_epi16(_mm_add_epi16(lerp16(vs, vd, alpha), half), 6);
+        }
+        storeQuad<CN>(_mm_packus_epi16(o[0], o[1]), pixels);
+    }
+#endif
+};
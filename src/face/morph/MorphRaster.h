@@ -0,0 +1,121 @@
+//
+// Created by LiangKeJin on 2024/8/11.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+/**
+ * 一行内属于同一个三角形的像素区间 [x0, x1)
+ */
+struct MorphSpan {
+    int x0;
+    int x1;
+    int tri;
+};
+
+/**
+ * 把三角形网格光栅化成每行的 span 列表
+ * 像素中心取整数坐标，使用 top-left 规则: 行 y 满足 ceil(top) <= y < ceil(bottom)，
+ * 列 x 满足 ceil(left) <= x < ceil(right)。共享边两侧用同样的端点顺序求交，
+ * 所以相邻三角形的 span 正好拼接，每个像素最多属于一个三角形
+ */
+class MorphRaster {
+public:
+    /**
+     * @param points 交错存放的 x, y 顶点坐标
+     * @param triangles 每 3 个为一个三角形的顶点索引
+     */
+    void rasterize(int width, int height, const float *points, const size_t *triangles, int triSize) {
+        m_width = width;
+        m_height = height;
+        if ((int) m_rows.size() < height) {
+            m_rows.resize(height);
+        }
+        for (int y = 0; y < height; ++y) {
+            m_rows[y].clear();
+        }
+
+        for (int t = 0; t < triSize; ++t) {
+            addTriangle(t, points + triangles[t * 3] * 2,
+                        points + triangles[t * 3 + 1] * 2,
+                        points + triangles[t * 3 + 2] * 2);
+        }
+
+        for (int y = 0; y < height; ++y) {
+            std::vector<MorphSpan> &row = m_rows[y];
+            if (row.size() > 1) {
+                std::sort(row.begin(), row.end(), [](const MorphSpan &l, const MorphSpan &r) {
+                    return l.x0 < r.x0;
+                });
+            }
+        }
+    }
+
+    inline int width() const {
+        return m_width;
+    }
+
+    inline int height() const {
+        return m_height;
+    }
+
+    /**
+     * 第 y 行的 span，按 x0 递增排列
+     */
+    inline const std::vector<MorphSpan> &row(int y) const {
+        return m_rows[y];
+    }
+
+    /**
+     * 导出成紧凑的一维 span 列表，第 y 行为 spans[rowStart[y], rowStart[y + 1])
+     */
+    void flatten(std::vector<MorphSpan> &spans, std::vector<int> &rowStart) const {
+        spans.clear();
+        rowStart.resize(m_height + 1);
+        for (int y = 0; y < m_height; ++y) {
+            rowStart[y] = (int) spans.size();
+            spans.insert(spans.end(), m_rows[y].begin(), m_rows[y].end());
+        }
+        rowStart[m_height] = (int) spans.size();
+    }
+
+private:
+    void addTriangle(int t, const float *a, const float *b, const float *c) {
+        // 按 (y, x) 排序，保证共享边在两个三角形中端点顺序一致
+        const float *v[3] = {a, b, c};
+        std::sort(v, v + 3, [](const float *p, const float *q) {
+            return p[1] < q[1] || (p[1] == q[1] && p[0] < q[0]);
+        });
+
+        double mid = v[1][1];
+        int yStart = std::max(0, (int) std::ceil(v[0][1]));
+        int yEnd = std::min(m_height, (int) std::ceil(v[2][1]));
+        for (int y = yStart; y < yEnd; ++y) {
+            double xl = edgeX(v[0], v[2], y);
+            double xr = y < mid ? edgeX(v[0], v[1], y) : edgeX(v[1], v[2], y);
+            if (xr < xl) {
+                std::swap(xl, xr);
+            }
+            int x0 = std::max(0, (int) std::ceil(xl));
+            int x1 = std::min(m_width, (int) std::ceil(xr));
+            if (x0 < x1) {
+                m_rows[y].push_back({x0, x1, t});
+            }
+        }
+    }
+
+    // p 在 q 的上方，且 p.y < y < q.y 时才会被调用
+    static inline double edgeX(const float *p, const float *q, double y) {
+        return p[0] + (y - p[1]) * ((double) q[0] - p[0]) / ((double) q[1] - p[1]);
+    }
+
+private:
+    int m_width = 0;
+    int m_height = 0;
+    std::vector<std::vector<MorphSpan>> m_rows;
+};
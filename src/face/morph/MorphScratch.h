@@ -0,0 +1,125 @@
+//
+// Created by LiangKeJin on 2024/8/12.
+//
+
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * 形变过程中临时 Mat 的内存池
+ * take() 在连续内存上切出 Mat 头，reset() 之后全部作废，下一轮重复使用同一块内存
+ * 当前块不够时临时追加新块，reset 时合并成一块足够大的，所以稳定之后不会再分配
+ */
+class MorphScratch {
+public:
+    cv::Mat take(int rows, int cols, int type) {
+        size_t step = align((size_t) cols * CV_ELEM_SIZE(type));
+        size_t bytes = std::max<size_t>(step * rows, ALIGN);
+        if (m_blocks.empty() || m_used + bytes > m_blocks.back().size) {
+            addBlock(std::max(bytes, m_blocks.empty() ? bytes : m_blocks.back().size));
+        }
+        uint8_t *data = m_blocks.back().data + m_used;
+        m_used += bytes;
+        m_total_used += bytes;
+        return cv::Mat(rows, cols, type, data, step);
+    }
+
+    /**
+     * 之前 take 的 Mat 全部失效
+     */
+    void reset() {
+        if (m_blocks.size() > 1) {
+            size_t size = m_total_used + m_total_used / 4;
+            m_blocks.clear();
+            addBlock(size);
+        }
+        m_used = 0;
+        m_total_used = 0;
+    }
+
+    /**
+     * 内存块的分配次数
+     */
+    inline long allocations() const {
+        return m_allocations;
+    }
+
+private:
+    static constexpr size_t ALIGN = 64;
+
+    static inline size_t align(size_t v) {
+        return (v + ALIGN - 1) & ~(ALIGN - 1);
+    }
+
+    struct Block {
+        std::unique_ptr<uint8_t[]> buffer;
+        uint8_t *data;
+        size_t size;
+    };
+
+    void addBlock(size_t size) {
+        Block block;
+        block.buffer.reset(new uint8_t[size + ALIGN]);
+        block.data = (uint8_t *) align((size_t) block.buffer.get());
+        block.size = size;
+        m_blocks.push_back(std::move(block));
+        m_used = 0;
+        m_allocations += 1;
+    }
+
+private:
+    std::vector<Block> m_blocks;
+    size_t m_used = 0;
+    size_t m_total_used = 0;
+    long m_allocations = 0;
+};
+
+/**
+ * 输出帧池: 只有池自己持有引用 (refcount == 1) 的帧才会被复用
+ * 调用方拿着帧的时候不会被覆盖，释放之后下一次 obtain 就能复用
+ */
+class MorphFramePool {
+public:
+    explicit MorphFramePool(int maxFrames = 4) : m_max_frames(maxFrames) {
+        m_frames.reserve(maxFrames);
+    }
+
+    cv::Mat obtain(int rows, int cols, int type) {
+        for (cv::Mat &frame : m_frames) {
+            if (frame.u && frame.u->refcount == 1 &&
+                frame.rows == rows && frame.cols == cols && frame.type() == type) {
+                return frame;
+            }
+        }
+        m_allocations += 1;
+        for (cv::Mat &frame : m_frames) {
+            if (frame.u && frame.u->refcount == 1) {
+                frame.create(rows, cols, type);
+                return frame;
+            }
+        }
+        if ((int) m_frames.size() < m_max_frames) {
+            m_frames.emplace_back(rows, cols, type);
+            return m_frames.back();
+        }
+        // 调用方持有的帧超过了池的大小，退化成普通分配，用完直接释放
+        return cv::Mat(rows, cols, type);
+    }
+
+    void clear() {
+        m_frames.clear();
+    }
+
+    inline long allocations() const {
+        return m_allocations;
+    }
+
+private:
+    const int m_max_frames;
+    std::vector<cv::Mat> m_frames;
+    long m_allocations = 0;
+};
@@ -0,0 +1,297 @@
+//
+// Created by LiangKeJin on 2024/8/12.
+//
+
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <condition_variable>
+#include <cstdio>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include "utils/ThreadPool.h"
+#include "utils/TimeUtils.h"
+#include "FaceMorph.h"
+
+/**
+ * 序列帧的输出端，write 按帧序号递增的顺序在同一个线程里调用
+ * write 可以阻塞，阻塞期间渲染线程最多只会提前渲染 maxInFlight 帧
+ */
+class FrameSink {
+public:
+    virtual ~FrameSink() = default;
+
+    virtual void open(int width, int height, int type, int sumFrames) {}
+
+    virtual void write(int index, const cv::Mat &frame) = 0;
+
+    /**
+     * 等待所有数据写完
+     */
+    virtual void close() {}
+};
+
+/**
+ * 把每一帧编码成图片文件，编码在自己的线程池中并行，最多积压 maxPending 帧
+ * @param pattern 带一个 %d 的文件路径，比如 "output/frame_0-%d.jpg"，后缀决定编码格式
+ */
+class ImageFileSink : public FrameSink {
+public:
+    explicit ImageFileSink(std::string pattern, int threads = 2, int maxPending = 4,
+                           std::vector<int> params = std::vector<int>())
+            : m_pattern(std::move(pattern)), m_params(std::move(params)),
+              m_max_pending(std::max(1, maxPending)), m_pool(threads, "image_file_sink") {}
+
+    ~ImageFileSink() override {
+        close();
+    }
+
+    void write(int index, const cv::Mat &frame) override {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock, [this]() { return m_pending < m_max_pending; });
+        m_pending += 1;
+        lock.unlock();
+
+        // frame 只在编码线程里读，引用计数保证渲染端不会复用这块内存
+        cv::Mat mat = frame;
+        m_pool.post([this, index, mat]() {
+            char path[512] = {0};
+            snprintf(path, sizeof(path), m_pattern.c_str(), index);
+            if (!cv::imwrite(path, mat, m_params)) {
+                printf("ImageFileSink: write %s failed\n", path);
+            }
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_pending -= 1;
+            m_cond.notify_all();
+        });
+    }
+
+    void close() override {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock, [this]() { return m_pending == 0; });
+    }
+
+private:
+    std::string m_pattern;
+    std::vector<int> m_params;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    int m_pending = 0;
+    const int m_max_pending;
+
+    // 放在最后，析构时先 join 编码线程
+    wuta::ThreadPool m_pool;
+};
+
+/**
+ * 原始视频流输出，可以是文件，也可以是 popen 得到的 ffmpeg 管道
+ * Y4M 模式输出 YUV4MPEG2 (C420jpeg)，RAW 模式输出无头的 rgb24
+ */
+class RawVideoSink : public FrameSink {
+public:
+    enum Format {
+        Y4M = 0,
+        RGB24 = 1,
+    };
+
+    /**
+     * @param path 输出文件，"-" 为 stdout
+     */
+    RawVideoSink(const std::string &path, Format format, int fps = 30) : m_format(format), m_fps(fps) {
+        if (path == "-") {
+            m_file = stdout;
+        } else {
+            m_file = fopen(path.c_str(), "wb");
+            m_own_file = true;
+        }
+        if (m_file == nullptr) {
+            throw std::runtime_error("RawVideoSink: open " + path + " failed");
+        }
+    }
+
+    /**
+     * 写到外部打开的 FILE，比如 popen("ffmpeg -f yuv4mpegpipe -i - out.mp4", "w")，不负责关闭
+     */
+    RawVideoSink(FILE *file, Format format, int fps = 30) : m_file(file), m_format(format), m_fps(fps) {}
+
+    ~RawVideoSink() override {
+        close();
+    }
+
+    void open(int width, int height, int type, int sumFrames) override {
+        if (type != CV_8UC3) {
+            throw std::runtime_error("RawVideoSink: only support CV_8UC3 frames");
+        }
+        if (m_format == Y4M) {
+            if (width % 2 != 0 || height % 2 != 0) {
+                throw std::runtime_error("RawVideoSink: y4m 4:2:0 needs even width and height");
+            }
+            fprintf(m_file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, m_fps);
+        }
+    }
+
+    void write(int index, const cv::Mat &frame) override {
+        if (m_format == Y4M) {
+            cv::cvtColor(frame, m_buffer, cv::COLOR_BGR2YUV_I420);
+            fputs("FRAME\n", m_file);
+        } else {
+            cv::cvtColor(frame, m_buffer, cv::COLOR_BGR2RGB);
+        }
+        for (int y = 0; y < m_buffer.rows; ++y) {
+            fwrite(m_buffer.ptr<uint8_t>(y), 1, m_buffer.cols * m_buffer.elemSize(), m_file);
+        }
+    }
+
+    void close() override {
+        if (m_file == nullptr) {
+            return;
+        }
+        fflush(m_file);
+        if (m_own_file) {
+            fclose(m_file);
+        }
+        m_file = nullptr;
+    }
+
+private:
+    FILE *m_file = nullptr;
+    bool m_own_file = false;
+    const Format m_format;
+    const int m_fps;
+
+    cv::Mat m_buffer;
+};
+
+/**
+ * cv::VideoWriter 输出
+ */
+class VideoWriterSink : public FrameSink {
+public:
+    VideoWriterSink(std::string path, int fourcc, double fps) : m_path(std::move(path)), m_fourcc(fourcc), m_fps(fps) {}
+
+    ~VideoWriterSink() override {
+        close();
+    }
+
+    void open(int width, int height, int type, int sumFrames) override {
+        if (!m_writer.open(m_path, m_fourcc, m_fps, cv::Size(width, height), CV_MAT_CN(type) != 1)) {
+            throw std::runtime_error("VideoWriterSink: open " + m_path + " failed");
+        }
+    }
+
+    void write(int index, const cv::Mat &frame) override {
+        m_writer.write(frame);
+    }
+
+    void close() override {
+        if (m_writer.isOpened()) {
+            m_writer.release();
+        }
+    }
+
+private:
+    std::string m_path;
+    int m_fourcc;
+    double m_fps;
+
+    cv::VideoWriter m_writer;
+};
+
+/**
+ * 并行渲染整段序列，按帧序号重排之后依次交给 sink
+ * 渲染在线程池中进行，sink 在调用线程中执行，二者重叠，吞吐是 min(render, encode)
+ * 已渲染但还没写出的帧最多 maxInFlight 帧，sink 慢时渲染线程会停下来等待
+ */
+class MorphSequenceRenderer {
+public:
+    /**
+     * @param threads 渲染线程数，<= 0 使用全部 CPU 核心
+     * @param maxInFlight 同时在渲染或等待写出的最大帧数
+     */
+    explicit MorphSequenceRenderer(const FaceMorph &morph, int threads = 0, int maxInFlight = 0)
+            : m_morph(morph), m_pool(threads, "morph_sequence") {
+        m_max_in_flight = maxInFlight > 0 ? maxInFlight : m_pool.size() * 2;
+    }
+
+    /**
+     * @param level 金字塔层，预览时用小图渲染整段序列，需要保留的帧再用 level 0 单独渲染
+     */
+    void render(int sumFrames, FrameSink &sink, int level = 0) {
+        if (m_morph.levels() == 0) {
+            throw std::runtime_error("MorphSequenceRenderer: render needs FaceMorph::setup");
+        }
+        long startMs = TimeUtils::nowMs();
+        level = std::min(std::max(level, 0), m_morph.levels() - 1);
+        sink.open(m_morph.width(level), m_morph.height(level), m_morph.type(), sumFrames);
+
+        std::map<int, cv::Mat> ready;
+        std::exception_ptr error;
+        int submitted = 0, written = 0, running = 0;
+        std::mutex mutex;
+        std::condition_variable cond;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        while (written < sumFrames && !error) {
+            while (submitted < sumFrames && submitted - written < m_max_in_flight) {
+                int index = submitted++;
+                running += 1;
+                m_pool.post([&, index]() {
+                    cv::Mat frame;
+                    std::exception_ptr e;
+                    try {
+                        frame = m_morph.renderFrame(index, sumFrames, level);
+                    } catch (...) {
+                        e = std::current_exception();
+                    }
+                    std::lock_guard<std::mutex> guard(mutex);
+                    if (e) {
+                        if (!error) {
+                            error = e;
+                        }
+                    } else {
+                        ready[index] = frame;
+                    }
+                    running -= 1;
+                    cond.notify_all();
+                });
+            }
+
+            cond.wait(lock, [&]() { return error || ready.count(written) > 0; });
+            if (error) {
+                break;
+            }
+            cv::Mat frame = std::move(ready[written]);
+            ready.erase(written);
+            lock.unlock();
+            try {
+                sink.write(written, frame);
+            } catch (...) {
+                lock.lock();
+                error = std::current_exception();
+                break;
+            }
+            lock.lock();
+            written += 1;
+        }
+        // 渲染任务引用了这里的局部变量，必须等它们全部结束
+        cond.wait(lock, [&]() { return running == 0; });
+        lock.unlock();
+
+        sink.close();
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        if (m_morph.config().verbose) {
+            printf("render sequence(%d frames) cost: %ld ms\n", sumFrames, TimeUtils::nowMs() - startMs);
+        }
+    }
+
+private:
+    const FaceMorph &m_morph;
+    int m_max_in_flight;
+    wuta::ThreadPool m_pool;
+};
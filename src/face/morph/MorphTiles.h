@@ -0,0 +1,129 @@
+//
+// Created by LiangKeJin on 2024/8/10.
+//
+
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+/**
+ * 单个三角形的仿射结果，坐标和 MorphImage::morphTriangle 串行路径完全一致
+ */
+struct MorphTriangle {
+    // 为 false 时三角形几乎不动，不参与仿射和混合
+    bool active = true;
+
+    // 原图和目标图的外接矩形
+    cv::Rect srcRect;
+    cv::Rect dstRect;
+    // 以外接矩形为原点的三角形顶点
+    std::vector<cv::Point2f> srcCrop;
+    std::vector<cv::Point2f> dstCrop;
+
+    // dstRect 大小的 CV_32FC1 mask 和 1 - mask，定点模式下 mask 为 CV_8UC1，没有 invMask
+    cv::Mat mask;
+    cv::Mat invMask;
+    // srcRect 仿射到 dstRect 的结果
+    cv::Mat warped;
+
+    /**
+     * 把 warped 按 mask 混合到 roi，mask 只有 0 和 1，两种 mask 的结果完全一致
+     */
+    static void blendTo(cv::Mat &roi, const cv::Mat &warped, const cv::Mat &mask, const cv::Mat &invMask) {
+        if (mask.type() == CV_8UC1) {
+            warped.copyTo(roi, mask);
+        } else {
+            cv::blendLinear(roi, warped, invMask, mask, roi);
+        }
+    }
+};
+
+/**
+ * 把输出图切成 cache 大小的 tile，并记录每个 tile 覆盖到的三角形
+ * 每个 tile 内按三角形原始顺序混合，共享边上的像素和串行路径一样由后面的三角形覆盖，
+ * 不同 tile 之间没有重叠的写区域，所以可以并行
+ */
+class MorphTileGrid {
+public:
+    void setup(int width, int height, int tileSize) {
+        tileSize = std::max(16, tileSize);
+        if (width == m_width && height == m_height && tileSize == m_tile_size) {
+            return;
+        }
+        m_width = width;
+        m_height = height;
+        m_tile_size = tileSize;
+        m_cols = (width + tileSize - 1) / tileSize;
+        m_rows = (height + tileSize - 1) / tileSize;
+
+        m_tile_rects.clear();
+        for (int r = 0; r < m_rows; ++r) {
+            for (int c = 0; c < m_cols; ++c) {
+                int x = c * tileSize, y = r * tileSize;
+                m_tile_rects.emplace_back(x, y, std::min(tileSize, width - x), std::min(tileSize, height - y));
+            }
+        }
+        m_tile_tris.resize(m_tile_rects.size());
+    }
+
+    /**
+     * 按 dstRect 把三角形分到覆盖的 tile 中，保持三角形原始顺序
+     */
+    void bin(const std::vector<MorphTriangle> &tris) {
+        for (auto &list : m_tile_tris) {
+            list.clear();
+        }
+        cv::Rect bounds(0, 0, m_width, m_height);
+        for (int i = 0, size = (int) tris.size(); i < size; ++i) {
+            cv::Rect r = tris[i].dstRect & bounds;
+            if (!tris[i].active || r.empty()) {
+                continue;
+            }
+            int c0 = r.x / m_tile_size, c1 = (r.x + r.width - 1) / m_tile_size;
+            int r0 = r.y / m_tile_size, r1 = (r.y + r.height - 1) / m_tile_size;
+            for (int tr = r0; tr <= r1; ++tr) {
+                for (int tc = c0; tc <= c1; ++tc) {
+                    m_tile_tris[tr * m_cols + tc].push_back(i);
+                }
+            }
+        }
+    }
+
+    inline int tileCount() const {
+        return (int) m_tile_rects.size();
+    }
+
+    inline const cv::Rect &tileRect(int tile) const {
+        return m_tile_rects[tile];
+    }
+
+    /**
+     * 把 tile 覆盖到的三角形依次混合到 outMat 上，只写 tile 内的像素
+     */
+    void compose(int tile, const std::vector<MorphTriangle> &tris, cv::Mat &outMat) const {
+        const cv::Rect &tileRect = m_tile_rects[tile];
+        for (int ti : m_tile_tris[tile]) {
+            const MorphTriangle &tri = tris[ti];
+            cv::Rect clip = tri.dstRect & tileRect;
+            if (clip.empty()) {
+                continue;
+            }
+            cv::Rect local(clip.x - tri.dstRect.x, clip.y - tri.dstRect.y, clip.width, clip.height);
+            cv::Mat roi = outMat(clip);
+            // mask 只有 0 和 1，逐像素混合的结果和整块混合完全一致
+            MorphTriangle::blendTo(roi, tri.warped(local), tri.mask(local),
+                                   tri.invMask.empty() ? tri.invMask : tri.invMask(local));
+        }
+    }
+
+private:
+    int m_width = 0;
+    int m_height = 0;
+    int m_tile_size = 0;
+    int m_cols = 0;
+    int m_rows = 0;
+
+    std::vector<cv::Rect> m_tile_rects;
+    std::vector<std::vector<int>> m_tile_tris;
+};
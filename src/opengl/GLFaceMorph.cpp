@@ -4,87 +4,117 @@
 
 #include <opencv2/opencv.hpp>
 #include "GLFaceMorph.h"
-#include "face/detect/InspireFaceDetector.h"
+#include "face/detect/AsyncFaceDetector.h"
+#include "face/detect/InspireLandmarkProvider.h"
+#include "face/detect/LandmarkCache.h"
+#include "face/detect/ReplayLandmarkProvider.h"
 #include "wrap/filter/TextureFilter.h"
 
 NAMESPACE_WUTA
 
 static bool init_flag = false;
 static GLFaceMorph faceMorph;
+// 不为空时回放录制的关键点（第 0 帧 src，第 1 帧 dst），不加载 InspireFace
+static const char *LANDMARK_REPLAY_FILE = nullptr;
+// 按图像内容缓存检测结果，命中时不加载模型，为空时关闭
+static const char *LANDMARK_CACHE_FILE = "landmarks.cache";
+
+// 检测在 AsyncFaceDetector 的线程上进行，渲染线程每帧只查看结果，检测完成之前不绘制
+static std::unique_ptr<AsyncFaceDetector> faceDetector;
+static cv::Mat srcImg, dstImg;
+static uint64_t srcSeq = 0, dstSeq = 0;
+static bool srcReady = false, dstReady = false;
+
+static LandmarkView facePoints(const AsyncDetectResult &r) {
+    const LandmarkFace *f = r.result.face(0);
+    return f ? f->landmarks() : LandmarkView();
+}
 
-void initialize() {
-    DetectConfig detectConfig = {};
-    InspireFaceDetector faceDetector(detectConfig);
+static void dumpLandmarks(const cv::Mat &img, const AsyncDetectResult &r) {
+    const LandmarkFace *f = r.result.face(0);
+    if (!f) {
+        return;
+    }
+    cv::Mat cl;
+    float scale = 4960.f / img.cols;
+    cv::resize(img, cl, cv::Size(img.cols * scale, img.rows * scale));
+    cv::Rect rect(f->x() * scale, f->y() * scale, f->width() * scale, f->height() * scale);
+    cv::rectangle(cl, rect, cv::Scalar(255, 255, 0), 2);
 
-    std::string imageDir = std::string(ASSERTS_PATH) + "/images/raw";
-    {
-        std::string aImgPath = imageDir + "/49907.png";
-        cv::Mat src = cv::imread(aImgPath);
-
-        DetectResult &srcFP = faceDetector.detect(src.data, src.cols, src.rows,
-                                                  HF_CAMERA_ROTATION_270, HF_STREAM_BGR, true);
-        FaceData *f = srcFP.face(0);
-        std::vector<float> points;
-        if (f) {
-            for (int k = 0; k < f->numLandmarks(); ++k) {
-                points.push_back(f->landmarkX(k));
-                points.push_back(f->landmarkY(k));
-            }
-        }
+    // 55 105 22
+    for (int k = 0; k < f->numLandmarks(); ++k) {
+
+//        if (k != 55 && k != 105) {
+//            continue;
+//        }
+
+        cv::Point2f p(f->landmarkX(k), f->landmarkY(k));
+        printf("landmark（%d): %.2f, %.2f\n", k,  p.x, p.y);
+
+        cv::Point2f drawP = p * scale;
+        cv::circle(cl, drawP, 2, cv::Scalar(0, 0, 255), 2);
+        std::string index = std::to_string(k);
+        cv::putText(cl, index, drawP, cv::FONT_HERSHEY_SIMPLEX, 1, cv::Scalar(0, 255, 0));
 
-        faceMorph.setSrcImg(src.data, src.cols, src.rows, GL_BGR);
-        Landmark landmark(src.cols, src.rows, points);
-        faceMorph.setSrcKeyPoints(landmark, 55, 105, 22);
     }
+//    cv::imshow("11", cl);
+//    cv::waitKey(0);
+    cv::imwrite("a.jpg", cl);
+}
 
-    std::string bImgPath = imageDir + "/49915.png";
-    cv::Mat dst = cv::imread(bImgPath);
-    {
-        DetectResult &srcFP = faceDetector.detect(dst.data, dst.cols, dst.rows,
-                                                  HF_CAMERA_ROTATION_90, HF_STREAM_BGR, true);
-        FaceData *f = srcFP.face(0);
-        std::vector<float> points;
-        if (f) {
-            for (int k = 0; k < f->numLandmarks(); ++k) {
-                points.push_back(f->landmarkX(k));
-                points.push_back(f->landmarkY(k));
-            }
+void initialize() {
+    faceDetector = std::make_unique<AsyncFaceDetector>([]() -> std::unique_ptr<LandmarkProvider> {
+        if (LANDMARK_REPLAY_FILE) {
+            return std::make_unique<ReplayLandmarkProvider>(LANDMARK_REPLAY_FILE);
         }
-        faceMorph.setDstImg(dst.data, dst.cols, dst.rows, GL_BGR);
-        Landmark landmark(dst.cols, dst.rows, points);
-        faceMorph.setDstKeyPoints(landmark, 55, 105, 22);
-
-        if (true) {
-            cv::Mat img = dst;
-            cv::Mat cl;
-            float scale = 4960.f / img.cols;
-            cv::resize(img, cl, cv::Size(img.cols * scale, img.rows * scale));
-            cv::Rect rect(f->x() * scale, f->y() * scale, f->width() * scale, f->height() * scale);
-            cv::rectangle(cl, rect, cv::Scalar(255, 255, 0), 2);
-
-            // 55 105 22
-            for (int k = 0; k < f->numLandmarks(); ++k) {
-
-//                if (k != 55 && k != 105) {
-//                    continue;
-//                }
-
-                cv::Point2f p(f->landmarkX(k), f->landmarkY(k));
-                printf("landmark（%d): %.2f, %.2f\n", k,  p.x, p.y);
-
-                cv::Point2f drawP = p * scale;
-                cv::circle(cl, drawP, 2, cv::Scalar(0, 0, 255), 2);
-                std::string index = std::to_string(k);
-                cv::putText(cl, index, drawP, cv::FONT_HERSHEY_SIMPLEX, 1, cv::Scalar(0, 255, 0));
-
-            }
-//            cv::imshow("11", cl);
-//            cv::waitKey(0);
-            cv::imwrite("a.jpg", cl);
+        DetectConfig detectConfig = {};
+        if (LANDMARK_CACHE_FILE) {
+            return std::make_unique<CachedLandmarkProvider>(
+                    LANDMARK_CACHE_FILE, InspireLandmarkProvider::configKey(detectConfig),
+                    [detectConfig]() { return std::make_unique<InspireLandmarkProvider>(detectConfig); });
         }
-    }
+        return std::make_unique<InspireLandmarkProvider>(detectConfig);
+    });
+    // 调试输出在检测线程上做，不占用渲染线程；src, dst 依次提交，dst 是第 2 帧
+    faceDetector->setCallback([](const AsyncDetectResultPtr &r) {
+        if (r->seq == 2) {
+            dumpLandmarks(dstImg, *r);
+        }
+    });
 
-//    faceMorph.generateTriangles();
+    std::string imageDir = std::string(ASSERTS_PATH) + "/images/raw";
+    srcImg = cv::imread(imageDir + "/49907.png");
+    dstImg = cv::imread(imageDir + "/49915.png");
+    faceMorph.setSrcImg(srcImg.data, srcImg.cols, srcImg.rows, GL_BGR);
+    faceMorph.setDstImg(dstImg.data, dstImg.cols, dstImg.rows, GL_BGR);
+
+    // 输入只有一个槽位，src 的结果出来之后再提交 dst
+    srcSeq = faceDetector->submit(srcImg.data, srcImg.cols, srcImg.rows,
+                                  LANDMARK_ROTATION_270, LANDMARK_IMAGE_BGR);
+}
+
+/**
+ * @return 两张图的关键点都已经设置
+ */
+static bool pollDetect() {
+    if (srcReady && dstReady) {
+        return true;
+    }
+    AsyncDetectResultPtr r = faceDetector->latest();
+    if (r == nullptr) {
+        return false;
+    }
+    if (!srcReady && r->seq == srcSeq) {
+        // 直接引用检测结果中的点，GLFaceMorph 内部只复制一次
+        faceMorph.setSrcKeyPoints(facePoints(*r), 55, 105, 22);
+        srcReady = true;
+        dstSeq = faceDetector->submit(dstImg.data, dstImg.cols, dstImg.rows,
+                                      LANDMARK_ROTATION_90, LANDMARK_IMAGE_BGR);
+    } else if (srcReady && r->seq == dstSeq) {
+        faceMorph.setDstKeyPoints(facePoints(*r), 55, 105, 22);
+        dstReady = true;
+    }
+    return srcReady && dstReady;
 }
 
 TextureFilter textureFilter;
@@ -95,6 +125,9 @@ void GLFaceMorph::test(int width, int height, float percent) {
         initialize();
         init_flag = true;
     }
+    if (!pollDetect()) {
+        return;
+    }
 
     Framebuffer &fb = faceMorph.render(percent);
 
@@ -6,9 +6,12 @@
 
 #include <Playground.h>
 #include "wrap/filter/FaceMorphFilter.h"
-#include "wrap/filter/TextureFilter.h"
-#include "utils/Delaunator.h"
+#include "wrap/filter/FaceMeshMorphFilter.h"
+#include "face/morph/FaceMeshTopology.h"
+#include "face/morph/LandmarkLOD.h"
 #include "face/CVUtils.h"
+#include "face/LandmarkView.h"
+#include "utils/Affine2D.h"
 
 NAMESPACE_WUTA
 
@@ -26,6 +29,10 @@ struct TransStatus {
     }
 };
 
+/**
+ * 关键点，可以只引用外部的点（LandmarkView），第一次变换时才复制到自己的内存
+ * 引用外部点时，复制出来的 Landmark 也引用同一块内存，需要长期保存时调用 own()
+ */
 class Landmark {
 public:
     Landmark() {}
@@ -35,28 +42,83 @@ public:
         if (p) {
             m_points.assign(p, p + psize);
         }
+        m_view = m_points;
     }
 
-    Landmark(float w, float h, const std::vector<float> &p, bool glCoord = false) : m_width(w), m_height(h) {
+    Landmark(float w, float h, std::vector<float> p, bool glCoord = false) : m_width(w), m_height(h) {
         m_gl_coord = glCoord;
-        m_points = p;
+        m_points = std::move(p);
+        m_view = m_points;
+    }
+
+    /**
+     * 不复制，p 需要在变换或者 own() 之前一直有效；跨步的视图直接复制成连续的点
+     */
+    Landmark(float w, float h, LandmarkView p, bool glCoord = false) : m_width(w), m_height(h) {
+        m_gl_coord = glCoord;
+        if (p.contiguous()) {
+            m_view = p;
+        } else {
+            p.copyTo(m_points);
+            m_view = m_points;
+        }
     }
 
     Landmark(const Landmark &l) {
+        *this = l;
+    }
+
+    Landmark(Landmark &&l) noexcept {
+        *this = std::move(l);
+    }
+
+    Landmark &operator=(const Landmark &l) {
+        if (this == &l) {
+            return *this;
+        }
         m_gl_coord = l.m_gl_coord;
         m_width = l.m_width;
         m_height = l.m_height;
-        m_points = l.m_points;
+        if (l.owned()) {
+            m_points = l.m_points;
+            m_view = m_points;
+        } else {
+            m_points.clear();
+            m_view = l.m_view;
+        }
+        return *this;
     }
 
-    Landmark &operator=(const Landmark &l) {
+    Landmark &operator=(Landmark &&l) noexcept {
+        if (this == &l) {
+            return *this;
+        }
         m_gl_coord = l.m_gl_coord;
         m_width = l.m_width;
         m_height = l.m_height;
-        m_points = l.m_points;
+        // vector 移动之后数据的地址不变，拥有的点视图仍然有效
+        m_points = std::move(l.m_points);
+        m_view = l.m_view;
+        l.m_points.clear();
+        l.m_view = LandmarkView();
+        return *this;
+    }
+
+    /**
+     * 引用外部点时复制到自己的内存
+     */
+    Landmark &own() {
+        if (!owned()) {
+            m_view.copyTo(m_points);
+            m_view = m_points;
+        }
         return *this;
     }
 
+    inline bool owned() const {
+        return m_view.data() == m_points.data();
+    }
+
     void setSize(float w, float h) {
         m_width = w;
         m_height = h;
@@ -71,15 +133,15 @@ public:
     }
 
     inline int size() const {
-        return (int) m_points.size() / 2;
+        return m_view.size();
     }
 
     inline float px(int index) const {
-        return m_points[index * 2];
+        return m_view.x(index);
     }
 
     inline float py(int index) const {
-        return m_points[index * 2 + 1];
+        return m_view.y(index);
     }
 
     float distance(int ai, int bi) const {
@@ -111,28 +173,49 @@ public:
     }
 
     Landmark &scale(float sa) {
-        for (int i = 0, size = (int) m_points.size(); i < size; ++i) {
-            m_points[i] *= sa;
-        }
-        return *this;
+        return transform(Affine2D::scale(sa));
     }
 
     Landmark &translate(float dx, float dy) {
-        for (int i = 0, size = (int) m_points.size(); i < size; i += 2) {
-            m_points[i] += dx;
-            m_points[i + 1] += dy;
-        }
-        return *this;
+        return transform(Affine2D::translate(dx, dy));
     }
 
     Landmark &rotate(float cx, float cy, float angle) {
-        for (int i = 0, size = (int) m_points.size(); i < size; i += 2) {
-            float x = m_points[i];
-            float y = m_points[i + 1];
-            MathUtils::rotatePoint(x, y, cx, cy, angle);
-            m_points[i] = x;
-            m_points[i + 1] = y;
+        return transform(Affine2D::rotate(cx, cy, angle));
+    }
+
+    /**
+     * 一次遍历应用组合好的变换
+     */
+    Landmark &transform(const Affine2D &m) {
+        if (owned()) {
+            m.apply(m_points.data(), m_points.data(), size());
+            return *this;
         }
+        // 引用外部点时，复制和变换在同一次遍历里完成
+        return transform(*this, m);
+    }
+
+    /**
+     * 从 src 变换得到点，不需要先复制再变换，复用已有的空间
+     */
+    Landmark &transform(const Landmark &src, const Affine2D &m) {
+        m_gl_coord = src.m_gl_coord;
+        m_width = src.m_width;
+        m_height = src.m_height;
+        LandmarkView in = src.m_view;
+        m_points.resize((size_t) in.size() * 2);
+        m.apply(in.data(), m_points.data(), in.size());
+        m_view = m_points;
+        return *this;
+    }
+
+    /**
+     * 从 src 切换到 glCoord 坐标系再做 m，两步合成一次遍历
+     */
+    Landmark &transform(const Landmark &src, bool glCoord, const Affine2D &m) {
+        transform(src, src.coordMatrix(glCoord).then(m));
+        m_gl_coord = glCoord;
         return *this;
     }
 
@@ -140,62 +223,83 @@ public:
         if (m_gl_coord == glCoord) {
             return *this;
         }
+        Affine2D flip = coordMatrix(glCoord);
         m_gl_coord = glCoord;
-        for (int i = 0, size = (int) m_points.size(); i < size; i += 2) {
-            m_points[i + 1] = m_height - m_points[i + 1];
+        return transform(flip);
+    }
+
+    /**
+     * 切换到 glCoord 坐标系（y 轴翻转）的变换，已经是该坐标系时为单位变换
+     */
+    Affine2D coordMatrix(bool glCoord) const {
+        Affine2D flip;
+        if (m_gl_coord != glCoord) {
+            flip.e = -1;
+            flip.f = m_height;
         }
-        return *this;
+        return flip;
+    }
+
+    inline const float *data() const {
+        return m_view.data();
+    }
+
+    inline LandmarkView view() const {
+        return m_view;
+    }
+
+    /**
+     * 只保留 indices 中的点，顺序和 indices 一致
+     */
+    Landmark subset(const std::vector<int> &indices) const {
+        return {m_width, m_height, LandmarkLOD::gather(data(), indices), m_gl_coord};
     }
 
     std::vector<float> normalize() {
         std::vector<float> pv;
-        for (int i = 0, size = (int) m_points.size(); i < size; i += 2) {
-            pv.push_back(m_points[i] / m_width);
-            pv.push_back(m_points[i + 1] / m_height);
-        }
+        normalize(pv);
         return pv;
     }
 
+    void normalize(std::vector<float> &pv, Bounds2D *bounds = nullptr) const {
+        pv.resize((size_t) size() * 2);
+        Affine2D::scale(1.f / m_width, 1.f / m_height).apply(data(), pv.data(), size(), bounds);
+    }
+
     std::vector<float> trianglePoints() {
         std::vector<float> pv;
-        float minx = (float) INT32_MAX, miny = (float) INT32_MAX, maxx = INT32_MIN, maxy = INT32_MIN;
-        for (int i = 0, size = (int) m_points.size(); i < size; i += 2) {
-            float x = m_points[i] / m_width;
-            float y = m_points[i + 1] / m_height;
-            if (minx > x) {
-                minx = x;
-            }
-            if (maxx < x) {
-                maxx = x;
-            }
-            if (miny > y) {
-                miny = y;
-            }
-            if (maxy < y) {
-                maxy = y;
-            }
-
-            pv.push_back(x);
-            pv.push_back(y);
-        }
+        trianglePoints(pv);
+        return pv;
+    }
+
+    /**
+     * 归一化的点加上外框的 4 个点，包围盒和归一化在同一次遍历里得到
+     */
+    void trianglePoints(std::vector<float> &pv) const {
+        int count = size() * 2;
+        pv.resize(count + 8);
+        Bounds2D bounds;
+        Affine2D::scale(1.f / m_width, 1.f / m_height).apply(data(), pv.data(), size(), &bounds);
+
         // 缩放矩形
-        float cx = (maxx + minx) / 2.0f;
-        float cy = (maxy + miny) / 2.0f;
-        float lw = (maxx - minx) * 2.0f;
-        float lh = (maxy - miny) * 2.0f;
+        float cx = bounds.centerX();
+        float cy = bounds.centerY();
+        float lw = bounds.width() * 2.0f;
+        float lh = bounds.height() * 2.0f;
         float lx = cx - lw / 2.0f, ly = cy - lh / 2.0f;
         float rx = cx + lw / 2.0f, ry = cy + lh / 2.0f;
-        pv.push_back(lx);
-        pv.push_back(ly);
+        float *rect = pv.data() + count;
+        rect[0] = lx;
+        rect[1] = ly;
 
-        pv.push_back(rx);
-        pv.push_back(ly);
+        rect[2] = rx;
+        rect[3] = ly;
 
-        pv.push_back(rx);
-        pv.push_back(ry);
+        rect[4] = rx;
+        rect[5] = ry;
 
-        pv.push_back(lx);
-        pv.push_back(ry);
+        rect[6] = lx;
+        rect[7] = ry;
 
         // 四个角
 //        pv.push_back(MIN(0, lx));
@@ -209,7 +313,6 @@ public:
 //
 //        pv.push_back(MIN(0, lx));
 //        pv.push_back(MAX(1, ry));
-        return pv;
     }
 
 private:
@@ -217,21 +320,21 @@ private:
 
     float m_width = 0;
     float m_height = 0;
+    // 当前的点，指向 m_points 或者外部的内存
+    LandmarkView m_view;
     std::vector<float> m_points;
 };
 
 class MorphImage {
 public:
     void setData(const uint8_t *data, int width, int height, GLenum format) {
-        m_width = width;
-        m_height = height;
+        resetSize(width, height);
         m_img.set(data, width, height, format);
         m_texture = INVALID_TEXTURE;
     }
 
     void setTexture(int id, int width, int height) {
-        m_width = width;
-        m_height = height;
+        resetSize(width, height);
         m_img.release();
         m_texture = Texture(id, width, height);
     }
@@ -240,8 +343,11 @@ public:
      * 3 个关键点 左右眼球中心点，鼻子中心点的索引
      */
     void setKeyPoints(const Landmark &landmark, int leftEye, int rightEye, int nose) {
-        m_landmark = landmark;
-        m_landmark.changeCoord(true);
+        // 翻转到 GL 坐标系和缩放（已经缩放过时，点也放到缩放后的坐标系）合成一次变换，直接写到 m_landmark
+        m_landmark.transform(landmark, true, m_fit);
+        if (m_width != m_raw_width || m_height != m_raw_height) {
+            m_landmark.setSize((float) m_width, (float) m_height);
+        }
         m_leye_index = leftEye;
         m_reye_index = rightEye;
         m_nose_index = nose;
@@ -259,6 +365,17 @@ public:
         return m_landmark.size();
     }
 
+    /**
+     * 原图尺寸，关键点在这个坐标系
+     */
+    inline int rawWidth() const {
+        return m_raw_width;
+    }
+
+    inline int rawHeight() const {
+        return m_raw_height;
+    }
+
     inline bool canTransform(const MorphImage &dst) const {
         return pointsSize() > 1 && pointsSize() == dst.pointsSize();
     }
@@ -289,37 +406,30 @@ public:
     }
 
     /**
-     * 将图片和点都统一到 dw, dh 大小
+     * 将点统一到 dw, dh 大小，图片不再渲染，缩放只记录在 m_fit 中，采样时换算到原图的纹理坐标
      */
-    void scaleTo(TextureFilter &texFilter, int dw, int dh) {
+    void scaleTo(int dw, int dh) {
         if (m_width == dw && m_height == dh) {
             return;
         }
 
-        float sw = (float) m_width, sh = (float) m_height;
+        float sw = (float) m_raw_width, sh = (float) m_raw_height;
         float scale = std::min((float) dw / sw, (float) dh / sh);
         float ssw = sw * scale, ssh = sh * scale;
         float dx = (float) dw / 2.f - ssw / 2.f, dy = (float) dh / 2.f - ssh / 2.f;
 
-        m_landmark.scale(scale).translate(dx, dy);
-
-        GLRect rect(sw, sh);
-        rect.scale(scale, scale);
-        rect.translate(dx, dy);
-
-        m_scaled_fb.create(dw, dh);
-        Viewport viewport(dw, dh);
-        viewport.enableClearColor(0, 0, 0, 0);
-        texFilter.setViewport(viewport).setVertexCoord(rect, (float) dw, (float) dh).setFullTextureCoord();
-        texFilter.inputTexture(rawTexture()).render(&m_scaled_fb);
+        Affine2D fit = Affine2D::scale(scale).then(Affine2D::translate(dx, dy));
+        // 点可能已经按之前的尺寸缩放过
+        m_landmark.transform(m_fit.inverse().then(fit));
+        m_fit = fit;
 
         m_width = dw;
         m_height = dh;
         m_landmark.setSize((float) dw, (float) dh);
     }
 
-    Texture inputTexture() {
-        return m_scaled_fb.valid() ? m_scaled_fb.textureNonnull() : rawTexture();
+    const Texture &texture() {
+        return m_texture.valid() ? m_texture : m_img.textureNonnull();
     }
 
     TransStatus getFinalTransStatus(MorphImage &dst) const {
@@ -335,41 +445,67 @@ public:
     }
 
     /**
-     * 得到一张渲染到指定位置的纹理，同时输出最终的点
+     * 缩放、平移之后绕两眼中心旋转，作用在 GL 坐标系的点上
      */
-    Texture2D transform(TextureFilter &texFilter, const TransStatus &status, Landmark &outLandmark) {
-        outLandmark = m_landmark;
-        outLandmark.scale(status.scale).translate(status.trans_x, status.trans_y);
-        float cx = outLandmark.centerX(m_leye_index, m_reye_index);
-        float cy = outLandmark.centerY(m_leye_index, m_reye_index);
-        outLandmark.rotate(cx, cy, status.rotate);
-
-        GLRect rect((float) m_width, (float) m_height);
-        rect.scale(status.scale, status.scale)
-                .translate(status.trans_x, status.trans_y)
-                .setRotation(cx, cy, status.rotate);
+    Affine2D transformMatrix(const TransStatus &status) const {
+        Affine2D m = Affine2D::scale(status.scale).then(Affine2D::translate(status.trans_x, status.trans_y));
+        float ex = eyeCenterX(), ey = eyeCenterY();
+        return m.then(Affine2D::rotate(m.mapX(ex, ey), m.mapY(ex, ey), status.rotate));
+    }
 
-        m_trans_fb.create(m_width, m_height);
-        texFilter.viewport().set(m_width, m_height)
-                .enableClearColor(0, 0, 0, 0);
-        texFilter.setVertexCoord(rect, (float) m_width, (float) m_height).setFullTextureCoord();
-        texFilter.blend(false).inputTexture(inputTexture()).render(&m_trans_fb);
+    /**
+     * 缩放后的纹理坐标到原图纹理坐标，不依赖关键点
+     */
+    Affine2D texToRaw() const {
+        Affine2D toRawTex = Affine2D::scale(1.f / (float) m_raw_width, -1.f / (float) m_raw_height);
+        toRawTex.f = 1;
+        return fromTexMatrix().then(m_fit.inverse()).then(toRawTex);
+    }
 
-        return m_trans_fb.textureNonnull();
+    /**
+     * 输出的纹理坐标到原图纹理坐标: 变换和缩放都折叠到采样坐标里，不需要中间的 framebuffer
+     */
+    Affine2D sampleMatrix(const TransStatus &status) const {
+        return fromTexMatrix().then(transformMatrix(status).inverse()).then(texCoordMatrix()).then(texToRaw());
     }
 
-    float *obtainTexPoints(int size) {
-        return m_tex_points.obtain<float>(size);
+    /**
+     * 得到变换之后的点
+     */
+    void transform(const TransStatus &status, Landmark &outLandmark) const {
+        // 缩放、平移、旋转组合成一个矩阵，一次遍历所有点
+        outLandmark.transform(m_landmark, transformMatrix(status));
     }
 
 private:
-    const Texture &rawTexture() {
-        return m_texture.valid() ? m_texture : m_img.textureNonnull();
+    /**
+     * GL 坐标系的点到纹理坐标: (x / w, 1 - y / h)
+     */
+    Affine2D texCoordMatrix() const {
+        Affine2D m = Affine2D::scale(1.f / (float) m_width, -1.f / (float) m_height);
+        m.f = 1;
+        return m;
+    }
+
+    Affine2D fromTexMatrix() const {
+        Affine2D m = Affine2D::scale((float) m_width, -(float) m_height);
+        m.f = (float) m_height;
+        return m;
+    }
+
+    void resetSize(int width, int height) {
+        m_width = m_raw_width = width;
+        m_height = m_raw_height = height;
+        m_fit = Affine2D();
     }
 
 private:
     int m_width = 0;
     int m_height = 0;
+    // 原图尺寸和原图到缩放后坐标系的变换
+    int m_raw_width = 0;
+    int m_raw_height = 0;
+    Affine2D m_fit;
     ImageTexture m_img;
     Texture m_texture = INVALID_TEXTURE;
 
@@ -377,11 +513,6 @@ private:
     int m_leye_index = 0;
     int m_reye_index = 0;
     int m_nose_index = 0;
-
-    Framebuffer m_scaled_fb;
-    Framebuffer m_trans_fb;
-
-    Array m_tex_points;
 };
 
 class GLFaceMorph {
@@ -391,26 +522,83 @@ public:
 public:
     void setSrcImg(const uint8_t *data, int width, int height, GLenum format) {
         m_src_img.setData(data, width, height, format);
+        m_mesh_dirty = true;
     }
 
     void setSrcTexture(int id, int width, int height) {
         m_src_img.setTexture(id, width, height);
+        m_mesh_dirty = true;
     }
 
+    /**
+     * 切换 LOD 时需要原始的点，这里保存一份；landmark 引用外部的点时只复制这一次
+     */
     void setSrcKeyPoints(const Landmark &landmark, int leftEye, int rightEye, int nose) {
-        m_src_img.setKeyPoints(landmark, leftEye, rightEye, nose);
+        m_src_keys = {landmark, leftEye, rightEye, nose};
+        m_src_keys.landmark.own();
+        applyKeyPoints();
+    }
+
+    /**
+     * 原图坐标系的点，例如 LandmarkFace::landmarks()，需要先设置 src 图像
+     */
+    void setSrcKeyPoints(LandmarkView points, int leftEye, int rightEye, int nose) {
+        setSrcKeyPoints(Landmark((float) m_src_img.rawWidth(), (float) m_src_img.rawHeight(), points),
+                        leftEye, rightEye, nose);
     }
 
     void setDstImg(const uint8_t *data, int width, int height, GLenum format) {
         m_dst_img.setData(data, width, height, format);
+        m_mesh_dirty = true;
     }
 
     void setDstTexture(int id, int width, int height) {
         m_dst_img.setTexture(id, width, height);
+        m_mesh_dirty = true;
     }
 
     void setDstKeyPoints(const Landmark &landmark, int leftEye, int rightEye, int nose) {
-        m_dst_img.setKeyPoints(landmark, leftEye, rightEye, nose);
+        m_dst_keys = {landmark, leftEye, rightEye, nose};
+        m_dst_keys.landmark.own();
+        applyKeyPoints();
+    }
+
+    /**
+     * 原图坐标系的点，需要先设置 dst 图像
+     */
+    void setDstKeyPoints(LandmarkView points, int leftEye, int rightEye, int nose) {
+        setDstKeyPoints(Landmark((float) m_dst_img.rawWidth(), (float) m_dst_img.rawHeight(), points),
+                        leftEye, rightEye, nose);
+    }
+
+    /**
+     * 关键点 LOD，第 k 级保留约 1/2^k 的稠密点（两眼、鼻子和外轮廓始终保留），0 使用全部关键点
+     * 预览或者低端机上用较高的级别换取更少的三角形
+     */
+    void setLODLevel(int level) {
+        if (level != m_lod_level) {
+            m_lod_level = level;
+            applyKeyPoints();
+        }
+    }
+
+    inline int lodLevel() const {
+        return m_lod_level;
+    }
+
+    /**
+     * 当前 LOD 相对完整关键点网格的最大形变误差（dst 像素）
+     */
+    inline float lodError() const {
+        return m_lod_error;
+    }
+
+    /**
+     * 固定网格模式: 设置关键点之后只构建并上传一次网格，之后进度变化只更新 uniform 并绘制一次
+     * 纹理坐标直接取自两张输入图，不再需要逐帧的变换渲染
+     */
+    void setStaticMesh(bool enable) {
+        m_static_mesh = enable;
     }
 
 
@@ -422,20 +610,22 @@ public:
     Framebuffer &render(float percent) {
         int dstWidth = (int) m_dst_img.width();
         int dstHeight = (int) m_dst_img.height();
-        m_src_img.scaleTo(m_texture_filter, dstWidth, dstHeight);
+        m_src_img.scaleTo(dstWidth, dstHeight);
+        m_output_fb.create(dstWidth, dstHeight);
 
         // 一边没识别到点，或者点位不一致，不能转换，简单的渐变混合
         if (!m_src_img.canTransform(m_dst_img)) {
-            // 简单混合
+            // 简单混合，src 的缩放折叠到纹理坐标里
+            float srcTexCoord[] = {0, 0, 1, 0, 0, 1, 1, 1};
+            m_src_img.texToRaw().apply(srcTexCoord, srcTexCoord, 4);
             m_morph_filter.setFullVertexCoord();
-            m_morph_filter.setSrcTexCoord(nullptr, 0);
+            m_morph_filter.setSrcTexCoord(srcTexCoord, 8);
             m_morph_filter.setDstTexCoord(nullptr, 0);
 
-            m_output_fb.create(dstWidth, dstHeight);
             m_morph_filter.setViewport(dstWidth, dstHeight);
             m_morph_filter.setAlpha(percent);
-            m_morph_filter.setSrcImg(m_src_img.inputTexture());
-            m_morph_filter.setDstImg(m_dst_img.inputTexture());
+            m_morph_filter.setSrcImg(m_src_img.texture());
+            m_morph_filter.setDstImg(m_dst_img.texture());
             m_morph_filter.render(&m_output_fb);
             return m_output_fb;
         }
@@ -447,82 +637,80 @@ public:
                 .trans_x = finalTrans.trans_x * percent,
                 .trans_y = finalTrans.trans_y * percent
         };
+        if (m_static_mesh) {
+            return renderStaticMesh(finalTrans, srcStatus, percent);
+        }
 //        _INFO("final trans: %s", finalTrans.toString());
 //        _INFO("cur trans: %s", srcStatus.toString());
 
-//        _INFO("cur src scale: %.2f, cur src trans(%.2f, %.2f)", curSrcScale, curSrcTransX, curSrcTransY);
-        Landmark curSrcLandmark;
-        Texture2D srcTex = m_src_img.transform(m_texture_filter, srcStatus, curSrcLandmark);
-        m_output_fb.create(dstWidth, dstHeight);
-        if (percent < 0.00001f) {
-            m_texture_filter.viewport().set(dstWidth, dstHeight).enableClearColor(0, 0, 0, 1);
-            m_texture_filter.setFullTextureCoord().setFullVertexCoord();
-            m_texture_filter.inputTexture(srcTex).alpha(1);
-            m_texture_filter.render(&m_output_fb);
-            return m_output_fb;
-        }
-
-        int leyeIndex = m_src_img.leftEyeIndex(), reyeIndex = m_src_img.rightEyeIndex();
-        float curDstScale = curSrcLandmark.distance(leyeIndex, reyeIndex) / m_dst_img.eyeDistance();
-        TransStatus dstStatus = {
-                .scale = curDstScale,
-                .rotate = finalTrans.rotate * (1 - percent),
-                .trans_x = curSrcLandmark.centerX(leyeIndex, reyeIndex) - m_dst_img.eyeCenterX() * curDstScale,
-                .trans_y = curSrcLandmark.centerY(leyeIndex, reyeIndex) - m_dst_img.eyeCenterY() * curDstScale
-        };
-        Landmark curDstLandmark;
-        Texture2D dstTex = m_dst_img.transform(m_texture_filter, dstStatus, curDstLandmark);
-        if (percent > 0.99999f) {
-            m_texture_filter.viewport().set(dstWidth, dstHeight).enableClearColor(0, 0, 0, 1);
-            m_texture_filter.setFullTextureCoord().setFullVertexCoord();
-            m_texture_filter.inputTexture(dstTex).alpha(1);
-            m_texture_filter.render(&m_output_fb);
-            return m_output_fb;
-        }
-
+        // 只变换点，两张图的缩放、变换都折叠到纹理坐标里，整个融合只绘制一次，0 和 1 时也一样
+        TransStatus dstStatus = dstStatusOf(finalTrans, srcStatus, percent);
+        Landmark &curSrcLandmark = m_cur_src_landmark;
+        Landmark &curDstLandmark = m_cur_dst_landmark;
+        m_src_img.transform(srcStatus, curSrcLandmark);
+        m_dst_img.transform(dstStatus, curDstLandmark);
 
         // 计算三角形
-        std::vector<float> srcPoints = curSrcLandmark.trianglePoints();
-        std::vector<float> dstPoints = curDstLandmark.trianglePoints();
-
-        std::vector<double> averagePoints;
+        // 点的缓冲区都是成员，逐帧复用
+        std::vector<float> &srcPoints = m_src_points;
+        std::vector<float> &dstPoints = m_dst_points;
+        curSrcLandmark.trianglePoints(srcPoints);
+        curDstLandmark.trianglePoints(dstPoints);
+
+        // 所有帧共用一套网格拓扑: 点位布局有预生成的表时直接使用，否则只在第一帧三角化
+        // 拖动进度时三角形不会跳变，只有出现翻转的三角形时才重新三角化
+        std::vector<float> &averagePoints = m_average_points;
+        averagePoints.resize(srcPoints.size());
         for (int i = 0, size = (int) srcPoints.size(); i < size; ++i) {
-            averagePoints.push_back((dstPoints[i] + srcPoints[i]) / 2.);
+            averagePoints[i] = (dstPoints[i] + srcPoints[i]) / 2.f;
+        }
+        size_t trianglePointSize;
+        const size_t *triangles = m_topology.triangles(averagePoints.data(), (int) averagePoints.size() / 2,
+                                                       trianglePointSize);
+
+        // 不重复的顶点 + 三角形索引: 关键点和外框，再主动填充到边界的 8 个点
+        const int stride = FaceMorphFilter::MESH_STRIDE;
+        int pointCount = (int) srcPoints.size() / 2;
+        int vertexCount = pointCount + 8;
+        std::vector<float> &vertices = m_mesh_vertices;
+        vertices.resize(vertexCount * stride);
+        for (int i = 0; i < pointCount; ++i) {
+            float sx = srcPoints[i * 2], sy = 1 - srcPoints[i * 2 + 1];
+            float dx = dstPoints[i * 2], dy = 1 - dstPoints[i * 2 + 1];
+            float *v = vertices.data() + i * stride;
+            v[0] = ((1 - percent) * sx + percent * dx) * 2 - 1;
+            v[1] = ((1 - percent) * sy + percent * dy) * 2 - 1;
+            v[2] = sx;
+            v[3] = sy;
+            v[4] = dx;
+            v[5] = dy;
         }
-        delaunator::Delaunator dela(averagePoints);
-
-        // 处理三角形，主动填充边界
-        size_t trianglePointSize = dela.triangles.size();
-        int orgItemSize = (int) trianglePointSize * 2;
-        int itemSize = orgItemSize + 6 * 8;
-        float *srcTriPs = m_src_img.obtainTexPoints(itemSize);
-        float *dstTriPs = m_dst_img.obtainTexPoints(itemSize);
-
-        for (size_t i = 0; i < trianglePointSize; ++i) {
-            size_t ti = dela.triangles[i] * 2;
-            float sx = srcPoints[ti], sy = 1 - srcPoints[ti + 1];
-            float dx = dstPoints[ti], dy = 1 - dstPoints[ti + 1];
-
-            srcTriPs[i * 2] = sx;
-            srcTriPs[i * 2 + 1] = sy;
-            dstTriPs[i * 2] = dx;
-            dstTriPs[i * 2 + 1] = dy;
+        fixBorder(vertices.data(), pointCount, stride, 0, -1, 1);
+        fixBorder(vertices.data(), pointCount, stride, 2, 0, 1);
+        fixBorder(vertices.data(), pointCount, stride, 4, 0, 1);
+
+        // 变换之后的纹理坐标换算到原图上采样
+        Affine2D srcSample = m_src_img.sampleMatrix(srcStatus);
+        Affine2D dstSample = m_dst_img.sampleMatrix(dstStatus);
+        for (int i = 0; i < vertexCount; ++i) {
+            float *v = vertices.data() + i * stride;
+            float sx = v[2], sy = v[3], dx = v[4], dy = v[5];
+            v[2] = srcSample.mapX(sx, sy);
+            v[3] = srcSample.mapY(sx, sy);
+            v[4] = dstSample.mapX(dx, dy);
+            v[5] = dstSample.mapY(dx, dy);
         }
-        fixTriangles(srcTriPs, orgItemSize, 0, 1);
-        fixTriangles(dstTriPs, orgItemSize, 0, 1);
 
-        float *weight = m_vertex_points.obtain<float>(itemSize);
-        for (size_t i = 0; i < itemSize; ++i) {
-            weight[i] = ((1 - percent) * srcTriPs[i] + percent * dstTriPs[i]) * 2 - 1;
+        std::vector<uint16_t> &indices = m_mesh_indices;
+        indices.assign(triangles, triangles + trianglePointSize);
+        for (int i : BORDER_INDICES) {
+            indices.push_back((uint16_t) (pointCount + i));
         }
-        fixTriangles(weight, orgItemSize, -1, 1);
 
         m_morph_filter.viewport().set(dstWidth, dstHeight).enableClearColor(0, 0, 0, 1);
-        m_morph_filter.setVertexCoord(weight, itemSize, GL_TRIANGLES, itemSize / 2);
-        m_morph_filter.setSrcTexCoord(srcTriPs, itemSize);
-        m_morph_filter.setDstTexCoord(dstTriPs, itemSize);
-        m_morph_filter.setSrcImg(srcTex);
-        m_morph_filter.setDstImg(dstTex);
+        m_morph_filter.setMesh(vertices.data(), vertexCount, indices.data(), (int) indices.size());
+        m_morph_filter.setSrcImg(m_src_img.texture());
+        m_morph_filter.setDstImg(m_dst_img.texture());
         m_morph_filter.setAlpha(percent);
 
         m_morph_filter.render(&m_output_fb);
@@ -531,96 +719,219 @@ public:
     }
 
 private:
-    static void fixTriangles(float *points, int size, int min, int max) {
+    /**
+     * src 按 srcStatus 变换之后，dst 对齐到 src 两眼的变换，和 render 中逐帧计算的一致
+     */
+    TransStatus dstStatusOf(const TransStatus &finalTrans, const TransStatus &srcStatus, float percent) {
+        Affine2D srcTrans = m_src_img.transformMatrix(srcStatus);
+        float ex = m_src_img.eyeCenterX(), ey = m_src_img.eyeCenterY();
+        // 相似变换，两眼距离只按 scale 缩放，两眼中心是旋转中心
+        float curDstScale = srcStatus.scale * m_src_img.eyeDistance() / m_dst_img.eyeDistance();
+        TransStatus dstStatus = {
+                .scale = curDstScale,
+                .rotate = finalTrans.rotate * (1 - percent),
+                .trans_x = srcTrans.mapX(ex, ey) - m_dst_img.eyeCenterX() * curDstScale,
+                .trans_y = srcTrans.mapY(ex, ey) - m_dst_img.eyeCenterY() * curDstScale
+        };
+        return dstStatus;
+    }
+
+    /**
+     * 纹理坐标空间的网格: 关键点 + 外框 4 个点 + 纹理的 4 个角
+     * 三角形在 percent = 0.5 的位置上生成，外框到纹理四角补 8 个三角形
+     */
+    void buildStaticMesh() {
+        m_mesh_dirty = false;
+        const TransStatus finalTrans = m_src_img.getFinalTransStatus(m_dst_img);
+        const TransStatus srcStatus = {
+                .scale = 1 + (finalTrans.scale - 1) * 0.5f,
+                .rotate = -finalTrans.rotate * 0.5f,
+                .trans_x = finalTrans.trans_x * 0.5f,
+                .trans_y = finalTrans.trans_y * 0.5f
+        };
+        Affine2D srcToOutput = meshTransform(m_src_img, srcStatus);
+        Affine2D dstToOutput = meshTransform(m_dst_img, dstStatusOf(finalTrans, srcStatus, 0.5f));
+
+        std::vector<float> &srcPoints = m_src_points;
+        std::vector<float> &dstPoints = m_dst_points;
+        meshPoints(m_src_img, srcPoints);
+        meshPoints(m_dst_img, dstPoints);
+
+        int pointCount = (int) srcPoints.size() / 2 - 4;
+        std::vector<float> &averagePoints = m_average_points;
+        averagePoints.resize(pointCount * 2);
+        for (int i = 0; i < pointCount; ++i) {
+            float sx = srcPoints[i * 2], sy = srcPoints[i * 2 + 1];
+            float dx = dstPoints[i * 2], dy = dstPoints[i * 2 + 1];
+            averagePoints[i * 2] = (srcToOutput.mapX(sx, sy) + dstToOutput.mapX(dx, dy)) / 2.f;
+            averagePoints[i * 2 + 1] = (srcToOutput.mapY(sx, sy) + dstToOutput.mapY(dx, dy)) / 2.f;
+        }
+        size_t trianglePointSize;
+        const size_t *triangles = m_topology.triangles(averagePoints.data(), pointCount, trianglePointSize);
+
+        // 外框 (pointCount - 4 ..) 和纹理四角 (pointCount ..) 的 4 个点顺序一致
+        const int stride = FaceMeshMorphFilter::MESH_STRIDE;
+        int vertexCount = pointCount + 4;
+        std::vector<float> &vertices = m_mesh_vertices;
+        vertices.resize(vertexCount * stride);
+        for (int i = 0; i < vertexCount; ++i) {
+            float *v = vertices.data() + i * stride;
+            v[0] = srcPoints[i * 2];
+            v[1] = srcPoints[i * 2 + 1];
+            v[2] = dstPoints[i * 2];
+            v[3] = dstPoints[i * 2 + 1];
+        }
+        std::vector<uint16_t> &indices = m_mesh_indices;
+        indices.assign(triangles, triangles + trianglePointSize);
+        FaceMeshTopology::appendBorder(pointCount - 4, pointCount, indices);
+        m_mesh_filter.setMesh(vertices.data(), vertexCount, indices.data(), (int) indices.size());
+    }
+
+    /**
+     * 归一化的关键点和外框 (Landmark::trianglePoints) 转到原图纹理坐标，再加上包住外框和原图纹理的四个角
+     */
+    static void meshPoints(MorphImage &img, std::vector<float> &points) {
+        img.landmark().trianglePoints(points);
+        for (int i = 1, size = (int) points.size(); i < size; i += 2) {
+            points[i] = 1 - points[i];
+        }
+        img.texToRaw().apply(points.data(), points.data(), (int) points.size() / 2);
+        size_t rect = points.size() - 8;
+        points.resize(points.size() + 8);
+        FaceMeshTopology::borderCorners(points.data() + rect, points.data() + rect + 8);
+    }
+
+    /**
+     * 原图纹理坐标 -> [0, 1] 输出坐标
+     */
+    static Affine2D meshTransform(const MorphImage &img, const TransStatus &status) {
+        return img.sampleMatrix(status).inverse();
+    }
+
+    Framebuffer &renderStaticMesh(const TransStatus &finalTrans, const TransStatus &srcStatus, float percent) {
+        int dstWidth = (int) m_dst_img.width();
+        int dstHeight = (int) m_dst_img.height();
+        if (m_mesh_dirty) {
+            buildStaticMesh();
+        }
+        Affine2D src = meshTransform(m_src_img, srcStatus);
+        Affine2D dst = meshTransform(m_dst_img, dstStatusOf(finalTrans, srcStatus, percent));
+
+        m_mesh_filter.viewport().set(dstWidth, dstHeight).enableClearColor(0, 0, 0, 1);
+        m_mesh_filter.setSrcTransform(src.a, src.b, src.c, src.d, src.e, src.f);
+        m_mesh_filter.setDstTransform(dst.a, dst.b, dst.c, dst.d, dst.e, dst.f);
+        m_mesh_filter.setSrcImg(m_src_img.texture());
+        m_mesh_filter.setDstImg(m_dst_img.texture());
+        m_mesh_filter.setAlpha(percent);
+        m_mesh_filter.render(&m_output_fb);
+        return m_output_fb;
+    }
+
+    /**
+     * 外框 O0..O3 (lx, ly), (rx, ly), (rx, ry), (lx, ry) 和点的包围盒 I0..I3 之间的 8 个三角形
+     * 顶点依次是 O0..O3, I0..I3
+     */
+    static constexpr int BORDER_INDICES[] = {
+            0, 1, 4, 4, 1, 5,
+            5, 1, 2, 5, 2, 6,
+            6, 2, 3, 6, 3, 7,
+            7, 3, 0, 7, 0, 4,
+    };
+
+    /**
+     * 在前 count 个顶点后面追加 8 个边界顶点的 offset 分量，主动填充到 [min, max] 的边界
+     */
+    static void fixBorder(float *vertices, int count, int stride, int offset, float min, float max) {
         float minx = (float) INT32_MAX, miny = (float) INT32_MAX, maxx = INT32_MIN, maxy = INT32_MIN;
-        for (int i = 0; i < size; i += 2) {
-            float x = points[i];
-            float y = points[i + 1];
-            if (minx > x) {
-                minx = x;
-            }
-            if (maxx < x) {
-                maxx = x;
-            }
-            if (miny > y) {
-                miny = y;
-            }
-            if (maxy < y) {
-                maxy = y;
-            }
+        for (int i = 0; i < count; ++i) {
+            float x = vertices[i * stride + offset];
+            float y = vertices[i * stride + offset + 1];
+            minx = std::min(minx, x);
+            maxx = std::max(maxx, x);
+            miny = std::min(miny, y);
+            maxy = std::max(maxy, y);
         }
         float lx = MIN(min, minx);
         float ly = MIN(min, miny);
         float rx = MAX(max, maxx);
         float ry = MAX(max, maxy);
-        // 加8个三角形
-        points[size++] = lx;
-        points[size++] = ly;
-        points[size++] = rx;
-        points[size++] = ly;
-        points[size++] = minx;
-        points[size++] = miny;
-
-        points[size++] = minx;
-        points[size++] = miny;
-        points[size++] = rx;
-        points[size++] = ly;
-        points[size++] = maxx;
-        points[size++] = miny;
-
-        points[size++] = maxx;
-        points[size++] = miny;
-        points[size++] = rx;
-        points[size++] = ly;
-        points[size++] = rx;
-        points[size++] = ry;
-
-        points[size++] = maxx;
-        points[size++] = miny;
-        points[size++] = rx;
-        points[size++] = ry;
-        points[size++] = maxx;
-        points[size++] = maxy;
-
-        points[size++] = maxx;
-        points[size++] = maxy;
-        points[size++] = rx;
-        points[size++] = ry;
-        points[size++] = lx;
-        points[size++] = ry;
-
-        points[size++] = maxx;
-        points[size++] = maxy;
-        points[size++] = lx;
-        points[size++] = ry;
-        points[size++] = minx;
-        points[size++] = maxy;
-
-        points[size++] = minx;
-        points[size++] = maxy;
-        points[size++] = lx;
-        points[size++] = ry;
-        points[size++] = lx;
-        points[size++] = ly;
-
-        points[size++] = minx;
-        points[size++] = maxy;
-        points[size++] = lx;
-        points[size++] = ly;
-        points[size++] = minx;
-        points[size++] = miny;
+        const float border[] = {lx, ly, rx, ly, rx, ry, lx, ry, minx, miny, maxx, miny, maxx, maxy, minx, maxy};
+        for (int k = 0; k < 8; ++k) {
+            vertices[(count + k) * stride + offset] = border[k * 2];
+            vertices[(count + k) * stride + offset + 1] = border[k * 2 + 1];
+        }
+    }
+
+private:
+    /**
+     * 输入的完整关键点和 3 个关键点的索引
+     */
+    struct KeyPoints {
+        Landmark landmark;
+        int left_eye = 0;
+        int right_eye = 0;
+        int nose = 0;
+    };
+
+    /**
+     * 两端都有关键点且点数一致时按 LOD 级别取子集，否则直接使用完整的关键点
+     */
+    void applyKeyPoints() {
+        m_lod_error = 0;
+        // 不使用 LOD 时直接从保存的点变换到 MorphImage，不再复制
+        const KeyPoints *src = &m_src_keys, *dst = &m_dst_keys;
+        KeyPoints srcLOD, dstLOD;
+        int count = src->landmark.size();
+        if (m_lod_level > 0 && count > 3 && count == dst->landmark.size()) {
+            // 重心坐标对仿射不变，直接在原始坐标上计算，误差为 dst 图上的像素
+            LandmarkLOD lod;
+            lod.build(src->landmark.data(), dst->landmark.data(), count,
+                      {src->left_eye, src->right_eye, src->nose, dst->left_eye, dst->right_eye, dst->nose});
+            std::vector<int> indices = lod.select(lod.levelPoints(m_lod_level));
+            m_lod_error = lod.error((int) indices.size());
+            srcLOD = subsetKeyPoints(*src, indices);
+            dstLOD = subsetKeyPoints(*dst, indices);
+            src = &srcLOD;
+            dst = &dstLOD;
+            _INFO("GLFaceMorph LOD(%d): %d -> %d points, error: %.2f px",
+                  m_lod_level, count, (int) indices.size(), m_lod_error);
+        }
+        m_src_img.setKeyPoints(src->landmark, src->left_eye, src->right_eye, src->nose);
+        m_dst_img.setKeyPoints(dst->landmark, dst->left_eye, dst->right_eye, dst->nose);
+        m_topology.reset();
+        m_mesh_dirty = true;
+    }
+
+    static KeyPoints subsetKeyPoints(const KeyPoints &keys, const std::vector<int> &indices) {
+        auto remap = [&indices](int index) {
+            return (int) (std::lower_bound(indices.begin(), indices.end(), index) - indices.begin());
+        };
+        return {keys.landmark.subset(indices), remap(keys.left_eye), remap(keys.right_eye), remap(keys.nose)};
     }
 
 private:
     MorphImage m_src_img;
     MorphImage m_dst_img;
-
-    Array m_vertex_points;
+    KeyPoints m_src_keys;
+    KeyPoints m_dst_keys;
+    int m_lod_level = 0;
+    float m_lod_error = 0;
 
     FaceMorphFilter m_morph_filter;
-    TextureFilter m_texture_filter;
+    FaceMeshMorphFilter m_mesh_filter;
+    bool m_static_mesh = false;
+    bool m_mesh_dirty = true;
 
     Framebuffer m_output_fb;
+
+    Landmark m_cur_src_landmark;
+    Landmark m_cur_dst_landmark;
+    std::vector<float> m_src_points;
+    std::vector<float> m_dst_points;
+    std::vector<float> m_average_points;
+    std::vector<float> m_mesh_vertices;
+    std::vector<uint16_t> m_mesh_indices;
+    FaceMeshTopology m_topology;
 };
 
 NAMESPACE_END
\ No newline at end of file
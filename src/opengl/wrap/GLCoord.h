@@ -238,6 +238,13 @@ public:
         return m_draw_mode;
     }
 
+    /**
+     * 每次修改坐标都会增加，Attribute 据此判断是否需要重新上传
+     */
+    int version() const {
+        return m_version;
+    }
+
     int drawCount() const {
         return m_draw_count;
     }
@@ -246,6 +253,7 @@ protected:
     virtual const float *getDefault(int &size) = 0;
 
     float *obtainCoords(int size) {
+        m_version += 1;
         if (m_coords == nullptr || m_cap < size) {
             delete[] m_coords;
             m_coords = new float[size];
@@ -258,6 +266,7 @@ protected:
 protected:
     float *m_coords = nullptr;
     int m_cap = 0;
+    int m_version = 0;
 
     int m_size = 0;
     GLenum m_draw_mode = GL_TRIANGLE_STRIP;
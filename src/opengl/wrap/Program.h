@@ -11,6 +11,7 @@
 #include "GLCoord.h"
 #include <map>
 #include <string>
+#include <vector>
 
 NAMESPACE_WUTA
 
@@ -70,12 +71,113 @@ public:
         glBindVertexArray(0);
     }
 
+    inline bool created() const {
+        return m_size != -1;
+    }
+
+    /**
+     * 数据很少变化时用 GL_STATIC_DRAW，下次重新创建 buffer 时生效
+     */
+    void setUsage(GLenum usage) {
+        m_usage = usage;
+    }
+
 private:
     GLenum m_usage;
     unsigned int m_vbo = 0;
     int m_size = -1;
 };
 
+/**
+ * 交错存放的顶点和三角形索引，共用一个 VBO 和一个 EBO，数据变化时才上传
+ * 多个 Attribute 通过 offset 绑定同一个 VertexMesh
+ */
+class VertexMesh {
+public:
+    ~VertexMesh() {
+        release();
+    }
+
+    /**
+     * @param vertices 每个顶点 stride 个 float
+     * @param indices 三个一组的三角形，顶点个数不能超过 65535
+     */
+    bool set(const float *vertices, int vertexCount, int stride, const uint16_t *indices, int indexCount) {
+        _ERROR_RETURN_IF(vertexCount > 0xFFFF, false, "VertexMesh: too many vertices(%d)", vertexCount);
+        m_vertices.assign(vertices, vertices + vertexCount * stride);
+        m_indices.assign(indices, indices + indexCount);
+        m_stride = stride;
+        m_version += 1;
+        return true;
+    }
+
+    /**
+     * 每帧都会更新的网格用 GL_STREAM_DRAW
+     */
+    void setUsage(GLenum usage) { m_usage = usage; }
+
+    inline int stride() const { return m_stride; }
+
+    inline int vertexCount() const { return m_stride > 0 ? (int) m_vertices.size() / m_stride : 0; }
+
+    inline int indexCount() const { return (int) m_indices.size(); }
+
+    /**
+     * 绑定 VBO，数据有变化时重新上传
+     */
+    void bindVertices() {
+        if (m_vbo == 0) {
+            glGenBuffers(1, &m_vbo);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+        if (m_vbo_version != m_version) {
+            glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) (m_vertices.size() * sizeof(float)),
+                         m_vertices.data(), m_usage);
+            m_vbo_version = m_version;
+        }
+    }
+
+    /**
+     * 需要在 VAO 绑定的状态下调用，EBO 的绑定记录在 VAO 中
+     */
+    void drawElements() {
+        if (m_ebo == 0) {
+            glGenBuffers(1, &m_ebo);
+        }
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo);
+        if (m_ebo_version != m_version) {
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr) (m_indices.size() * sizeof(uint16_t)),
+                         m_indices.data(), m_usage);
+            m_ebo_version = m_version;
+        }
+        glDrawElements(GL_TRIANGLES, (GLsizei) m_indices.size(), GL_UNSIGNED_SHORT, nullptr);
+    }
+
+    void release() {
+        if (m_vbo != 0) {
+            glDeleteBuffers(1, &m_vbo);
+            m_vbo = 0;
+        }
+        if (m_ebo != 0) {
+            glDeleteBuffers(1, &m_ebo);
+            m_ebo = 0;
+        }
+        m_vbo_version = m_ebo_version = -1;
+    }
+
+private:
+    std::vector<float> m_vertices;
+    std::vector<uint16_t> m_indices;
+    int m_stride = 0;
+    int m_version = 0;
+    GLenum m_usage = GL_STATIC_DRAW;
+
+    GLuint m_vbo = 0;
+    GLuint m_ebo = 0;
+    int m_vbo_version = -1;
+    int m_ebo_version = -1;
+};
+
 class VAO {
 public:
     ~VAO() {
@@ -169,21 +271,21 @@ public:
     void set(T v, T v1) {
         T a[] = {v, v1};
         std::lock_guard<std::mutex> lock(m_update_mutex);
-        m_data.put(a, sizeof(a));
+        m_data.put(a, 2);
     }
 
     template<typename T>
     void set(T v, T v1, T v2) {
         T a[] = {v, v1, v2};
         std::lock_guard<std::mutex> lock(m_update_mutex);
-        m_data.put(a, sizeof(a));
+        m_data.put(a, 3);
     }
 
     template<typename T>
     void set(T v, T v1, T v2, T v3) {
         T a[] = {v, v1, v2, v3};
         std::lock_guard<std::mutex> lock(m_update_mutex);
-        m_data.put(a, sizeof(a));
+        m_data.put(a, 4);
     }
 
 protected:
@@ -278,6 +380,7 @@ public:
         this->m_vec_size = vecSize;
         this->m_normalized = normalized;
         m_data.put(values, size);
+        m_dirty = true;
     }
 
     void put(GLCoord &coords, int vecSize = 2, bool normalized = false) {
@@ -287,6 +390,7 @@ public:
         this->m_vec_size = vecSize;
         this->m_normalized = normalized;
         m_data.put(values, size);
+        m_dirty = true;
     }
 
     void bind(GLCoord &coords, int vecSize = 2, bool normalized = false) {
@@ -294,6 +398,30 @@ public:
         this->m_vec_size = vecSize;
         this->m_normalized = normalized;
         m_bind_coord = &coords;
+        m_bind_mesh = nullptr;
+        m_dirty = true;
+    }
+
+    /**
+     * 绑定交错顶点中从 offset 个 float 开始的 vecSize 个分量
+     */
+    void bind(VertexMesh &mesh, int offset, int vecSize = 2) {
+        std::lock_guard<std::mutex> lock(m_update_mutex);
+        this->m_vec_size = vecSize;
+        this->m_normalized = false;
+        m_bind_mesh = &mesh;
+        m_mesh_offset = offset;
+        m_bind_coord = nullptr;
+        m_dirty = true;
+    }
+
+    /**
+     * 静态的网格数据使用 GL_STATIC_DRAW
+     */
+    Attribute *setUsage(GLenum usage) {
+        std::lock_guard<std::mutex> lock(m_update_mutex);
+        m_vbo.setUsage(usage);
+        return this;
     }
 
     void input(GLint progId, const VAO& vao) {
@@ -318,17 +446,39 @@ public:
             glVertexAttrib4f(loc, fvalue(0), fvalue(1), fvalue(2), fvalue(3));
             break;
         case FLOAT_POINTER : {
-            int dataSize = 0;
-            const float *d;
-            if (m_bind_coord) {
-                d = m_bind_coord->get(dataSize);
-            } else {
-                d = m_data.data<float>();
-                dataSize = m_data.getPutSize<float>();
+            if (m_bind_mesh) {
+                m_bind_mesh->bindVertices();
+                vao.bind();
+                glVertexAttribPointer(loc, m_vec_size, GL_FLOAT, m_normalized,
+                                      (GLsizei) (m_bind_mesh->stride() * sizeof(float)),
+                                      (const void *) (m_mesh_offset * sizeof(float)));
+                glEnableVertexAttribArray(loc);
+                VAO::unbind();
+                VBO::unbind();
+                break;
+            }
+            // 数据没有变化时不重新上传，只绑定已有的 buffer
+            bool dirty = m_dirty || !m_vbo.created();
+            if (m_bind_coord && m_bind_coord->version() != m_uploaded_version) {
+                dirty = true;
             }
+            if (dirty) {
+                int dataSize = 0;
+                const float *d;
+                if (m_bind_coord) {
+                    m_uploaded_version = m_bind_coord->version();
+                    d = m_bind_coord->get(dataSize);
+                } else {
+                    d = m_data.data<float>();
+                    dataSize = m_data.getPutSize<float>();
+                }
 
-            int unitSize = sizeof(float);
-            m_vbo.bind((const void *)d, dataSize*unitSize);
+                int unitSize = sizeof(float);
+                m_vbo.bind((const void *)d, dataSize*unitSize);
+                m_dirty = false;
+            } else {
+                m_vbo.bind();
+            }
             vao.bind();
             glVertexAttribPointer(loc, m_vec_size,
                                   GL_FLOAT, m_normalized,  0, nullptr);
@@ -349,6 +499,10 @@ private:
     int m_vec_size = 2;
     bool m_normalized = false;
     GLCoord *m_bind_coord = nullptr;
+    VertexMesh *m_bind_mesh = nullptr;
+    int m_mesh_offset = 0;
+    bool m_dirty = true;
+    int m_uploaded_version = -1;
 
     VBO m_vbo;
 };
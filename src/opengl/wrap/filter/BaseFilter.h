@@ -105,7 +105,10 @@ public:
         m_program.detach();
     }
 
-    virtual void release() { m_program.release(); }
+    virtual void release() {
+        m_program.release();
+        m_mesh.release();
+    }
 
 protected:
     virtual const char *vertexShader() = 0;
@@ -120,6 +123,13 @@ protected:
 
     VertexCoord &vertexCoord() { return m_vertex_coords; }
 
+    /**
+     * useMesh(true) 时用 mesh() 中的索引绘制，attribute 需要 bind 到 mesh()
+     */
+    VertexMesh &mesh() { return m_mesh; }
+
+    void useMesh(bool use) { m_use_mesh = use; }
+
     TextureCoord &textureCoord() { return m_texture_coords; }
 
     virtual void onProgramCreated() {}
@@ -129,6 +139,10 @@ protected:
     virtual void onRender(Framebuffer *output) { m_program.input(); }
 
     virtual void onDrawArrays() {
+        if (m_use_mesh) {
+            m_mesh.drawElements();
+            return;
+        }
         glDrawArrays(m_vertex_coords.drawMode(), 0, m_vertex_coords.drawCount());
     }
 
@@ -136,6 +150,7 @@ protected:
         glBindTexture(GL_TEXTURE_2D, 0);
         glBindVertexArray(0);
         glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     }
 
 private:
@@ -146,6 +161,9 @@ private:
 
     VertexCoord m_vertex_coords;
     TextureCoord m_texture_coords;
+
+    VertexMesh m_mesh;
+    bool m_use_mesh = false;
 };
 
 NAMESPACE_END
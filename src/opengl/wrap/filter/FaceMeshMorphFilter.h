@@ -0,0 +1,155 @@
+//
+// Created by LiangKeJin on 2024/8/16.
+//
+
+#pragma once
+
+#include "BaseFilter.h"
+
+NAMESPACE_WUTA
+
+/**
+ * 网格固定的人脸融合: 顶点只有两端的纹理坐标，和索引一起上传一次之后不再变化
+ * 顶点位置在 vertex shader 中由两端各自的 2x3 仿射和 alpha 插值得到，进度变化只需要更新 uniform
+ */
+class FaceMeshMorphFilter : public BaseFilter {
+public:
+    FaceMeshMorphFilter() : BaseFilter("face_mesh_morph") {
+        defAttribute("a_srcTexCoord", DataType::FLOAT_POINTER)->bind(mesh(), 0);
+        defAttribute("a_dstTexCoord", DataType::FLOAT_POINTER)->bind(mesh(), 2);
+        useMesh(true);
+        defUniform("srcImg", DataType::SAMPLER_2D);
+        defUniform("dstImg", DataType::SAMPLER_2D);
+        defUniform("srcTransX", DataType::FVEC3);
+        defUniform("srcTransY", DataType::FVEC3);
+        defUniform("dstTransX", DataType::FVEC3);
+        defUniform("dstTransY", DataType::FVEC3);
+        defUniform("alpha", DataType::FLOAT);
+    }
+
+public:
+    /**
+     * 交错顶点的分量: src 纹理坐标、dst 纹理坐标
+     */
+    static constexpr int MESH_STRIDE = 4;
+
+    /**
+     * 两端的纹理坐标和三角形索引，只在网格变化时调用
+     */
+    void setMesh(const float *vertices, int vertexCount, const uint16_t *indices, int indexCount) {
+        mesh().set(vertices, vertexCount, MESH_STRIDE, indices, indexCount);
+    }
+
+    void setSrcImg(const Texture &tex) {
+        uniform("srcImg")->set(tex.id());
+    }
+
+    void setDstImg(const Texture &tex) {
+        uniform("dstImg")->set(tex.id());
+    }
+
+    /**
+     * 纹理坐标到 [0, 1] 输出坐标的仿射: x' = a * x + b * y + c, y' = d * x + e * y + f
+     */
+    void setSrcTransform(float a, float b, float c, float d, float e, float f) {
+        uniform("srcTransX")->set(a, b, c);
+        uniform("srcTransY")->set(d, e, f);
+    }
+
+    void setDstTransform(float a, float b, float c, float d, float e, float f) {
+        uniform("dstTransX")->set(a, b, c);
+        uniform("dstTransY")->set(d, e, f);
+    }
+
+    void setAlpha(float alpha) {
+        uniform("alpha")->set(alpha);
+    }
+
+protected:
+    const char *vertexShader() override {
+#ifndef GLAPI
+        return R"(
+        attribute vec2 a_srcTexCoord;
+        attribute vec2 a_dstTexCoord;
+        uniform highp vec3 srcTransX;
+        uniform highp vec3 srcTransY;
+        uniform highp vec3 dstTransX;
+        uniform highp vec3 dstTransY;
+        uniform highp float alpha;
+        varying highp vec2 srcTexCoord;
+        varying highp vec2 dstTexCoord;
+        void main() {
+            highp vec3 s = vec3(a_srcTexCoord, 1.0);
+            highp vec3 d = vec3(a_dstTexCoord, 1.0);
+            highp vec2 sp = vec2(dot(srcTransX, s), dot(srcTransY, s));
+            highp vec2 dp = vec2(dot(dstTransX, d), dot(dstTransY, d));
+            srcTexCoord = a_srcTexCoord;
+            dstTexCoord = a_dstTexCoord;
+            gl_Position = vec4(mix(sp, dp, alpha) * 2.0 - 1.0, 0.0, 1.0);
+        })";
+#else
+        return R"(
+        #version 330 core
+        in vec2 a_srcTexCoord;
+        in vec2 a_dstTexCoord;
+        uniform highp vec3 srcTransX;
+        uniform highp vec3 srcTransY;
+        uniform highp vec3 dstTransX;
+        uniform highp vec3 dstTransY;
+        uniform highp float alpha;
+        out highp vec2 srcTexCoord;
+        out highp vec2 dstTexCoord;
+        void main() {
+            highp vec3 s = vec3(a_srcTexCoord, 1.0);
+            highp vec3 d = vec3(a_dstTexCoord, 1.0);
+            highp vec2 sp = vec2(dot(srcTransX, s), dot(srcTransY, s));
+            highp vec2 dp = vec2(dot(dstTransX, d), dot(dstTransY, d));
+            srcTexCoord = a_srcTexCoord;
+            dstTexCoord = a_dstTexCoord;
+            gl_Position = vec4(mix(sp, dp, alpha) * 2.0 - 1.0, 0.0, 1.0);
+        })";
+#endif
+    }
+
+    const char *fragmentShader() override {
+#ifndef GLAPI
+        return R"(
+        varying highp vec2 srcTexCoord;
+        varying highp vec2 dstTexCoord;
+        uniform sampler2D srcImg;
+        uniform sampler2D dstImg;
+
+        uniform highp float alpha;
+        void main() {
+            // 纹理坐标可能超出原图（缩放留下的黑边、旋转之后露出的区域），按透明黑色处理
+            highp vec2 srcIn = step(vec2(0.0), srcTexCoord) * step(srcTexCoord, vec2(1.0));
+            highp vec2 dstIn = step(vec2(0.0), dstTexCoord) * step(dstTexCoord, vec2(1.0));
+            highp vec4 src = texture2D(srcImg, srcTexCoord) * (srcIn.x * srcIn.y);
+            highp vec4 dst = texture2D(dstImg, dstTexCoord) * (dstIn.x * dstIn.y);
+            highp vec4 fc = src * (1.0 - alpha) + dst * alpha;
+            gl_FragColor = vec4(fc.xyz, 1.0);
+        })";
+#else
+        return R"(
+        #version 330 core
+        in highp vec2 srcTexCoord;
+        in highp vec2 dstTexCoord;
+        uniform sampler2D srcImg;
+        uniform sampler2D dstImg;
+
+        uniform highp float alpha;
+        out vec4 fragColor;
+        void main() {
+            // 纹理坐标可能超出原图（缩放留下的黑边、旋转之后露出的区域），按透明黑色处理
+            highp vec2 srcIn = step(vec2(0.0), srcTexCoord) * step(srcTexCoord, vec2(1.0));
+            highp vec2 dstIn = step(vec2(0.0), dstTexCoord) * step(dstTexCoord, vec2(1.0));
+            highp vec4 src = texture(srcImg, srcTexCoord) * (srcIn.x * srcIn.y);
+            highp vec4 dst = texture(dstImg, dstTexCoord) * (dstIn.x * dstIn.y);
+            highp vec4 fc = src * (1.0 - alpha) + dst * alpha;
+            fragColor = vec4(fc.xyz, 1.0);
+        })";
+#endif
+    }
+};
+
+NAMESPACE_END
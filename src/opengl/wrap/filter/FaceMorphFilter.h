@@ -17,10 +17,32 @@ public:
         defUniform("srcImg", DataType::SAMPLER_2D);
         defUniform("dstImg", DataType::SAMPLER_2D);
         defUniform("alpha", DataType::FLOAT);
+        // 网格随进度变化，每帧都会更新
+        mesh().setUsage(GL_STREAM_DRAW);
     }
 
 public:
+    /**
+     * 交错顶点的分量: 顶点坐标、src 纹理坐标、dst 纹理坐标
+     */
+    static constexpr int MESH_STRIDE = 6;
+
+    /**
+     * 使用索引绘制网格，vertices 每个顶点 MESH_STRIDE 个 float，indices 三个一组
+     */
+    void setMesh(const float *vertices, int vertexCount, const uint16_t *indices, int indexCount) {
+        mesh().set(vertices, vertexCount, MESH_STRIDE, indices, indexCount);
+        if (!m_mesh_bound) {
+            attribute("a_vertexCoord")->bind(mesh(), 0);
+            attribute("a_srcTexCoord")->bind(mesh(), 2);
+            attribute("a_dstTexCoord")->bind(mesh(), 4);
+            useMesh(true);
+            m_mesh_bound = true;
+        }
+    }
+
     void setSrcTexCoord(const float *p, int size) {
+        bindCoords();
         textureCoord().set(p, size, GL_TRIANGLES, size/2);
     }
 
@@ -29,6 +51,7 @@ public:
     }
 
     void setDstTexCoord(const float *p, int size) {
+        bindCoords();
         m_dst_tex_coord.set(p, size, GL_TRIANGLES, size/2);
     }
 
@@ -80,8 +103,11 @@ protected:
 
         uniform mediump float alpha;
         void main() {
-            highp vec4 src = texture2D(srcImg, srcTexCoord);
-            highp vec4 dst = texture2D(dstImg, dstTexCoord);
+            // 纹理坐标可能超出原图（缩放留下的黑边、旋转之后露出的区域），按透明黑色处理
+            highp vec2 srcIn = step(vec2(0.0), srcTexCoord) * step(srcTexCoord, vec2(1.0));
+            highp vec2 dstIn = step(vec2(0.0), dstTexCoord) * step(dstTexCoord, vec2(1.0));
+            highp vec4 src = texture2D(srcImg, srcTexCoord) * (srcIn.x * srcIn.y);
+            highp vec4 dst = texture2D(dstImg, dstTexCoord) * (dstIn.x * dstIn.y);
             highp vec4 fc = src * (1.0 - alpha) + dst * alpha;
             gl_FragColor = vec4(fc.xyz, 1.0);
         })";
@@ -96,16 +122,34 @@ protected:
         uniform mediump float alpha;
         out vec4 fragColor;
         void main() {
-            highp vec4 src = texture(srcImg, srcTexCoord);
-            highp vec4 dst = texture(dstImg, dstTexCoord);
+            // 纹理坐标可能超出原图（缩放留下的黑边、旋转之后露出的区域），按透明黑色处理
+            highp vec2 srcIn = step(vec2(0.0), srcTexCoord) * step(srcTexCoord, vec2(1.0));
+            highp vec2 dstIn = step(vec2(0.0), dstTexCoord) * step(dstTexCoord, vec2(1.0));
+            highp vec4 src = texture(srcImg, srcTexCoord) * (srcIn.x * srcIn.y);
+            highp vec4 dst = texture(dstImg, dstTexCoord) * (dstIn.x * dstIn.y);
             highp vec4 fc = src * (1.0 - alpha) + dst * alpha;
             fragColor = vec4(fc.xyz, 1.0);
         })";
 #endif
     }
 
+private:
+    /**
+     * 切回逐顶点数组绘制（全屏的简单混合）
+     */
+    void bindCoords() {
+        if (m_mesh_bound) {
+            attribute("a_vertexCoord")->bind(vertexCoord());
+            attribute("a_srcTexCoord")->bind(textureCoord());
+            attribute("a_dstTexCoord")->bind(m_dst_tex_coord);
+            useMesh(false);
+            m_mesh_bound = false;
+        }
+    }
+
 private:
     TextureCoord m_dst_tex_coord;
+    bool m_mesh_bound = false;
 };
 
 NAMESPACE_END
\ No newline at end of file
@@ -0,0 +1,166 @@
+//
+// Created by LiangKeJin on 2024/8/16.
+//
+
+#pragma once
+
+#include <Playground.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+
+NAMESPACE_WUTA
+
+/**
+ * 点集的包围盒
+ */
+struct Bounds2D {
+    float min_x = FLT_MAX;
+    float min_y = FLT_MAX;
+    float max_x = -FLT_MAX;
+    float max_y = -FLT_MAX;
+
+    inline float width() const { return max_x - min_x; }
+
+    inline float height() const { return max_y - min_y; }
+
+    inline float centerX() const { return (max_x + min_x) / 2.f; }
+
+    inline float centerY() const { return (max_y + min_y) / 2.f; }
+};
+
+/**
+ * 2x3 仿射: x' = a * x + b * y + c, y' = d * x + e * y + f
+ * 缩放、平移、旋转先组合成一个矩阵，再一次遍历所有点
+ */
+struct Affine2D {
+    float a = 1, b = 0, c = 0;
+    float d = 0, e = 1, f = 0;
+
+    static Affine2D scale(float sx, float sy) {
+        Affine2D m;
+        m.a = sx;
+        m.e = sy;
+        return m;
+    }
+
+    static Affine2D scale(float s) {
+        return scale(s, s);
+    }
+
+    static Affine2D translate(float dx, float dy) {
+        Affine2D m;
+        m.c = dx;
+        m.f = dy;
+        return m;
+    }
+
+    /**
+     * 绕 (cx, cy) 旋转 angle 度，方向和 MathUtils::rotatePoint 一致，sin/cos 只计算一次
+     */
+    static Affine2D rotate(float cx, float cy, float angle) {
+        float radians = angle / 180.0f * (float) M_PI;
+        float sinTheta = std::sin(radians), cosTheta = std::cos(radians);
+        Affine2D m;
+        m.a = cosTheta;
+        m.b = -sinTheta;
+        m.c = cx - cx * cosTheta + cy * sinTheta;
+        m.d = sinTheta;
+        m.e = cosTheta;
+        m.f = cy - cx * sinTheta - cy * cosTheta;
+        return m;
+    }
+
+    /**
+     * 先做当前变换，再做 next
+     */
+    Affine2D then(const Affine2D &next) const {
+        Affine2D m;
+        m.a = next.a * a + next.b * d;
+        m.b = next.a * b + next.b * e;
+        m.c = next.a * c + next.b * f + next.c;
+        m.d = next.d * a + next.e * d;
+        m.e = next.d * b + next.e * e;
+        m.f = next.d * c + next.e * f + next.f;
+        return m;
+    }
+
+    /**
+     * 逆变换，不可逆时返回单位变换
+     */
+    Affine2D inverse() const {
+        float det = a * e - b * d;
+        if (std::fabs(det) < 1e-12f) {
+            return {};
+        }
+        float inv = 1.f / det;
+        Affine2D m;
+        m.a = e * inv;
+        m.b = -b * inv;
+        m.d = -d * inv;
+        m.e = a * inv;
+        m.c = -(m.a * c + m.b * f);
+        m.f = -(m.d * c + m.e * f);
+        return m;
+    }
+
+    inline float mapX(float x, float y) const {
+        return a * x + b * y + c;
+    }
+
+    inline float mapY(float x, float y) const {
+        return d * x + e * y + f;
+    }
+
+    /**
+     * 变换 count 个交错的 x, y，in 和 out 可以是同一块内存，bounds 不为空时同时统计变换后的包围盒
+     */
+    void apply(const float *in, float *out, int count, Bounds2D *bounds = nullptr) const {
+        int i = 0;
+        float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+#if defined(__SSE4_1__)
+        // 一次两个点: (x0, y0, x1, y1) * (a, e, a, e) + (y0, x0, y1, x1) * (b, d, b, d) + (c, f, c, f)
+        const __m128 diag = _mm_setr_ps(a, e, a, e);
+        const __m128 cross = _mm_setr_ps(b, d, b, d);
+        const __m128 offset = _mm_setr_ps(c, f, c, f);
+        __m128 vmin = _mm_set1_ps(FLT_MAX), vmax = _mm_set1_ps(-FLT_MAX);
+        for (; i + 2 <= count; i += 2) {
+            __m128 p = _mm_loadu_ps(in + i * 2);
+            __m128 swapped = _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 3, 0, 1));
+            __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(p, diag), _mm_mul_ps(swapped, cross)), offset);
+            _mm_storeu_ps(out + i * 2, r);
+            vmin = _mm_min_ps(vmin, r);
+            vmax = _mm_max_ps(vmax, r);
+        }
+        alignas(16) float lanes[8];
+        _mm_store_ps(lanes, vmin);
+        _mm_store_ps(lanes + 4, vmax);
+        minX = std::min(lanes[0], lanes[2]);
+        minY = std::min(lanes[1], lanes[3]);
+        maxX = std::max(lanes[4], lanes[6]);
+        maxY = std::max(lanes[5], lanes[7]);
+#endif
+        for (; i < count; ++i) {
+            float x = in[i * 2], y = in[i * 2 + 1];
+            float nx = mapX(x, y), ny = mapY(x, y);
+            out[i * 2] = nx;
+            out[i * 2 + 1] = ny;
+            minX = std::min(minX, nx);
+            minY = std::min(minY, ny);
+            maxX = std::max(maxX, nx);
+            maxY = std::max(maxY, ny);
+        }
+        if (bounds) {
+            bounds->min_x = minX;
+            bounds->min_y = minY;
+            bounds->max_x = maxX;
+            bounds->max_y = maxY;
+        }
+    }
+};
+
+NAMESPACE_END
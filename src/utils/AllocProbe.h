@@ -0,0 +1,61 @@
+//
+// Created by LiangKeJin on 2024/8/12.
+//
+
+#pragma once
+
+#include <Playground.h>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+NAMESPACE_WUTA
+
+/**
+ * 堆分配计数，用来确认某段代码在稳定状态下没有堆分配
+ * 需要在一个 cpp 文件里展开 WUTA_ALLOC_PROBE_OPERATOR_NEW() 替换全局的 operator new，
+ * 没有展开时 count() 一直为 0
+ * cv::Mat 的数据走 cv::fastMalloc，不经过 operator new，还要调用 CVAllocProbe::install() 才会计入
+ *
+ *   long before = AllocProbe::count();
+ *   faceMorph.getFrameAt(k, total);
+ *   long allocs = AllocProbe::count() - before;
+ */
+class AllocProbe {
+public:
+    static long count() {
+        return counter().load(std::memory_order_relaxed);
+    }
+
+    /**
+     * 记录一次不经过 operator new 的分配
+     */
+    static void record() {
+        counter().fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static void *alloc(size_t size) {
+        record();
+        void *p = malloc(size ? size : 1);
+        if (p == nullptr) {
+            throw std::bad_alloc();
+        }
+        return p;
+    }
+
+private:
+    static std::atomic<long> &counter() {
+        static std::atomic<long> c{0};
+        return c;
+    }
+};
+
+NAMESPACE_END
+
+#define WUTA_ALLOC_PROBE_OPERATOR_NEW() \
+    void *operator new(size_t size) { return wuta::AllocProbe::alloc(size); } \
+    void *operator new[](size_t size) { return wuta::AllocProbe::alloc(size); } \
+    void operator delete(void *p) noexcept { free(p); } \
+    void operator delete[](void *p) noexcept { free(p); } \
+    void operator delete(void *p, size_t) noexcept { free(p); } \
+    void operator delete[](void *p, size_t) noexcept { free(p); }
@@ -1,10 +1,36 @@
 
 #include "Delaunator.h"
+#include <cstdint>
+#include <cstring>
+#include <thread>
 
 namespace delaunator {
 
-Delaunator::Delaunator(std::vector<double> const& in_coords)
-    : coords(in_coords),
+namespace {
+
+// fn(chunk, begin, end) for `chunks` contiguous ranges of [0, n), chunk 0 runs on the calling thread
+template<typename Fn>
+void for_chunks(std::size_t n, std::size_t chunks, Fn fn) {
+    if (chunks <= 1) {
+        fn(std::size_t(0), std::size_t(0), n);
+        return;
+    }
+    std::vector<std::thread> workers;
+    workers.reserve(chunks - 1);
+    for (std::size_t c = 1; c < chunks; c++) {
+        workers.emplace_back(fn, c, n * c / chunks, n * (c + 1) / chunks);
+    }
+    fn(std::size_t(0), std::size_t(0), n / chunks);
+    for (auto &w : workers) {
+        w.join();
+    }
+}
+
+} // namespace
+
+template<typename T, typename Storage>
+BasicDelaunator<T, Storage>::BasicDelaunator()
+    : coords(),
       triangles(),
       halfedges(),
       hull_prev(),
@@ -15,19 +41,95 @@ Delaunator::Delaunator(std::vector<double> const& in_coords)
       m_center_x(),
       m_center_y(),
       m_hash_size(),
-      m_edge_stack() {
-    std::size_t n = coords.size() >> 1;
+      m_edge_stack(),
+      m_ids(),
+      m_flips(),
+      m_points(),
+      m_skipped() {
+}
+
+template<typename T, typename Storage>
+BasicDelaunator<T, Storage>::BasicDelaunator(StridedSpan<T> in_coords) : BasicDelaunator() {
+    update(in_coords);
+}
+
+template<typename T, typename Storage>
+bool BasicDelaunator<T, Storage>::update(StridedSpan<T> in_coords) {
+    // a skipped point is in no triangle, flips can't bring it back once it moves apart
+    bool reuse = !triangles.empty() && in_coords.size() == m_points && m_skipped == 0;
+    coords = in_coords;
+    m_points = in_coords.size();
+    m_flips = 0;
+    if (reuse && still_valid() && relegalize()) {
+        return true;
+    }
+    triangulate();
+    return false;
+}
+
+template<typename T, typename Storage>
+bool BasicDelaunator<T, Storage>::still_valid() const {
+    // every triangle keeps its orientation and none of them degenerates
+    for (std::size_t t = 0, size = triangles.size(); t < size; t += 3) {
+        const std::size_t i0 = triangles[t], i1 = triangles[t + 1], i2 = triangles[t + 2];
+        if (!orient(coords.x(i2), coords.y(i2),
+                    coords.x(i1), coords.y(i1),
+                    coords.x(i0), coords.y(i0))) {
+            return false;
+        }
+    }
+    // no reflex corner on the hull, so it is still the convex hull of all points
+    std::size_t e = hull_start;
+    do {
+        const std::size_t p = hull_prev[e], q = hull_next[e];
+        if (orient(coords.x(p), coords.y(p),
+                   coords.x(e), coords.y(e),
+                   coords.x(q), coords.y(q))) {
+            return false;
+        }
+        e = q;
+    } while (e != hull_start);
+    return true;
+}
+
+template<typename T, typename Storage>
+bool BasicDelaunator<T, Storage>::relegalize() {
+    // Lawson flips: sweep all interior edges until one pass makes no flip,
+    // give up and rebuild if rounding makes it cycle
+    const std::size_t max_passes = 16;
+    for (std::size_t pass = 0; pass < max_passes; pass++) {
+        const std::size_t flips = m_flips;
+        for (std::size_t e = 0, size = halfedges.size(); e < size; e++) {
+            if (halfedges[e] != INVALID_INDEX && e < halfedges[e]) {
+                legalize(e);
+            }
+        }
+        if (m_flips == flips) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template<typename T, typename Storage>
+void BasicDelaunator<T, Storage>::triangulate() {
+    triangles.clear();
+    halfedges.clear();
+    m_edge_stack.clear();
+    m_skipped = 0;
+
+    std::size_t n = coords.size();
 
     double max_x = std::numeric_limits<double>::min();
     double max_y = std::numeric_limits<double>::min();
     double min_x = std::numeric_limits<double>::max();
     double min_y = std::numeric_limits<double>::max();
-    std::vector<std::size_t> ids;
-    ids.reserve(n);
+    auto &ids = m_ids;
+    ids.clear();
 
     for (std::size_t i = 0; i < n; i++) {
-        const double x = coords[2 * i];
-        const double y = coords[2 * i + 1];
+        const double x = coords.x(i);
+        const double y = coords.y(i);
 
         if (x < min_x) min_x = x;
         if (y < min_y) min_y = y;
@@ -46,30 +148,30 @@ Delaunator::Delaunator(std::vector<double> const& in_coords)
 
     // pick a seed point close to the centroid
     for (std::size_t i = 0; i < n; i++) {
-        const double d = dist(cx, cy, coords[2 * i], coords[2 * i + 1]);
+        const double d = dist(cx, cy, coords.x(i), coords.y(i));
         if (d < min_dist) {
             i0 = i;
             min_dist = d;
         }
     }
 
-    const double i0x = coords[2 * i0];
-    const double i0y = coords[2 * i0 + 1];
+    const double i0x = coords.x(i0);
+    const double i0y = coords.y(i0);
 
     min_dist = std::numeric_limits<double>::max();
 
     // find the point closest to the seed
     for (std::size_t i = 0; i < n; i++) {
         if (i == i0) continue;
-        const double d = dist(i0x, i0y, coords[2 * i], coords[2 * i + 1]);
+        const double d = dist(i0x, i0y, coords.x(i), coords.y(i));
         if (d < min_dist && d > 0.0) {
             i1 = i;
             min_dist = d;
         }
     }
 
-    double i1x = coords[2 * i1];
-    double i1y = coords[2 * i1 + 1];
+    double i1x = coords.x(i1);
+    double i1y = coords.y(i1);
 
     double min_radius = std::numeric_limits<double>::max();
 
@@ -78,7 +180,7 @@ Delaunator::Delaunator(std::vector<double> const& in_coords)
         if (i == i0 || i == i1) continue;
 
         const double r = circumradius(
-            i0x, i0y, i1x, i1y, coords[2 * i], coords[2 * i + 1]);
+            i0x, i0y, i1x, i1y, coords.x(i), coords.y(i));
 
         if (r < min_radius) {
             i2 = i;
@@ -90,8 +192,8 @@ Delaunator::Delaunator(std::vector<double> const& in_coords)
         throw std::runtime_error("not triangulation");
     }
 
-    double i2x = coords[2 * i2];
-    double i2y = coords[2 * i2 + 1];
+    double i2x = coords.x(i2);
+    double i2y = coords.y(i2);
 
     if (orient(i0x, i0y, i1x, i1y, i2x, i2y)) {
         std::swap(i1, i2);
@@ -102,10 +204,16 @@ Delaunator::Delaunator(std::vector<double> const& in_coords)
     std::tie(m_center_x, m_center_y) = circumcenter(i0x, i0y, i1x, i1y, i2x, i2y);
 
     // sort the points by distance from the seed triangle circumcenter
-    std::sort(ids.begin(), ids.end(), compare{ coords, m_center_x, m_center_y });
+    if (use_key_sort) {
+        sort_by_keys();
+    } else {
+        std::sort(ids.begin(), ids.end(), compare<T>{ coords, m_center_x, m_center_y });
+    }
 
-    // initialize a hash table for storing edges of the advancing convex hull
-    m_hash_size = static_cast<std::size_t>(std::llround(std::ceil(std::sqrt(n))));
+    // initialize a hash table for storing edges of the advancing convex hull,
+    // power of two so probing is a mask instead of a division
+    m_hash_size = 1;
+    while (m_hash_size * m_hash_size < n) m_hash_size <<= 1;
     m_hash.resize(m_hash_size);
     std::fill(m_hash.begin(), m_hash.end(), INVALID_INDEX);
 
@@ -138,11 +246,16 @@ Delaunator::Delaunator(std::vector<double> const& in_coords)
     double yp = std::numeric_limits<double>::quiet_NaN();
     for (std::size_t k = 0; k < n; k++) {
         const std::size_t i = ids[k];
-        const double x = coords[2 * i];
-        const double y = coords[2 * i + 1];
+        const double x = coords.x(i);
+        const double y = coords.y(i);
+
+        const bool seed = i == i0 || i == i1 || i == i2;
 
         // skip near-duplicate points
-        if (k > 0 && check_pts_equal(x, y, xp, yp)) continue;
+        if (k > 0 && check_pts_equal(x, y, xp, yp)) {
+            if (!seed) m_skipped++;
+            continue;
+        }
         xp = x;
         yp = y;
 
@@ -150,14 +263,17 @@ Delaunator::Delaunator(std::vector<double> const& in_coords)
         if (
             check_pts_equal(x, y, i0x, i0y) ||
             check_pts_equal(x, y, i1x, i1y) ||
-            check_pts_equal(x, y, i2x, i2y)) continue;
+            check_pts_equal(x, y, i2x, i2y)) {
+            if (!seed) m_skipped++;
+            continue;
+        }
 
         // find a visible edge on the convex hull using edge hash
         std::size_t start = 0;
 
         size_t key = hash_key(x, y);
         for (size_t j = 0; j < m_hash_size; j++) {
-            start = m_hash[fast_mod(key + j, m_hash_size)];
+            start = m_hash[(key + j) & (m_hash_size - 1)];
             if (start != INVALID_INDEX && start != hull_next[start]) break;
         }
 
@@ -165,7 +281,7 @@ Delaunator::Delaunator(std::vector<double> const& in_coords)
         size_t e = start;
         size_t q;
 
-        while (q = hull_next[e], !orient(x, y, coords[2 * e], coords[2 * e + 1], coords[2 * q], coords[2 * q + 1])) { //TODO: does it works in a same way as in JS
+        while (q = hull_next[e], !orient(x, y, coords.x(e), coords.y(e), coords.x(q), coords.y(q))) { //TODO: does it works in a same way as in JS
             e = q;
             if (e == start) {
                 e = INVALID_INDEX;
@@ -173,7 +289,10 @@ Delaunator::Delaunator(std::vector<double> const& in_coords)
             }
         }
 
-        if (e == INVALID_INDEX) continue; // likely a near-duplicate point; skip it
+        if (e == INVALID_INDEX) { // likely a near-duplicate point; skip it
+            m_skipped++;
+            continue;
+        }
 
         // add the first triangle from the point
         std::size_t t = add_triangle(
@@ -192,7 +311,7 @@ Delaunator::Delaunator(std::vector<double> const& in_coords)
         std::size_t next = hull_next[e];
         while (
             q = hull_next[next],
-            orient(x, y, coords[2 * next], coords[2 * next + 1], coords[2 * q], coords[2 * q + 1])) {
+            orient(x, y, coords.x(next), coords.y(next), coords.x(q), coords.y(q))) {
             t = add_triangle(next, i, q, hull_tri[i], INVALID_INDEX, hull_tri[next]);
             hull_tri[i] = legalize(t + 2);
             hull_next[next] = next; // mark as removed
@@ -204,7 +323,7 @@ Delaunator::Delaunator(std::vector<double> const& in_coords)
         if (e == start) {
             while (
                 q = hull_prev[e],
-                orient(x, y, coords[2 * q], coords[2 * q + 1], coords[2 * e], coords[2 * e + 1])) {
+                orient(x, y, coords.x(q), coords.y(q), coords.x(e), coords.y(e))) {
                 t = add_triangle(q, i, e, INVALID_INDEX, hull_tri[e], hull_tri[q]);
                 legalize(t + 2);
                 hull_tri[q] = t;
@@ -222,21 +341,23 @@ Delaunator::Delaunator(std::vector<double> const& in_coords)
         hull_next[i] = next;
 
         m_hash[hash_key(x, y)] = i;
-        m_hash[hash_key(coords[2 * e], coords[2 * e + 1])] = e;
+        m_hash[hash_key(coords.x(e), coords.y(e))] = e;
     }
 }
 
-double Delaunator::get_hull_area() {
+template<typename T, typename Storage>
+double BasicDelaunator<T, Storage>::get_hull_area() {
     std::vector<double> hull_area;
     size_t e = hull_start;
     do {
-        hull_area.push_back((coords[2 * e] - coords[2 * hull_prev[e]]) * (coords[2 * e + 1] + coords[2 * hull_prev[e] + 1]));
+        hull_area.push_back((coords.x(e) - coords.x(hull_prev[e])) * (coords.y(e) + coords.y(hull_prev[e])));
         e = hull_next[e];
     } while (e != hull_start);
     return sum(hull_area);
 }
 
-std::size_t Delaunator::legalize(std::size_t a) {
+template<typename T, typename Storage>
+std::size_t BasicDelaunator<T, Storage>::legalize(std::size_t a) {
     std::size_t i = 0;
     std::size_t ar = 0;
     m_edge_stack.clear();
@@ -284,16 +405,17 @@ std::size_t Delaunator::legalize(std::size_t a) {
         const std::size_t p1 = triangles[bl];
 
         const bool illegal = in_circle(
-            coords[2 * p0],
-            coords[2 * p0 + 1],
-            coords[2 * pr],
-            coords[2 * pr + 1],
-            coords[2 * pl],
-            coords[2 * pl + 1],
-            coords[2 * p1],
-            coords[2 * p1 + 1]);
+            coords.x(p0),
+            coords.y(p0),
+            coords.x(pr),
+            coords.y(pr),
+            coords.x(pl),
+            coords.y(pl),
+            coords.x(p1),
+            coords.y(p1));
 
         if (illegal) {
+            m_flips++;
             triangles[a] = p1;
             triangles[b] = p0;
 
@@ -335,15 +457,101 @@ std::size_t Delaunator::legalize(std::size_t a) {
     return ar;
 }
 
-inline std::size_t Delaunator::hash_key(const double x, const double y) const {
+template<typename T, typename Storage>
+void BasicDelaunator<T, Storage>::sort_by_keys() {
+    const std::size_t n = coords.size();
+    auto &items = m_sort_items;
+    items.resize(n);
+    const std::size_t chunks = n >= PARALLEL_SORT_MIN ? std::max<std::size_t>(sort_threads, 1) : 1;
+    // dist() >= 0, and the bits of a non-negative double are ordered like its value
+    for_chunks(n, chunks, [&](std::size_t, std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; i++) {
+            const double d = dist(coords.x(i), coords.y(i), m_center_x, m_center_y);
+            std::uint64_t key;
+            std::memcpy(&key, &d, sizeof(key));
+            items[i] = SortItem{ key, i };
+        }
+    });
+
+    auto by_key = [](const SortItem& a, const SortItem& b) { return a.key < b.key; };
+    if (n < RADIX_SORT_MIN) {
+        std::sort(items.begin(), items.end(), by_key);
+    } else {
+        // LSD radix sort, 11-bit digits, digits where every key agrees are skipped.
+        // Every chunk counts its own range, bucket b of chunk c is placed after bucket b of
+        // the chunks before it, so the scatter stays stable and matches the serial order
+        auto &tmp = m_sort_tmp;
+        tmp.resize(n);
+        SortItem *src = items.data(), *dst = tmp.data();
+        std::size_t local[RADIX_SIZE];
+        std::size_t *counts = local;
+        if (chunks > 1) {
+            m_sort_counts.resize(chunks * RADIX_SIZE);
+            counts = m_sort_counts.data();
+        }
+        for (int shift = 0; shift < 64; shift += RADIX_BITS) {
+            for_chunks(n, chunks, [&](std::size_t c, std::size_t begin, std::size_t end) {
+                std::size_t *count = counts + c * RADIX_SIZE;
+                std::fill(count, count + RADIX_SIZE, 0);
+                for (std::size_t i = begin; i < end; i++) {
+                    count[(src[i].key >> shift) & (RADIX_SIZE - 1)]++;
+                }
+            });
+            const std::size_t first = (src[0].key >> shift) & (RADIX_SIZE - 1);
+            std::size_t same = 0;
+            for (std::size_t c = 0; c < chunks; c++) {
+                same += counts[c * RADIX_SIZE + first];
+            }
+            if (same == n) continue;
+            std::size_t offset = 0;
+            for (std::size_t b = 0; b < RADIX_SIZE; b++) {
+                for (std::size_t c = 0; c < chunks; c++) {
+                    const std::size_t count = counts[c * RADIX_SIZE + b];
+                    counts[c * RADIX_SIZE + b] = offset;
+                    offset += count;
+                }
+            }
+            for_chunks(n, chunks, [&](std::size_t c, std::size_t begin, std::size_t end) {
+                std::size_t *count = counts + c * RADIX_SIZE;
+                for (std::size_t i = begin; i < end; i++) {
+                    dst[count[(src[i].key >> shift) & (RADIX_SIZE - 1)]++] = src[i];
+                }
+            });
+            std::swap(src, dst);
+        }
+        if (src != items.data()) {
+            std::copy(src, src + n, items.data());
+        }
+    }
+
+    // same tie-break as compare: x, then y
+    for (std::size_t k = 0; k < n;) {
+        std::size_t end = k + 1;
+        while (end < n && items[end].key == items[k].key) end++;
+        if (end - k > 1) {
+            std::sort(items.begin() + k, items.begin() + end, [this](const SortItem& a, const SortItem& b) {
+                const double dx = coords.x(a.id) - coords.x(b.id);
+                if (dx > 0.0 || dx < 0.0) return dx < 0;
+                return coords.y(a.id) < coords.y(b.id);
+            });
+        }
+        k = end;
+    }
+    for (std::size_t k = 0; k < n; k++) {
+        m_ids[k] = items[k].id;
+    }
+}
+
+template<typename T, typename Storage>
+inline std::size_t BasicDelaunator<T, Storage>::hash_key(const double x, const double y) const {
     const double dx = x - m_center_x;
     const double dy = y - m_center_y;
-    return fast_mod(
-        static_cast<std::size_t>(std::llround(std::floor(pseudo_angle(dx, dy) * static_cast<double>(m_hash_size)))),
-        m_hash_size);
+    return static_cast<std::size_t>(std::llround(std::floor(pseudo_angle(dx, dy) * static_cast<double>(m_hash_size))))
+        & (m_hash_size - 1);
 }
 
-std::size_t Delaunator::add_triangle(
+template<typename T, typename Storage>
+std::size_t BasicDelaunator<T, Storage>::add_triangle(
     std::size_t i0,
     std::size_t i1,
     std::size_t i2,
@@ -360,7 +568,8 @@ std::size_t Delaunator::add_triangle(
     return t;
 }
 
-void Delaunator::link(const std::size_t a, const std::size_t b) {
+template<typename T, typename Storage>
+void BasicDelaunator<T, Storage>::link(const std::size_t a, const std::size_t b) {
     std::size_t s = halfedges.size();
     if (a == s) {
         halfedges.push_back(b);
@@ -381,4 +590,9 @@ void Delaunator::link(const std::size_t a, const std::size_t b) {
     }
 }
 
+template class BasicDelaunator<double>;
+template class BasicDelaunator<float>;
+template class BasicDelaunator<double, FixedStorage<SMALL_MAX_POINTS>>;
+template class BasicDelaunator<float, FixedStorage<SMALL_MAX_POINTS>>;
+
 } //namespace delaunator
@@ -2,10 +2,12 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <exception>
 #include <iostream>
 #include <limits>
 #include <memory>
+#include <stdexcept>
 #include <utility>
 #include <vector>
 
@@ -98,18 +100,51 @@ inline std::pair<double, double> circumcenter(
     return std::make_pair(x, y);
 }
 
+/**
+ * Read-only view of interleaved 2D points: point i is (data[i * stride], data[i * stride + 1]).
+ * Coordinates are promoted to double on read, so the predicates stay the same for float input.
+ */
+template<typename T>
+struct StridedSpan {
+    const T* data;
+    std::size_t count;
+    std::size_t stride;
+
+    StridedSpan() : data(nullptr), count(0), stride(2) {}
+
+    StridedSpan(const T* in_data, std::size_t in_count, std::size_t in_stride = 2)
+        : data(in_data), count(in_count), stride(in_stride) {}
+
+    // x0, y0, x1, y1, ...
+    StridedSpan(std::vector<T> const& in_coords)
+        : data(in_coords.data()), count(in_coords.size() >> 1), stride(2) {}
+
+    inline std::size_t size() const {
+        return count;
+    }
+
+    inline double x(std::size_t i) const {
+        return static_cast<double>(data[i * stride]);
+    }
+
+    inline double y(std::size_t i) const {
+        return static_cast<double>(data[i * stride + 1]);
+    }
+};
+
+template<typename T>
 struct compare {
 
-    std::vector<double> const& coords;
+    StridedSpan<T> const& coords;
     double cx;
     double cy;
 
     bool operator()(std::size_t i, std::size_t j) {
-        const double d1 = dist(coords[2 * i], coords[2 * i + 1], cx, cy);
-        const double d2 = dist(coords[2 * j], coords[2 * j + 1], cx, cy);
+        const double d1 = dist(coords.x(i), coords.y(i), cx, cy);
+        const double d2 = dist(coords.x(j), coords.y(j), cx, cy);
         const double diff1 = d1 - d2;
-        const double diff2 = coords[2 * i] - coords[2 * j];
-        const double diff3 = coords[2 * i + 1] - coords[2 * j + 1];
+        const double diff2 = coords.x(i) - coords.x(j);
+        const double diff3 = coords.y(i) - coords.y(j);
 
         if (diff1 > 0.0 || diff1 < 0.0) {
             return diff1 < 0;
@@ -170,28 +205,144 @@ struct DelaunatorPoint {
     bool removed;
 };
 
-class Delaunator {
+/**
+ * std::vector-like buffer with a fixed capacity and no heap allocation,
+ * only the operations used by BasicDelaunator
+ */
+template<typename V, std::size_t N>
+class FixedVector {
+public:
+    inline std::size_t size() const { return m_size; }
+    inline bool empty() const { return m_size == 0; }
+    inline V* data() { return m_data; }
+    inline const V* data() const { return m_data; }
+    inline V* begin() { return m_data; }
+    inline V* end() { return m_data + m_size; }
+    inline const V* begin() const { return m_data; }
+    inline const V* end() const { return m_data + m_size; }
+    inline V& operator[](std::size_t i) { return m_data[i]; }
+    inline const V& operator[](std::size_t i) const { return m_data[i]; }
+
+    inline void clear() { m_size = 0; }
+
+    inline void reserve(std::size_t n) {
+        check(n);
+    }
+
+    inline void resize(std::size_t n) {
+        check(n);
+        m_size = n;
+    }
+
+    inline void push_back(const V& v) {
+        check(m_size + 1);
+        m_data[m_size++] = v;
+    }
+
+private:
+    static inline void check(std::size_t n) {
+        if (n > N) {
+            throw std::runtime_error("FixedVector: capacity exceeded");
+        }
+    }
+
+    V m_data[N];
+    std::size_t m_size = 0;
+};
+
+// buffers on the heap, any number of points
+struct HeapStorage {
+    template<typename V> using point_vector = std::vector<V>;
+    template<typename V> using edge_vector = std::vector<V>;
+};
+
+// fixed-size buffers inside the object for at most N points
+template<std::size_t N>
+struct FixedStorage {
+    template<typename V> using point_vector = FixedVector<V, N>;
+    template<typename V> using edge_vector = FixedVector<V, 3 * (2 * N - 5)>;
+};
+
+template<typename T, typename Storage = HeapStorage>
+class BasicDelaunator {
 
 public:
-    std::vector<double> const& coords;
-    std::vector<std::size_t> triangles;
-    std::vector<std::size_t> halfedges;
-    std::vector<std::size_t> hull_prev;
-    std::vector<std::size_t> hull_next;
-    std::vector<std::size_t> hull_tri;
+    // view of the points passed to the last update(), the caller owns them;
+    // get_hull_area() and TriangleLocator::build(dela) read it, so those need the points alive
+    StridedSpan<T> coords;
+    typename Storage::template edge_vector<std::size_t> triangles;
+    typename Storage::template edge_vector<std::size_t> halfedges;
+    typename Storage::template point_vector<std::size_t> hull_prev;
+    typename Storage::template point_vector<std::size_t> hull_next;
+    typename Storage::template point_vector<std::size_t> hull_tri;
     std::size_t hull_start;
 
-    Delaunator(std::vector<double> const& in_coords);
+    // false: sort with the compare functor like the original implementation, kept for benchmarks
+    bool use_key_sort = true;
+
+    // threads for the key pass and the radix passes of inputs with at least PARALLEL_SORT_MIN points,
+    // every chunk keeps its own histogram so the order is the same for any count.
+    // opt-in, 1 (serial) by default: the face meshes stay far below PARALLEL_SORT_MIN,
+    // only DelaunatorBench --threads sets it
+    std::size_t sort_threads = 1;
+
+    BasicDelaunator();
+
+    BasicDelaunator(StridedSpan<T> in_coords);
+
+    /**
+     * Re-triangulate in_coords, keeping the capacity of every buffer.
+     * If the point count is unchanged, the previous build placed every point
+     * and the previous triangulation is still valid
+     * for the new positions (no inverted or degenerate triangle, no reflex hull corner),
+     * only the edges that lost the Delaunay property are flipped (see legalize),
+     * otherwise the triangulation is rebuilt from scratch.
+     * @return true if the previous topology was reused
+     */
+    bool update(StridedSpan<T> in_coords);
+
+    // number of edge flips done by the last incremental update
+    inline std::size_t last_flips() const {
+        return m_flips;
+    }
 
+    // points the last full build left out of every triangle as near-duplicates
+    inline std::size_t skipped_points() const {
+        return m_skipped;
+    }
+
+    // uses coords, call it before the points go away
     double get_hull_area();
 
 private:
-    std::vector<std::size_t> m_hash;
+    typename Storage::template point_vector<std::size_t> m_hash;
     double m_center_x;
     double m_center_y;
     std::size_t m_hash_size;
-    std::vector<std::size_t> m_edge_stack;
-
+    typename Storage::template edge_vector<std::size_t> m_edge_stack;
+    typename Storage::template point_vector<std::size_t> m_ids;
+    std::size_t m_flips;
+    std::size_t m_points;
+    std::size_t m_skipped;
+
+    // distance keys computed once, radix sorted for large inputs
+    struct SortItem {
+        std::uint64_t key;
+        std::size_t id;
+    };
+    static constexpr std::size_t RADIX_SORT_MIN = 2048;
+    static constexpr int RADIX_BITS = 11;
+    static constexpr std::size_t RADIX_SIZE = std::size_t(1) << RADIX_BITS;
+    static constexpr std::size_t PARALLEL_SORT_MIN = std::size_t(1) << 16;
+    typename Storage::template point_vector<SortItem> m_sort_items;
+    typename Storage::template point_vector<SortItem> m_sort_tmp;
+    // per thread histograms, only used when sorting in parallel
+    std::vector<std::size_t> m_sort_counts;
+
+    void triangulate();
+    void sort_by_keys();
+    bool still_valid() const;
+    bool relegalize();
     std::size_t legalize(std::size_t a);
     std::size_t hash_key(double x, double y) const;
     std::size_t add_triangle(
@@ -204,4 +355,17 @@ private:
     void link(std::size_t a, std::size_t b);
 };
 
+// landmark-sized inputs, no heap allocation at all
+constexpr std::size_t SMALL_MAX_POINTS = 300;
+
+using Delaunator = BasicDelaunator<double>;
+
+template<typename T>
+using SmallDelaunator = BasicDelaunator<T, FixedStorage<SMALL_MAX_POINTS>>;
+
+extern template class BasicDelaunator<double>;
+extern template class BasicDelaunator<float>;
+extern template class BasicDelaunator<double, FixedStorage<SMALL_MAX_POINTS>>;
+extern template class BasicDelaunator<float, FixedStorage<SMALL_MAX_POINTS>>;
+
 } //namespace delaunator
@@ -0,0 +1,94 @@
+//
+// Created by LiangKeJin on 2024/8/20.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+/**
+ * 非加密的 64 位哈希，结构和 xxHash64 相同: 4 路并行的乘法-循环移位，每周期处理 32 字节，
+ * 用于图像内容这类大块数据的去重，不能用于安全场景
+ */
+class HashUtils {
+public:
+    static uint64_t hash64(const void *data, size_t size, uint64_t seed = 0) {
+        const uint8_t *p = (const uint8_t *) data;
+        const uint8_t *end = p + size;
+        uint64_t h;
+        if (size >= 32) {
+            uint64_t v1 = seed + P1 + P2, v2 = seed + P2, v3 = seed, v4 = seed - P1;
+            const uint8_t *limit = end - 32;
+            do {
+                v1 = round(v1, read64(p));
+                v2 = round(v2, read64(p + 8));
+                v3 = round(v3, read64(p + 16));
+                v4 = round(v4, read64(p + 24));
+                p += 32;
+            } while (p <= limit);
+            h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+            h = merge(h, v1);
+            h = merge(h, v2);
+            h = merge(h, v3);
+            h = merge(h, v4);
+        } else {
+            h = seed + P5;
+        }
+        h += (uint64_t) size;
+        for (; p + 8 <= end; p += 8) {
+            h ^= round(0, read64(p));
+            h = rotl(h, 27) * P1 + P4;
+        }
+        for (; p < end; ++p) {
+            h ^= (*p) * P5;
+            h = rotl(h, 11) * P1;
+        }
+        return avalanche(h);
+    }
+
+    /**
+     * 把 v 合并到已有的哈希 h
+     */
+    static inline uint64_t combine(uint64_t h, uint64_t v) {
+        return avalanche(h ^ round(P3, v));
+    }
+
+private:
+    static inline uint64_t read64(const uint8_t *p) {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    static inline uint64_t rotl(uint64_t x, int r) {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    static inline uint64_t round(uint64_t acc, uint64_t v) {
+        acc += v * P2;
+        acc = rotl(acc, 31);
+        return acc * P1;
+    }
+
+    static inline uint64_t merge(uint64_t acc, uint64_t v) {
+        acc ^= round(0, v);
+        return acc * P1 + P4;
+    }
+
+    static inline uint64_t avalanche(uint64_t h) {
+        h ^= h >> 33;
+        h *= P2;
+        h ^= h >> 29;
+        h *= P3;
+        h ^= h >> 32;
+        return h;
+    }
+
+private:
+    static constexpr uint64_t P1 = 0x9E3779B185EBCA87ULL;
+    static constexpr uint64_t P2 = 0xC2B2AE3D27D4EB4FULL;
+    static constexpr uint64_t P3 = 0x165667B19E3779F9ULL;
+    static constexpr uint64_t P4 = 0x85EBCA77C2B2AE63ULL;
+    static constexpr uint64_t P5 = 0x27D4EB2F165667C5ULL;
+};
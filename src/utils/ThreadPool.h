@@ -0,0 +1,213 @@
+//
+// Created by LiangKeJin on 2024/8/10.
+//
+
+#pragma once
+
+#include <Playground.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+NAMESPACE_WUTA
+
+/**
+ * 固定线程数的工作线程池
+ * post() 投递普通任务，parallelFor() 把一个区间分给工作线程和调用线程一起执行
+ */
+class ThreadPool {
+public:
+    typedef std::function<void()> Task;
+
+    /**
+     * @param threads 工作线程数，<= 0 时使用 CPU 核心数
+     */
+    explicit ThreadPool(int threads = 0, const char *name = "_thread_pool") : m_name(name) {
+        if (threads <= 0) {
+            threads = (int) std::thread::hardware_concurrency();
+        }
+        threads = std::max(1, threads);
+        for (int i = 0; i < threads; ++i) {
+            m_workers.emplace_back(&ThreadPool::threadLoop, this);
+        }
+    }
+
+    ~ThreadPool() { quit(); }
+
+    inline int size() const { return (int) m_workers.size(); }
+
+    void post(const Task &task) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            _WARN_RETURN_IF(m_quit, void(), "thread pool(%s) has quit, failed to post!", m_name.c_str());
+            m_tasks.push_back(task);
+        }
+        m_cond.notify_one();
+    }
+
+    /**
+     * 并行执行 func(0) ... func(count-1)，返回时所有调用都已结束
+     * 调用线程本身也会领取任务，所以在工作线程里嵌套调用也不会死锁
+     * func 以指针的形式交给工作线程，batch 在调用线程的栈上，整个调用没有堆分配
+     */
+    template<typename Func>
+    void parallelFor(int count, Func &&func) {
+        if (count <= 0) {
+            return;
+        }
+        int helpers = std::min(size(), count - 1);
+        if (helpers <= 0) {
+            for (int i = 0; i < count; ++i) {
+                func(i);
+            }
+            return;
+        }
+
+        typedef typename std::remove_reference<Func>::type F;
+        Batch batch(count, helpers, &Batch::invoke<F>, (void *) &func);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            Batch **tail = &m_batches;
+            while (*tail) {
+                tail = &(*tail)->link;
+            }
+            *tail = &batch;
+        }
+        m_cond.notify_all();
+
+        batch.run();
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        // 还没被工作线程领走的分片直接撤回，只等待已经开始执行的
+        if (batch.helpers > 0) {
+            unlink(&batch);
+        }
+        batch.cond.wait(lock, [&batch]() { return batch.running == 0; });
+        lock.unlock();
+
+        if (batch.error) {
+            std::rethrow_exception(batch.error);
+        }
+    }
+
+    void quit() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_quit) {
+                return;
+            }
+            m_quit = true;
+        }
+        m_cond.notify_all();
+        for (auto &worker : m_workers) {
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+    }
+
+private:
+    struct Batch {
+        typedef void (*Invoke)(void *func, int i);
+
+        Batch(int c, int h, Invoke invoke, void *f) : count(c), helpers(h), call(invoke), func(f) {}
+
+        template<typename F>
+        static void invoke(void *func, int i) {
+            (*(F *) func)(i);
+        }
+
+        void run() {
+            int i;
+            while ((i = next.fetch_add(1)) < count) {
+                try {
+                    call(func, i);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(error_mutex);
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+                }
+            }
+        }
+
+        const int count;
+        std::atomic<int> next{0};
+
+        // 以下字段由 ThreadPool::m_mutex 保护
+        // helpers 为还可以被工作线程领取的次数，减到 0 时从 m_batches 中移除
+        int helpers;
+        int running = 0;
+        Batch *link = nullptr;
+        std::condition_variable cond;
+
+        const Invoke call;
+        void *const func;
+
+        std::mutex error_mutex;
+        std::exception_ptr error;
+    };
+
+    void unlink(Batch *batch) {
+        for (Batch **p = &m_batches; *p; p = &(*p)->link) {
+            if (*p == batch) {
+                *p = batch->link;
+                return;
+            }
+        }
+    }
+
+    void threadLoop() {
+        while (true) {
+            Task task;
+            Batch *batch = nullptr;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cond.wait(lock, [this]() { return m_quit || m_batches || !m_tasks.empty(); });
+                if (m_batches) {
+                    batch = m_batches;
+                    batch->running += 1;
+                    batch->helpers -= 1;
+                    if (batch->helpers == 0) {
+                        m_batches = batch->link;
+                    }
+                } else if (!m_tasks.empty()) {
+                    task = std::move(m_tasks.front());
+                    m_tasks.pop_front();
+                } else {
+                    break;
+                }
+            }
+
+            if (batch) {
+                batch->run();
+                std::lock_guard<std::mutex> lock(m_mutex);
+                batch->running -= 1;
+                // 持锁通知，调用线程醒来之后 batch 就会被销毁
+                batch->cond.notify_all();
+            } else if (task) {
+                task();
+            }
+        }
+    }
+
+private:
+    std::string m_name;
+    std::vector<std::thread> m_workers;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<Task> m_tasks;
+    // parallelFor 中还有分片可领取的 batch，按投递顺序链接
+    Batch *m_batches = nullptr;
+    bool m_quit = false;
+};
+
+NAMESPACE_END
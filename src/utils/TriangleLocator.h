@@ -0,0 +1,271 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "Delaunator.h"
+
+namespace delaunator {
+
+/**
+ * A located point: triangle index t (vertices triangles[3t], [3t + 1], [3t + 2])
+ * and its barycentric weights for those three vertices.
+ */
+struct TriangleLocation {
+    std::size_t triangle = INVALID_INDEX;
+    double b0 = 0;
+    double b1 = 0;
+    double b2 = 0;
+
+    inline bool found() const {
+        return triangle != INVALID_INDEX;
+    }
+};
+
+/**
+ * Point location on a triangulation with halfedges (Delaunator output).
+ * A uniform grid stores one seed triangle per cell, then a visibility walk across halfedges
+ * reaches the containing triangle. The walk starts from the previous hit when it is closer,
+ * so queries along a scanline cost amortized O(1).
+ * The walk always terminates on a Delaunay triangulation; for anything else it is bounded
+ * and falls back to a linear scan.
+ */
+class TriangleLocator {
+public:
+    /**
+     * Copies the points (promoted to double), triangles and halfedges,
+     * the triangulation may be updated afterwards without affecting the locator.
+     */
+    template<typename T>
+    void build(StridedSpan<T> coords, const std::size_t* triangles, const std::size_t* halfedges,
+               std::size_t triangle_count) {
+        const std::size_t n = coords.size();
+        m_points.resize(n * 2);
+        for (std::size_t i = 0; i < n; i++) {
+            m_points[2 * i] = coords.x(i);
+            m_points[2 * i + 1] = coords.y(i);
+        }
+        m_triangles.assign(triangles, triangles + triangle_count * 3);
+        m_halfedges.assign(halfedges, halfedges + triangle_count * 3);
+        m_last = INVALID_INDEX;
+        build_grid();
+    }
+
+    /**
+     * Reads dela.coords, so the points passed to the last dela.update() must still be alive
+     */
+    template<typename D>
+    void build(const D& dela) {
+        build(dela.coords, dela.triangles.data(), dela.halfedges.data(), dela.triangles.size() / 3);
+    }
+
+    inline std::size_t triangle_count() const {
+        return m_triangles.size() / 3;
+    }
+
+    /**
+     * @return false if (x, y) is outside the triangulation
+     */
+    bool locate(double x, double y, TriangleLocation& out) {
+        out = TriangleLocation();
+        if (m_triangles.empty()) {
+            return false;
+        }
+        std::size_t seed = m_grid[cell_index(x, y)];
+        if (m_last != INVALID_INDEX && m_last != seed) {
+            // closer start: the previous hit is usually the neighbour of the answer
+            const double dl = centroid_dist(m_last, x, y);
+            const double ds = centroid_dist(seed, x, y);
+            if (dl < ds) {
+                seed = m_last;
+            }
+        }
+        return locate_from(seed, x, y, out);
+    }
+
+    /**
+     * Locate count points of a scanline: (x0 + i * dx, y), i = 0 .. count - 1
+     * only the first point uses the grid, the others walk from the previous hit
+     * @return number of points found inside the triangulation
+     */
+    std::size_t locate_row(double y, double x0, double dx, std::size_t count, TriangleLocation* out) {
+        std::size_t found = 0;
+        for (std::size_t i = 0; i < count; i++) {
+            const double x = x0 + dx * static_cast<double>(i);
+            bool hit;
+            if (i == 0 || !out[i - 1].found()) {
+                hit = locate(x, y, out[i]);
+            } else {
+                out[i] = TriangleLocation();
+                hit = locate_from(out[i - 1].triangle, x, y, out[i]);
+            }
+            found += hit ? 1 : 0;
+        }
+        return found;
+    }
+
+    /**
+     * Locate count interleaved points xy[2i], xy[2i + 1]
+     */
+    template<typename T>
+    std::size_t locate_points(const T* xy, std::size_t count, TriangleLocation* out) {
+        std::size_t found = 0;
+        for (std::size_t i = 0; i < count; i++) {
+            found += locate(static_cast<double>(xy[2 * i]), static_cast<double>(xy[2 * i + 1]), out[i]) ? 1 : 0;
+        }
+        return found;
+    }
+
+private:
+    bool locate_from(std::size_t seed, double x, double y, TriangleLocation& out) {
+        std::size_t t = walk(seed, x, y);
+        if (t == WALK_FAILED) {
+            t = scan(x, y);
+        }
+        if (t == INVALID_INDEX) {
+            return false;
+        }
+        m_last = t;
+        barycentric(t, x, y, out);
+        return true;
+    }
+
+    static constexpr std::size_t WALK_FAILED = INVALID_INDEX - 1;
+
+    inline double px(std::size_t i) const { return m_points[2 * i]; }
+    inline double py(std::size_t i) const { return m_points[2 * i + 1]; }
+
+    // twice the signed area of (a, b, p), times the orientation of the triangulation
+    inline double side(std::size_t a, std::size_t b, double x, double y) const {
+        return ((px(b) - px(a)) * (y - py(a)) - (py(b) - py(a)) * (x - px(a))) * m_orientation;
+    }
+
+    inline double centroid_dist(std::size_t t, double x, double y) const {
+        const std::size_t a = m_triangles[3 * t], b = m_triangles[3 * t + 1], c = m_triangles[3 * t + 2];
+        const double cx = (px(a) + px(b) + px(c)) / 3.0;
+        const double cy = (py(a) + py(b) + py(c)) / 3.0;
+        return dist(cx, cy, x, y);
+    }
+
+    inline std::size_t cell_index(double x, double y) const {
+        long cx = static_cast<long>(std::floor((x - m_min_x) * m_inv_cell));
+        long cy = static_cast<long>(std::floor((y - m_min_y) * m_inv_cell));
+        cx = std::min(std::max(cx, 0L), static_cast<long>(m_cols) - 1);
+        cy = std::min(std::max(cy, 0L), static_cast<long>(m_rows) - 1);
+        return static_cast<std::size_t>(cy) * m_cols + static_cast<std::size_t>(cx);
+    }
+
+    void build_grid() {
+        const std::size_t tri_count = triangle_count();
+        m_grid.clear();
+        if (tri_count == 0) {
+            return;
+        }
+        const std::size_t a = m_triangles[0], b = m_triangles[1], c = m_triangles[2];
+        m_orientation = 1.0;
+        m_orientation = side(a, b, px(c), py(c)) < 0 ? -1.0 : 1.0;
+
+        double min_x = std::numeric_limits<double>::max(), min_y = min_x;
+        double max_x = std::numeric_limits<double>::lowest(), max_y = max_x;
+        for (std::size_t v : m_triangles) {
+            min_x = std::min(min_x, px(v));
+            min_y = std::min(min_y, py(v));
+            max_x = std::max(max_x, px(v));
+            max_y = std::max(max_y, py(v));
+        }
+        // about two triangles per cell
+        const double w = std::max(max_x - min_x, EPSILON), h = std::max(max_y - min_y, EPSILON);
+        const double cell = std::sqrt(w * h * 2.0 / static_cast<double>(tri_count));
+        m_min_x = min_x;
+        m_min_y = min_y;
+        m_inv_cell = 1.0 / cell;
+        m_cols = std::max<std::size_t>(1, static_cast<std::size_t>(std::ceil(w / cell)));
+        m_rows = std::max<std::size_t>(1, static_cast<std::size_t>(std::ceil(h / cell)));
+        m_grid.assign(m_cols * m_rows, INVALID_INDEX);
+
+        for (std::size_t t = 0; t < tri_count; t++) {
+            const std::size_t i0 = m_triangles[3 * t], i1 = m_triangles[3 * t + 1], i2 = m_triangles[3 * t + 2];
+            m_grid[cell_index((px(i0) + px(i1) + px(i2)) / 3.0, (py(i0) + py(i1) + py(i2)) / 3.0)] = t;
+        }
+        // empty cells take the seed of the previous non-empty cell in scan order, then the next one
+        std::size_t seed = INVALID_INDEX;
+        for (std::size_t& s : m_grid) {
+            if (s == INVALID_INDEX) s = seed; else seed = s;
+        }
+        seed = INVALID_INDEX;
+        for (std::size_t i = m_grid.size(); i-- > 0;) {
+            if (m_grid[i] == INVALID_INDEX) m_grid[i] = seed; else seed = m_grid[i];
+        }
+    }
+
+    /**
+     * @return the containing triangle, INVALID_INDEX if the point is outside the hull,
+     *         WALK_FAILED if the walk did not converge
+     */
+    std::size_t walk(std::size_t t, double x, double y) const {
+        const std::size_t max_steps = triangle_count() + 3;
+        for (std::size_t step = 0; step < max_steps; step++) {
+            std::size_t exit = INVALID_INDEX;
+            for (std::size_t k = 0; k < 3; k++) {
+                const std::size_t e = 3 * t + k;
+                const std::size_t next = 3 * t + (k + 1) % 3;
+                if (side(m_triangles[e], m_triangles[next], x, y) < 0) {
+                    exit = e;
+                    break;
+                }
+            }
+            if (exit == INVALID_INDEX) {
+                return t;
+            }
+            const std::size_t opposite = m_halfedges[exit];
+            if (opposite == INVALID_INDEX) {
+                // crossed a hull edge, the hull is convex so the point is outside
+                return INVALID_INDEX;
+            }
+            t = opposite / 3;
+        }
+        return WALK_FAILED;
+    }
+
+    std::size_t scan(double x, double y) const {
+        for (std::size_t t = 0, size = triangle_count(); t < size; t++) {
+            if (side(m_triangles[3 * t], m_triangles[3 * t + 1], x, y) >= 0 &&
+                side(m_triangles[3 * t + 1], m_triangles[3 * t + 2], x, y) >= 0 &&
+                side(m_triangles[3 * t + 2], m_triangles[3 * t], x, y) >= 0) {
+                return t;
+            }
+        }
+        return INVALID_INDEX;
+    }
+
+    void barycentric(std::size_t t, double x, double y, TriangleLocation& out) const {
+        const std::size_t a = m_triangles[3 * t], b = m_triangles[3 * t + 1], c = m_triangles[3 * t + 2];
+        const double area = side(a, b, px(c), py(c));
+        out.triangle = t;
+        if (area <= 0) {
+            out.b0 = 1;
+            out.b1 = out.b2 = 0;
+            return;
+        }
+        out.b0 = side(b, c, x, y) / area;
+        out.b1 = side(c, a, x, y) / area;
+        out.b2 = 1.0 - out.b0 - out.b1;
+    }
+
+private:
+    std::vector<double> m_points;
+    std::vector<std::size_t> m_triangles;
+    std::vector<std::size_t> m_halfedges;
+
+    double m_orientation = 1.0;
+    double m_min_x = 0;
+    double m_min_y = 0;
+    double m_inv_cell = 1.0;
+    std::size_t m_cols = 0;
+    std::size_t m_rows = 0;
+    std::vector<std::size_t> m_grid;
+
+    std::size_t m_last = INVALID_INDEX;
+};
+
+} //namespace delaunator